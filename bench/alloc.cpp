@@ -0,0 +1,376 @@
+#include "../src/allocator.h"
+#include "../src/array.h"
+#include "../src/def.h"
+#include "../src/number.h"
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Allocator microbenchmarks
+//
+// Every workload runs against each allocator of allocator.h through the type-erased Allocator,
+// as the app uses them, with a fresh allocator per sample:
+//
+//   churn     small objects (16 to 128 bytes) allocated and freed at random, 1024 live
+//   append    ArrayList<u64>::append up to 1M items
+//   strings   four strings grown a few bytes at a time by exact-size realloc, interleaved
+//   mixed     16 B to 16 KB blocks freed in random order and replaced, 4096 live
+//
+// Next to ns/op, each result reports the peak of live bytes, the peak of bytes the allocator
+// held to serve them (arena blocks, the used part of a fixed buffer), the difference as waste,
+// and the growth of the resident set. malloc-backed allocators do not expose what they hold, so
+// for them the resident set is the only measure of overhead.
+//
+// Run with `./build.sh bench-alloc [options]`.
+
+constexpr usize ALLOC_CHURN_SLOTS = 1024;
+constexpr usize ALLOC_CHURN_OPS = 100000;
+constexpr usize ALLOC_APPEND_ITEMS = 1000000;
+constexpr usize ALLOC_STRING_COUNT = 4;
+constexpr usize ALLOC_STRING_APPENDS = 4096;
+constexpr usize ALLOC_MIXED_SLOTS = 4096;
+constexpr usize ALLOC_MIXED_OPS = 20000;
+// Big enough for the worst workload on an allocator that never reuses memory; pages that are
+// never touched cost nothing
+constexpr usize ALLOC_FIXED_BUFFER_SIZE = MB(256);
+
+/// @brief Passes calls through to `child`, keeping count of the bytes live.
+struct CountingAllocator {
+    Allocator child;
+    u64 live;
+    u64 peak;
+
+    static CountingAllocator init(Allocator child) {
+        return CountingAllocator{
+            .child = child,
+            .live = 0,
+            .peak = 0,
+        };
+    }
+
+    Allocator allocator() { return Allocator::init(this, alloc_impl, realloc_impl, free_impl); }
+
+  private:
+    static void* alloc_impl(void* context, usize size, usize alignment) {
+        CountingAllocator* counting = (CountingAllocator*)context;
+
+        void* ptr = counting->child.alloc(size, alignment);
+        if (ptr) counting->grow(size);
+        return ptr;
+    }
+
+    static void*
+    realloc_impl(void* context, void* ptr, usize old_size, usize new_size, usize alignment) {
+        CountingAllocator* counting = (CountingAllocator*)context;
+
+        void* new_ptr = counting->child.realloc(ptr, old_size, new_size, alignment);
+        if (new_ptr) {
+            counting->live -= ptr ? old_size : 0;
+            counting->grow(new_size);
+        }
+        return new_ptr;
+    }
+
+    static void free_impl(void* context, void* ptr, usize size, usize alignment) {
+        CountingAllocator* counting = (CountingAllocator*)context;
+
+        if (!ptr) return;
+        counting->child.free(ptr, size, alignment);
+        counting->live -= size;
+    }
+
+    void grow(usize size) {
+        live += size;
+        if (live > peak) peak = live;
+    }
+};
+
+enum AllocatorKind {
+    AllocatorKindPage,
+    AllocatorKindFixedBuffer,
+    AllocatorKindArena,
+    AllocatorKindGeneralPurpose,
+};
+
+constexpr AllocatorKind ALLOCATOR_KINDS[] = {
+    AllocatorKindPage,
+    AllocatorKindFixedBuffer,
+    AllocatorKindArena,
+    AllocatorKindGeneralPurpose,
+};
+
+constexpr string allocator_kind_name(AllocatorKind kind) {
+    switch (kind) {
+        case AllocatorKindPage: return "page";
+        case AllocatorKindFixedBuffer: return "fixed";
+        case AllocatorKindArena: return "arena";
+        case AllocatorKindGeneralPurpose: return "gpa";
+    }
+
+    return "?";
+}
+
+/// @brief One allocator under test, counted on the way in and, for those that draw from other
+/// memory, on the way out.
+///
+/// The allocators point at each other, so allocator() links them once the subject has its
+/// final address, and the subject must not move after that.
+struct AllocatorSubject {
+    AllocatorKind kind;
+    // What the workload calls
+    CountingAllocator front;
+    // What an arena takes its blocks from
+    CountingAllocator backing;
+    void* fixed_buffer;
+    FixedBufferAllocator fixed;
+    ArenaAllocator arena;
+    GeneralPurposeAllocator general;
+
+    static AllocatorSubject init(AllocatorKind kind) {
+        bool fixed = kind == AllocatorKindFixedBuffer;
+        void* fixed_buffer = fixed ? malloc(ALLOC_FIXED_BUFFER_SIZE) : nullptr;
+
+        return AllocatorSubject{
+            .kind = kind,
+            .front = CountingAllocator::init(PageAllocator::init()),
+            .backing = CountingAllocator::init(PageAllocator::init()),
+            .fixed_buffer = fixed_buffer,
+            .fixed = FixedBufferAllocator::init(fixed_buffer, fixed ? ALLOC_FIXED_BUFFER_SIZE : 0),
+            .arena = ArenaAllocator::init(PageAllocator::init()),
+            .general = kind == AllocatorKindGeneralPurpose ? GeneralPurposeAllocator::init()
+                                                           : GeneralPurposeAllocator{},
+        };
+    }
+
+    void deinit() {
+        if (kind == AllocatorKindArena) arena.deinit();
+        if (kind == AllocatorKindGeneralPurpose) general.deinit();
+        ::free(fixed_buffer);
+    }
+
+    Allocator allocator() {
+        switch (kind) {
+            case AllocatorKindPage: break;
+            case AllocatorKindFixedBuffer: front.child = fixed.allocator(); break;
+            case AllocatorKindArena:
+                arena.child_allocator = backing.allocator();
+                front.child = arena.allocator();
+                break;
+            case AllocatorKindGeneralPurpose: front.child = general.allocator(); break;
+        }
+
+        return front.allocator();
+    }
+
+    /// @brief Raises the marks of `memory` to this subject's.
+    void record(BenchMemory& memory) {
+        u64 reserved = 0;
+        if (kind == AllocatorKindFixedBuffer) reserved = fixed.offset;
+        if (kind == AllocatorKindArena) reserved = backing.peak;
+
+        if (front.peak > memory.live_peak) memory.live_peak = front.peak;
+        if (reserved > memory.reserved_peak) memory.reserved_peak = reserved;
+    }
+};
+
+bool churn(Allocator allocator, BenchRandom& random) {
+    void* slots[ALLOC_CHURN_SLOTS] = {};
+    usize sizes[ALLOC_CHURN_SLOTS] = {};
+    defer {
+        for (usize i = 0; i < ALLOC_CHURN_SLOTS; i++) allocator.free(slots[i], sizes[i]);
+    };
+
+    for (usize op = 0; op < ALLOC_CHURN_OPS; op++) {
+        usize slot = random.below(ALLOC_CHURN_SLOTS);
+        allocator.free(slots[slot], sizes[slot]);
+
+        sizes[slot] = 16 + random.below(113);
+        slots[slot] = allocator.alloc(sizes[slot]);
+        if (!slots[slot]) return false;
+        memset(slots[slot], 0xAB, sizes[slot]);
+    }
+
+    return true;
+}
+
+bool append(Allocator allocator, BenchRandom& random) {
+    (void)random;
+
+    auto list = ArrayList<u64>::init(allocator);
+    defer { list.deinit(); };
+
+    for (usize i = 0; i < ALLOC_APPEND_ITEMS; i++) {
+        if (!list.append(i)) return false;
+    }
+
+    return true;
+}
+
+bool strings(Allocator allocator, BenchRandom& random) {
+    char* texts[ALLOC_STRING_COUNT] = {};
+    usize lengths[ALLOC_STRING_COUNT] = {};
+    defer {
+        for (usize i = 0; i < ALLOC_STRING_COUNT; i++) allocator.free(texts[i], lengths[i], 1);
+    };
+
+    for (usize op = 0; op < ALLOC_STRING_APPENDS; op++) {
+        usize i = random.below(ALLOC_STRING_COUNT);
+        usize chunk = 1 + random.below(32);
+
+        char* grown = (char*)allocator.realloc(texts[i], lengths[i], lengths[i] + chunk, 1);
+        if (!grown) return false;
+        memset(grown + lengths[i], 'a' + (int)(op % 26), chunk);
+
+        texts[i] = grown;
+        lengths[i] += chunk;
+    }
+
+    return true;
+}
+
+bool mixed(Allocator allocator, BenchRandom& random) {
+    void* slots[ALLOC_MIXED_SLOTS] = {};
+    usize sizes[ALLOC_MIXED_SLOTS] = {};
+    defer {
+        for (usize i = 0; i < ALLOC_MIXED_SLOTS; i++) allocator.free(slots[i], sizes[i]);
+    };
+
+    for (usize op = 0; op < ALLOC_MIXED_OPS; op++) {
+        usize slot = random.below(ALLOC_MIXED_SLOTS);
+        allocator.free(slots[slot], sizes[slot]);
+
+        // Log-uniform, so every power of two from 16 B to 16 KB is as likely
+        usize base = (usize)16 << random.below(10);
+        sizes[slot] = base + random.below(base);
+        slots[slot] = allocator.alloc(sizes[slot]);
+        if (!slots[slot]) return false;
+        memset(slots[slot], 0xCD, sizes[slot]);
+    }
+
+    return true;
+}
+
+struct AllocWorkload {
+    string name;
+    bool (*run)(Allocator allocator, BenchRandom& random);
+    usize ops;
+};
+
+constexpr AllocWorkload ALLOC_WORKLOADS[] = {
+    {.name = "churn", .run = churn, .ops = ALLOC_CHURN_OPS},
+    {.name = "append", .run = append, .ops = ALLOC_APPEND_ITEMS},
+    {.name = "strings", .run = strings, .ops = ALLOC_STRING_APPENDS},
+    {.name = "mixed", .run = mixed, .ops = ALLOC_MIXED_OPS},
+};
+
+struct AllocOptions {
+    usize runs;
+    usize warmup;
+    u64 seed;
+    // "-" for stdout
+    string json_path;
+    string filter;
+};
+
+bool parse_options(int argc, char* argv[], AllocOptions& options) {
+    for (int i = 1; i < argc; i += 2) {
+        string arg = argv[i];
+        if (i + 1 == argc) return false;
+        string value = argv[i + 1];
+
+        if (strcmp(arg, "--runs") == 0) {
+            auto parsed = int_from_str<usize>(value);
+            if (!parsed.has_value() || parsed.value() == 0) return false;
+            options.runs = parsed.value();
+        } else if (strcmp(arg, "--warmup") == 0) {
+            auto parsed = int_from_str<usize>(value);
+            if (!parsed.has_value()) return false;
+            options.warmup = parsed.value();
+        } else if (strcmp(arg, "--seed") == 0) {
+            auto parsed = int_from_str<u64>(value);
+            if (!parsed.has_value()) return false;
+            options.seed = parsed.value();
+        } else if (strcmp(arg, "--json") == 0) {
+            options.json_path = value;
+        } else if (strcmp(arg, "--filter") == 0) {
+            options.filter = value;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void print_usage() {
+    fprintf(
+        stderr,
+        "Usage: bench_alloc [--runs N] [--warmup N] [--seed N] [--json PATH|-] [--filter NAME]\n"
+        "  --runs     timed samples per workload (default: 20)\n"
+        "  --warmup   untimed samples before them (default: 3)\n"
+        "  --seed     seed of the sizes and of the order of frees (default: 1)\n"
+        "  --json     also write the results as JSON, '-' for stdout\n"
+        "  --filter   only run the workloads whose name contains this, e.g. 'arena' or 'churn/'\n"
+    );
+}
+
+int main(int argc, char* argv[]) {
+    AllocOptions options = AllocOptions{
+        .runs = 20,
+        .warmup = 3,
+        .seed = 1,
+        .json_path = nullptr,
+        .filter = nullptr,
+    };
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    BenchMemory memory = {};
+    Bench bench = Bench::init(PageAllocator::init(), options.filter);
+    bench.memory = &memory;
+    Bench::print_header(stderr, true);
+
+    // "churn/arena" and so on, alive until the results are written
+    char names[BENCH_MAX_RESULTS][32];
+    usize name_count = 0;
+
+    for (const AllocWorkload& workload : ALLOC_WORKLOADS) {
+        for (AllocatorKind kind : ALLOCATOR_KINDS) {
+            if (name_count == BENCH_MAX_RESULTS) break;
+
+            mut_string name = names[name_count++];
+            snprintf(name, sizeof(names[0]), "%s/%s", workload.name, allocator_kind_name(kind));
+
+            bench.run(name, options.warmup, options.runs, BenchUnitOps, workload.ops, [&]() {
+                AllocatorSubject subject = AllocatorSubject::init(kind);
+                defer { subject.deinit(); };
+                if (kind == AllocatorKindFixedBuffer && !subject.fixed_buffer) return false;
+
+                // Every sample sees the same sizes and order
+                BenchRandom random = BenchRandom::init(options.seed);
+                bool ok = workload.run(subject.allocator(), random);
+                subject.record(memory);
+                return ok;
+            });
+        }
+    }
+
+    if (options.json_path) {
+        char context[64];
+        snprintf(context, sizeof(context), "\"seed\": %llu", (unsigned long long)options.seed);
+
+        bool to_stdout = strcmp(options.json_path, "-") == 0;
+        FILE* out = to_stdout ? stdout : fopen(options.json_path, "w");
+        if (!out) {
+            fprintf(stderr, "Error: could not write '%s'\n", options.json_path);
+            return 1;
+        }
+        bench.write_json(out, context);
+        if (!to_stdout) fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,546 @@
+#include "../src/allocator.h"
+#include "../src/bible.h"
+#include "../src/def.h"
+#include "../src/file.h"
+#include "../src/index.h"
+#include "../src/number.h"
+#include "../src/reference.h"
+#include "../src/search.h"
+#include "../src/simd.h"
+#include "../src/string.h"
+#include "../src/xml.h"
+#include "bench.h"
+#include "synthetic.h"
+#include <cstdio>
+
+// End-to-end benchmarks of the hot paths, on a synthetic Bible generated from a fixed seed:
+//
+//   cold_start      open the XML with no index: map and parse everything
+//   warm_start      open the XML through its up-to-date .bidx
+//   warm_start_z    open a dictionary-coded .bidx
+//   parse           parse the mapped XML, in MB/s
+//   lookup          one reference: parse it, resolve it, copy its text out
+//   lookup_z        the same against the dictionary-coded index
+//   batch           BENCH_BATCH_SIZE lookups per sample, in ops/s
+//   search          single and two-word queries, in ops/s
+//   search_phrase   two- and three-word phrases, in ops/s
+//
+// Run with `./build.sh bench [options]`. The page cache is warm for every workload, so
+// cold_start measures the parse, not the disk. Before any of them, the XML classifier and parse
+// of each SIMD level are checked against the scalar path, and a mismatch fails the run.
+
+constexpr usize BENCH_REFERENCE_COUNT = 4096;
+constexpr usize BENCH_BATCH_SIZE = 10000;
+constexpr usize BENCH_QUERY_COUNT = 256;
+// Lookups and searches take a microsecond or so each, so they get this many times the samples
+// of the other workloads for a p99 that rests on more than a handful of them
+constexpr usize BENCH_OP_RUNS_FACTOR = 100;
+
+struct BenchOptions {
+    usize runs;
+    usize warmup;
+    u64 seed;
+    string data_path;
+    // "-" for stdout
+    string json_path;
+    string filter;
+};
+
+// Random references against the structure of `bible`, one in eight a whole chapter and one in
+// eight a short verse range, written one after another into `text`
+bool make_references(
+    Bible& bible,
+    BenchRandom& random,
+    ArrayList<char>& text,
+    ArrayList<StringSlice>& references
+) {
+    // Reserved up front: the slices point into `text`, so it must not grow
+    if (!text.reserve(BENCH_REFERENCE_COUNT * 64)) return false;
+    if (!references.reserve(BENCH_REFERENCE_COUNT)) return false;
+
+    for (usize i = 0; i < BENCH_REFERENCE_COUNT; i++) {
+        usize book = random.below(bible.book_count);
+        usize chapter_index =
+            bible.books[book].first_chapter + random.below(bible.books[book].chapter_count);
+        BibleChapter& chapter = bible.chapters[chapter_index];
+        usize verse = 1 + random.below(chapter.verse_count);
+        StringSlice name = bible.book_name(book);
+
+        char* start = text.items + text.len;
+        usize available = text.capacity - text.len;
+        int len;
+        u64 kind = random.below(8);
+        if (kind == 0) {
+            len = snprintf(
+                start,
+                available,
+                "%.*s %u",
+                (int)name.len,
+                name.ptr,
+                (unsigned)chapter.number
+            );
+        } else if (kind == 1) {
+            len = snprintf(
+                start,
+                available,
+                "%.*s %u:%zu-%zu",
+                (int)name.len,
+                name.ptr,
+                (unsigned)chapter.number,
+                verse,
+                verse + 3
+            );
+        } else {
+            len = snprintf(
+                start,
+                available,
+                "%.*s %u:%zu",
+                (int)name.len,
+                name.ptr,
+                (unsigned)chapter.number,
+                verse
+            );
+        }
+        if (len < 0 || (usize)len >= available) return false;
+
+        text.len += (usize)len;
+        references.append(StringSlice::init(start, (usize)len));
+    }
+
+    return true;
+}
+
+// Queries made of words of one verse, so every query has at least one hit: with `phrase`, two or
+// three consecutive words, otherwise one or two words picked anywhere in the verse
+bool make_queries(
+    Bible& bible,
+    BenchRandom& random,
+    bool phrase,
+    ArrayList<char>& text,
+    ArrayList<StringSlice>& queries
+) {
+    // Reserved up front: the slices point into `text`, so it must not grow
+    if (!text.reserve(BENCH_QUERY_COUNT * 64)) return false;
+    if (!queries.reserve(BENCH_QUERY_COUNT)) return false;
+
+    char scratch[4096];
+    for (usize i = 0; i < BENCH_QUERY_COUNT; i++) {
+        usize start = text.len;
+        usize wanted = phrase ? 2 + random.below(2) : 1 + random.below(2);
+        usize taken = 0;
+
+        while (taken < wanted) {
+            text.len = start;
+            taken = 0;
+
+            usize row = random.below(bible.verse_count);
+            if (bible.verse_text_capacity(row) > sizeof(scratch)) continue;
+
+            auto it = WordIterator::init(bible.verse_plain_text(row, scratch));
+            usize skip = random.below(8);
+            while (auto word = it.next()) {
+                // Phrases skip only before their first word
+                bool skipped = phrase ? taken == 0 && skip > 0 : random.below(2) == 0;
+                if (skip > 0) skip--;
+                if (skipped) continue;
+
+                if (text.len + word->len + 1 > text.capacity) return false;
+                if (taken > 0) text.items[text.len++] = ' ';
+                memcpy(text.items + text.len, word->ptr, word->len);
+                text.len += word->len;
+
+                if (++taken == wanted) break;
+            }
+        }
+
+        queries.append(StringSlice::init(text.items + start, text.len - start));
+    }
+
+    return true;
+}
+
+// Resolves `reference` and copies the text of its verses into `out`, the same work as printing
+// it minus the write.
+// @return Bytes of verse text, 0 when the reference does not resolve.
+usize lookup(
+    Bible& bible,
+    StringSlice reference,
+    ArrayList<VerseRange>& ranges,
+    ArrayList<char>& out
+) {
+    out.clear();
+
+    auto parsed = Reference::parse(reference, ranges);
+    if (!parsed.has_value()) return 0;
+
+    auto book_index = bible.find_book(parsed->book);
+    if (!book_index.has_value()) return 0;
+
+    for (usize i = 0; i < ranges.len; i++) {
+        RowSpan span =
+            bible.find_verse_span(book_index.value(), ranges.items[i].first, ranges.items[i].last);
+
+        for (usize row = span.first; row < span.end; row++) {
+            if (!out.reserve(bible.verse_text_capacity(row) + 1)) return 0;
+
+            bible.verse_text_runs(row, [&](StringSlice run) {
+                memcpy(out.items + out.len, run.ptr, run.len);
+                out.len += run.len;
+            });
+            out.items[out.len++] = '\n';
+        }
+    }
+
+    return out.len;
+}
+
+// Whether the classifier of `level` gives the scalar one's masks: on blocks holding every byte
+// value, on each structural byte alone at every position, and on the blocks of `data` at an odd
+// stride, so they start at every alignment
+bool same_classifier_masks(SimdLevel level, const u8* data, usize size) {
+    XmlClassifyFn classify = xml_classify_for(level);
+    u8 block[XML_BLOCK_SIZE];
+
+    for (usize first = 0; first < 256; first += XML_BLOCK_SIZE) {
+        for (usize i = 0; i < XML_BLOCK_SIZE; i++) block[i] = (u8)(first + i);
+        if (classify(block) != xml_classify_scalar(block)) return false;
+    }
+
+    const u8 structural[] = {'<', '>', '"', '\''};
+    for (u8 c : structural) {
+        for (usize i = 0; i < XML_BLOCK_SIZE; i++) {
+            memset(block, 'a', sizeof(block));
+            block[i] = c;
+            if (classify(block) != xml_classify_scalar(block)) return false;
+        }
+    }
+
+    for (usize offset = 0; offset + XML_BLOCK_SIZE <= size; offset += XML_BLOCK_SIZE - 1) {
+        if (classify(data + offset) != xml_classify_scalar(data + offset)) return false;
+    }
+
+    return true;
+}
+
+// Whether two parses of the same mapping built the same tables
+bool same_tables(Bible& a, Bible& b) {
+    bool same = a.text == b.text && a.text_is_xml == b.text_is_xml &&
+                a.verse_count == b.verse_count && a.book_count == b.book_count &&
+                a.chapter_count == b.chapter_count && a.versification == b.versification;
+    if (!same) return false;
+
+    usize rows = a.verse_count;
+    same = memcmp(a.verse_books, b.verse_books, sizeof(u8) * rows) == 0 &&
+           memcmp(a.verse_chapters, b.verse_chapters, sizeof(u16) * rows) == 0 &&
+           memcmp(a.verse_numbers, b.verse_numbers, sizeof(u16) * rows) == 0 &&
+           memcmp(a.text_offsets, b.text_offsets, sizeof(u32) * rows) == 0 &&
+           memcmp(a.text_lengths, b.text_lengths, sizeof(u32) * rows) == 0;
+
+    for (usize i = 0; i < a.book_count && same; i++) {
+        BibleBook& x = a.books[i];
+        BibleBook& y = b.books[i];
+        same = x.id == y.id && x.name.equals(y.name) && x.first_chapter == y.first_chapter &&
+               x.chapter_count == y.chapter_count;
+    }
+
+    // Field by field: the padding after `number` is never written
+    for (usize i = 0; i < a.chapter_count && same; i++) {
+        BibleChapter& x = a.chapters[i];
+        BibleChapter& y = b.chapters[i];
+        same = x.number == y.number && x.first_verse == y.first_verse &&
+               x.verse_count == y.verse_count;
+    }
+
+    return same;
+}
+
+// Checks every vector path the CPU has (capped by BIBLE_SIMD) against the scalar one, so they
+// cannot drift apart behind timings that still look fine
+bool check_simd_paths(MappedFile file) {
+    ArenaAllocator scratch_arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+    Allocator scratch = scratch_arena.allocator();
+    defer { scratch_arena.deinit(); };
+
+    auto scalar = Bible::parse(scratch, file, SimdScalar);
+    if (!scalar.has_value()) {
+        fprintf(stderr, "Error: the scalar parse failed\n");
+        return false;
+    }
+
+    for (i32 level = SimdScalar + 1; level <= (i32)simd_level(); level++) {
+        string name = simd_level_name((SimdLevel)level);
+        if (!same_classifier_masks((SimdLevel)level, file.data, file.size)) {
+            fprintf(stderr, "Error: the %s classifier disagrees with the scalar one\n", name);
+            return false;
+        }
+
+        auto parsed = Bible::parse(scratch, file, (SimdLevel)level);
+        if (!parsed.has_value() || !same_tables(scalar.value(), parsed.value())) {
+            fprintf(stderr, "Error: the %s parse differs from the scalar one\n", name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool parse_options(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; i += 2) {
+        string arg = argv[i];
+        if (i + 1 == argc) return false;
+        string value = argv[i + 1];
+
+        if (strcmp(arg, "--runs") == 0) {
+            auto parsed = int_from_str<usize>(value);
+            if (!parsed.has_value() || parsed.value() == 0) return false;
+            options.runs = parsed.value();
+        } else if (strcmp(arg, "--warmup") == 0) {
+            auto parsed = int_from_str<usize>(value);
+            if (!parsed.has_value()) return false;
+            options.warmup = parsed.value();
+        } else if (strcmp(arg, "--seed") == 0) {
+            auto parsed = int_from_str<u64>(value);
+            if (!parsed.has_value()) return false;
+            options.seed = parsed.value();
+        } else if (strcmp(arg, "--data") == 0) {
+            options.data_path = value;
+        } else if (strcmp(arg, "--json") == 0) {
+            options.json_path = value;
+        } else if (strcmp(arg, "--filter") == 0) {
+            options.filter = value;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void print_usage() {
+    fprintf(
+        stderr,
+        "Usage: bench [--runs N] [--warmup N] [--seed N] [--data PATH] [--json PATH|-] "
+        "[--filter NAME]\n"
+        "  --runs     timed samples per workload, 100 times that for lookups and searches\n"
+        "             (default: 30)\n"
+        "  --warmup   untimed samples before them (default: 5)\n"
+        "  --seed     seed of the synthetic Bible and of the queries (default: 1)\n"
+        "  --data     where to write the synthetic XML (default: build/bench.xml)\n"
+        "  --json     also write the results as JSON, '-' for stdout\n"
+        "  --filter   only run the workloads whose name contains this\n"
+    );
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options = BenchOptions{
+        .runs = 30,
+        .warmup = 5,
+        .seed = 1,
+        .data_path = "build/bench.xml",
+        .json_path = nullptr,
+        .filter = nullptr,
+    };
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 1;
+    }
+
+    ArenaAllocator arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+    Allocator allocator = arena.allocator();
+    defer { arena.deinit(); };
+
+    string xml_path = options.data_path;
+
+    char index_path[4096];
+    char search_path[4096];
+    char compressed_path[4096];
+    int compressed_len =
+        snprintf(compressed_path, sizeof(compressed_path), "%s.z.bidx", options.data_path);
+    bool paths_ok = BibleIndex::path_for(xml_path, index_path, sizeof(index_path)) &&
+                    SearchIndex::path_for(xml_path, search_path, sizeof(search_path)) &&
+                    compressed_len > 0 && (usize)compressed_len < sizeof(compressed_path);
+    if (!paths_ok) {
+        fprintf(stderr, "Error: data path too long\n");
+        return 1;
+    }
+
+    // Regenerate everything, so a changed seed or format never meets a stale index
+    remove(index_path);
+    remove(search_path);
+    remove(compressed_path);
+
+    SyntheticBible synthetic = SyntheticBible::init(allocator, options.seed);
+    defer { synthetic.deinit(); };
+    if (!synthetic.write(xml_path)) {
+        fprintf(stderr, "Error: could not write '%s'\n", xml_path);
+        return 1;
+    }
+
+    auto source = FileInfo::init(xml_path);
+    auto loaded = Bible::load(allocator, xml_path);
+    if (!source.has_value() || !loaded.has_value()) {
+        fprintf(stderr, "Error: could not load '%s'\n", xml_path);
+        return 1;
+    }
+
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    bool indexed = !BibleIndex::write(allocator, bible, source.value(), index_path).has_value() &&
+                   !BibleIndex::write(allocator, bible, source.value(), compressed_path, true)
+                        .has_value();
+    auto search_index = search_index_open(bible, xml_path);
+    if (!indexed || !search_index.has_value()) {
+        fprintf(stderr, "Error: could not index '%s'\n", xml_path);
+        return 1;
+    }
+    defer { search_index->deinit(); };
+
+    // What lookups see once the index is built, plain and dictionary-coded
+    auto plain_loaded = bible_open(allocator, xml_path);
+    auto compressed_loaded = bible_open(allocator, compressed_path);
+    if (!plain_loaded.has_value() || !compressed_loaded.has_value()) {
+        fprintf(stderr, "Error: could not open the indexes of '%s'\n", xml_path);
+        return 1;
+    }
+
+    Bible plain = plain_loaded.value();
+    defer { plain.deinit(); };
+    Bible compressed = compressed_loaded.value();
+    defer { compressed.deinit(); };
+
+    // Inputs, drawn from their own stream so adding a workload does not change the others'
+    BenchRandom random = BenchRandom::init(options.seed ^ 0x5EED);
+
+    auto reference_text = ArrayList<char>::init(allocator);
+    auto references = ArrayList<StringSlice>::init(allocator);
+    auto query_text = ArrayList<char>::init(allocator);
+    auto queries = ArrayList<StringSlice>::init(allocator);
+    auto phrase_text = ArrayList<char>::init(allocator);
+    auto phrases = ArrayList<StringSlice>::init(allocator);
+    bool inputs_ok = make_references(bible, random, reference_text, references) &&
+                     make_queries(bible, random, false, query_text, queries) &&
+                     make_queries(bible, random, true, phrase_text, phrases);
+    if (!inputs_ok) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    auto ranges = ArrayList<VerseRange>::init(allocator);
+    auto text = ArrayList<char>::init(allocator);
+    auto hits = ArrayList<SearchHit>::init(allocator);
+
+    auto mapped = MappedFile::init(xml_path);
+    if (!mapped.has_value()) {
+        fprintf(stderr, "Error: could not map '%s'\n", xml_path);
+        return 1;
+    }
+    defer { mapped->deinit(); };
+
+    if (!check_simd_paths(mapped.value())) return 1;
+
+    Bench bench = Bench::init(PageAllocator::init(), options.filter);
+    Bench::print_header(stderr);
+
+    // Every opened Bible gets a fresh arena, torn down with it, as in a fresh process
+    bench.run("cold_start", options.warmup, options.runs, BenchUnitNone, 0, [&]() {
+        ArenaAllocator sample_arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+        Allocator sample = sample_arena.allocator();
+        defer { sample_arena.deinit(); };
+
+        auto opened = Bible::load_parallel(sample, xml_path);
+        if (!opened.has_value()) return false;
+        opened->deinit();
+        return true;
+    });
+
+    bench.run("warm_start", options.warmup, options.runs, BenchUnitNone, 0, [&]() {
+        ArenaAllocator sample_arena = ArenaAllocator::init(PageAllocator::init());
+        Allocator sample = sample_arena.allocator();
+        defer { sample_arena.deinit(); };
+
+        auto opened = bible_open(sample, xml_path);
+        if (!opened.has_value() || opened->text_is_xml) return false;
+        opened->deinit();
+        return true;
+    });
+
+    bench.run("warm_start_z", options.warmup, options.runs, BenchUnitNone, 0, [&]() {
+        ArenaAllocator sample_arena = ArenaAllocator::init(PageAllocator::init());
+        Allocator sample = sample_arena.allocator();
+        defer { sample_arena.deinit(); };
+
+        auto opened = bible_open(sample, compressed_path);
+        if (!opened.has_value() || !opened->text_is_coded()) return false;
+        opened->deinit();
+        return true;
+    });
+
+    bench.run("parse", options.warmup, options.runs, BenchUnitBytes, mapped->size, [&]() {
+        ArenaAllocator sample_arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+        Allocator sample = sample_arena.allocator();
+        defer { sample_arena.deinit(); };
+
+        // The tables live in the arena; the mapping is shared, so no deinit()
+        return Bible::parse(sample, mapped.value()).has_value();
+    });
+
+    // One sample is one operation, so p50 and p99 are per lookup or query
+    usize op_runs = options.runs * BENCH_OP_RUNS_FACTOR;
+    usize op_warmup = options.warmup * BENCH_OP_RUNS_FACTOR;
+
+    usize next_reference = 0;
+    bench.run("lookup", op_warmup, op_runs, BenchUnitOps, 1, [&]() {
+        StringSlice reference = references.items[next_reference++ % references.len];
+        return lookup(plain, reference, ranges, text) > 0;
+    });
+
+    bench.run("lookup_z", op_warmup, op_runs, BenchUnitOps, 1, [&]() {
+        StringSlice reference = references.items[next_reference++ % references.len];
+        return lookup(compressed, reference, ranges, text) > 0;
+    });
+
+    bench.run("batch", options.warmup, options.runs, BenchUnitOps, BENCH_BATCH_SIZE, [&]() {
+        for (usize i = 0; i < BENCH_BATCH_SIZE; i++) {
+            StringSlice reference = references.items[i % references.len];
+            if (lookup(plain, reference, ranges, text) == 0) return false;
+        }
+        return true;
+    });
+
+    usize next_query = 0;
+    bench.run("search", op_warmup, op_runs, BenchUnitOps, 1, [&]() {
+        StringSlice query = queries.items[next_query++ % queries.len];
+        return search_index->search(query, false, hits) && hits.len > 0;
+    });
+
+    bench.run("search_phrase", op_warmup, op_runs, BenchUnitOps, 1, [&]() {
+        StringSlice query = phrases.items[next_query++ % phrases.len];
+        return search_index->search(query, true, hits) && hits.len > 0;
+    });
+
+    if (options.json_path) {
+        char context[512];
+        snprintf(
+            context,
+            sizeof(context),
+            "\"seed\": %llu, \"bytes\": %zu, \"books\": %zu, \"chapters\": %zu, \"verses\": %zu",
+            (unsigned long long)options.seed,
+            mapped->size,
+            bible.book_count,
+            bible.chapter_count,
+            bible.verse_count
+        );
+
+        bool to_stdout = strcmp(options.json_path, "-") == 0;
+        FILE* out = to_stdout ? stdout : fopen(options.json_path, "w");
+        if (!out) {
+            fprintf(stderr, "Error: could not write '%s'\n", options.json_path);
+            return 1;
+        }
+        bench.write_json(out, context);
+        if (!to_stdout) fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "../src/allocator.h"
+#include "../src/def.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Benchmark harness
+//
+// A workload is a callable that is timed as one sample. It runs `warmup` times untimed, then
+// `runs` times timed, and the result keeps p50, p99, mean and min over the samples. A workload
+// that says how much work one sample does (bytes or items) also gets a throughput, computed
+// from the median so one slow outlier does not skew it.
+//
+// A workload can also report memory high-water marks, by pointing `Bench::memory` at a
+// BenchMemory it updates while it runs.
+//
+// Results print as a table for people and as JSON for scripts that track regressions.
+
+constexpr usize BENCH_MAX_RESULTS = 64;
+
+// Reads a "kB" field of /proc/self/status
+inline u64 bench_read_status(string field) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) return 0;
+    defer { fclose(status); };
+
+    char line[256];
+    usize field_len = strlen(field);
+    while (fgets(line, sizeof(line), status)) {
+        if (strncmp(line, field, field_len) == 0) {
+            return strtoull(line + field_len, nullptr, 10) * KB(1);
+        }
+    }
+
+    return 0;
+}
+
+inline u64 bench_now_ns() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+/// @brief Resets the process' peak resident set size to the current one (Linux only).
+/// @return The current resident set size in bytes, 0 when it cannot be read.
+inline u64 bench_reset_peak_rss() {
+    FILE* clear_refs = fopen("/proc/self/clear_refs", "w");
+    if (clear_refs) {
+        fputs("5", clear_refs);
+        fclose(clear_refs);
+    }
+
+    return bench_read_status("VmRSS:");
+}
+
+/// @brief The process' peak resident set size in bytes since the last reset, 0 when it cannot
+/// be read.
+inline u64 bench_peak_rss() { return bench_read_status("VmHWM:"); }
+
+/// @brief Deterministic splitmix64 generator.
+struct BenchRandom {
+    u64 state;
+
+    static BenchRandom init(u64 seed) { return BenchRandom{.state = seed}; }
+
+    u64 next() {
+        u64 z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    /// @brief Uniform in [0, bound).
+    u64 below(u64 bound) { return next() % bound; }
+
+    /// @brief Uniform in [0, 1).
+    f64 unit() { return (f64)(next() >> 11) / (f64)(1ull << 53); }
+};
+
+enum BenchUnit {
+    // Latency only
+    BenchUnitNone,
+    // `work` is bytes, reported as MB/s
+    BenchUnitBytes,
+    // `work` is operations, reported as ops/s
+    BenchUnitOps,
+};
+
+// Memory high-water marks of a workload in bytes, 0 when not measured
+struct BenchMemory {
+    // Bytes the workload had allocated and not freed yet
+    u64 live_peak;
+    // Bytes the allocator held from its backing memory to serve them
+    u64 reserved_peak;
+    // Growth of the process' resident set over the workload
+    u64 rss_peak;
+
+    bool measured() { return live_peak || reserved_peak || rss_peak; }
+};
+
+struct BenchResult {
+    string name;
+    usize runs;
+    u64 p50_ns;
+    u64 p99_ns;
+    u64 min_ns;
+    f64 mean_ns;
+    BenchUnit unit;
+    // Work done by one sample
+    u64 work;
+    BenchMemory memory;
+
+    f64 throughput() {
+        if (unit == BenchUnitNone || p50_ns == 0) return 0;
+
+        f64 per_second = (f64)work * 1e9 / (f64)p50_ns;
+        return unit == BenchUnitBytes ? per_second / (f64)MB(1) : per_second;
+    }
+
+    f64 ns_per_op() { return unit == BenchUnitOps && work > 0 ? (f64)p50_ns / (f64)work : 0; }
+
+    string unit_name() {
+        switch (unit) {
+            case BenchUnitNone: return "";
+            case BenchUnitBytes: return "MB/s";
+            case BenchUnitOps: return "ops/s";
+        }
+
+        return "";
+    }
+};
+
+struct Bench {
+    BenchResult results[BENCH_MAX_RESULTS];
+    usize result_count;
+    // Only workloads whose name contains this run, when set
+    string filter;
+    // When set, cleared before each run() and copied into its result
+    BenchMemory* memory;
+    Allocator allocator;
+
+    static Bench init(Allocator allocator, string filter = nullptr) {
+        return Bench{
+            .results = {},
+            .result_count = 0,
+            .filter = filter,
+            .memory = nullptr,
+            .allocator = allocator,
+        };
+    }
+
+    bool selected(string name) { return !filter || strstr(name, filter); }
+
+    /// @brief Times `body` and records the result under `name`.
+    /// @return False when the workload was filtered out, out of memory, or `body` returned
+    /// false (a broken workload, reported on stderr).
+    template <typename F>
+    bool run(string name, usize warmup, usize runs, BenchUnit unit, u64 work, F body) {
+        if (!selected(name) || runs == 0 || result_count == BENCH_MAX_RESULTS) return false;
+
+        u64* samples = allocator.alloc_array<u64>(runs);
+        if (!samples) return false;
+        defer { allocator.free_array(samples, runs); };
+
+        u64 rss_start = 0;
+        if (memory) {
+            *memory = {};
+            rss_start = bench_reset_peak_rss();
+        }
+
+        for (usize i = 0; i < warmup; i++) {
+            if (!body()) {
+                fprintf(stderr, "%s: workload failed\n", name);
+                return false;
+            }
+        }
+
+        for (usize i = 0; i < runs; i++) {
+            u64 start = bench_now_ns();
+            bool ok = body();
+            samples[i] = bench_now_ns() - start;
+
+            if (!ok) {
+                fprintf(stderr, "%s: workload failed\n", name);
+                return false;
+            }
+        }
+
+        std::sort(samples, samples + runs);
+
+        u64 sum = 0;
+        for (usize i = 0; i < runs; i++) sum += samples[i];
+
+        results[result_count++] = BenchResult{
+            .name = name,
+            .runs = runs,
+            .p50_ns = samples[runs / 2],
+            .p99_ns = samples[runs * 99 / 100],
+            .min_ns = samples[0],
+            .mean_ns = (f64)sum / (f64)runs,
+            .unit = unit,
+            .work = work,
+            .memory = {},
+        };
+        if (memory) {
+            u64 rss_peak = bench_peak_rss();
+            memory->rss_peak = rss_peak > rss_start ? rss_peak - rss_start : 0;
+            results[result_count - 1].memory = *memory;
+        }
+        print_result(stderr, results[result_count - 1]);
+        return true;
+    }
+
+    /// @param memory Whether the columns are those of workloads that measure memory.
+    static void print_header(FILE* out, bool memory = false) {
+        if (memory) {
+            fprintf(
+                out,
+                "%-24s %8s %12s %12s %10s %10s %10s %10s %10s\n",
+                "workload",
+                "runs",
+                "p50",
+                "p99",
+                "ns/op",
+                "live",
+                "reserved",
+                "waste",
+                "rss"
+            );
+            return;
+        }
+
+        fprintf(
+            out,
+            "%-24s %8s %12s %12s %12s %14s\n",
+            "workload",
+            "runs",
+            "p50",
+            "p99",
+            "mean",
+            "throughput"
+        );
+    }
+
+    static void print_result(FILE* out, BenchResult& result) {
+        char p50[32];
+        char p99[32];
+        char mean[32];
+        format_duration(p50, sizeof(p50), (f64)result.p50_ns);
+        format_duration(p99, sizeof(p99), (f64)result.p99_ns);
+        format_duration(mean, sizeof(mean), result.mean_ns);
+
+        if (result.memory.measured()) {
+            BenchMemory& memory = result.memory;
+            u64 waste = memory.reserved_peak > memory.live_peak
+                            ? memory.reserved_peak - memory.live_peak
+                            : 0;
+
+            char live[32];
+            char reserved[32];
+            char wasted[32];
+            char rss[32];
+            format_bytes(live, sizeof(live), memory.live_peak);
+            format_bytes(reserved, sizeof(reserved), memory.reserved_peak);
+            format_bytes(wasted, sizeof(wasted), memory.reserved_peak ? waste : 0);
+            format_bytes(rss, sizeof(rss), memory.rss_peak);
+
+            fprintf(
+                out,
+                "%-24s %8zu %12s %12s %10.1f %10s %10s %10s %10s\n",
+                result.name,
+                result.runs,
+                p50,
+                p99,
+                result.ns_per_op(),
+                live,
+                reserved,
+                wasted,
+                rss
+            );
+            return;
+        }
+
+        fprintf(out, "%-24s %8zu %12s %12s %12s", result.name, result.runs, p50, p99, mean);
+        if (result.unit != BenchUnitNone) {
+            fprintf(out, " %9.1f %s", result.throughput(), result.unit_name());
+        }
+        fputc('\n', out);
+    }
+
+    /// @brief Writes the results as a JSON object, with `context` (a JSON object body,
+    /// e.g. `"seed": 1`) describing the run.
+    void write_json(FILE* out, string context) {
+        fprintf(out, "{\n  %s,\n  \"results\": [\n", context);
+
+        for (usize i = 0; i < result_count; i++) {
+            BenchResult& result = results[i];
+            fprintf(
+                out,
+                "    {\"name\": \"%s\", \"runs\": %zu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+                "\"min_ns\": %llu, \"mean_ns\": %.1f",
+                result.name,
+                result.runs,
+                (unsigned long long)result.p50_ns,
+                (unsigned long long)result.p99_ns,
+                (unsigned long long)result.min_ns,
+                result.mean_ns
+            );
+            if (result.unit != BenchUnitNone) {
+                fprintf(
+                    out,
+                    ", \"throughput\": %.3f, \"unit\": \"%s\"",
+                    result.throughput(),
+                    result.unit_name()
+                );
+            }
+            if (result.unit == BenchUnitOps) {
+                fprintf(out, ", \"ns_per_op\": %.2f", result.ns_per_op());
+            }
+            if (result.memory.measured()) {
+                fprintf(
+                    out,
+                    ", \"live_peak\": %llu, \"reserved_peak\": %llu, \"rss_peak\": %llu",
+                    (unsigned long long)result.memory.live_peak,
+                    (unsigned long long)result.memory.reserved_peak,
+                    (unsigned long long)result.memory.rss_peak
+                );
+            }
+            fprintf(out, "}%s\n", i + 1 < result_count ? "," : "");
+        }
+
+        fprintf(out, "  ]\n}\n");
+    }
+
+  private:
+    // "-" for 0, which is a mark that was not measured
+    static void format_bytes(mut_string out, usize size, u64 bytes) {
+        if (bytes == 0) {
+            snprintf(out, size, "-");
+        } else if (bytes < KB(1)) {
+            snprintf(out, size, "%llu B", (unsigned long long)bytes);
+        } else if (bytes < MB(1)) {
+            snprintf(out, size, "%.1f KB", (f64)bytes / (f64)KB(1));
+        } else {
+            snprintf(out, size, "%.1f MB", (f64)bytes / (f64)MB(1));
+        }
+    }
+
+    static void format_duration(mut_string out, usize size, f64 ns) {
+        if (ns < 1e3) {
+            snprintf(out, size, "%.0f ns", ns);
+        } else if (ns < 1e6) {
+            snprintf(out, size, "%.2f us", ns / 1e3);
+        } else if (ns < 1e9) {
+            snprintf(out, size, "%.2f ms", ns / 1e6);
+        } else {
+            snprintf(out, size, "%.2f s", ns / 1e9);
+        }
+    }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "../src/bible.h"
+#include "../src/def.h"
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Synthetic Bible-shaped XML
+//
+// A Zefania XML file with the shape of a real Bible: the 66 books with their KJV chapter counts
+// (1189 chapters), 10 to 40 verses per chapter (about 30k verses, 4 MB), and verse text drawn
+// from a Zipf-distributed vocabulary, with capitals, punctuation and the odd entity for the
+// XML decoder. The file depends only on the seed, so numbers compare across machines and
+// commits.
+
+constexpr u8 SYNTHETIC_CHAPTER_COUNTS[BIBLE_BOOK_COUNT] = {
+    50, 40, 27, 36, 34, 24, 21, 4,  31, 24, 22, 25, 29, 36, 10, 13, 10, 42,  150, 31, 12, 8,
+    66, 52, 5,  48, 12, 14, 3,  9,  1,  4,  7,  3,  3,  3,  2,  14, 4,  28,  16,  24, 21, 28,
+    16, 16, 13, 6,  6,  4,  4,  5,  3,  6,  4,  3,  1,  13, 5,  5,  3,  5,   1,   1,  1,  22,
+};
+
+// The most frequent words; the long tail is made of syllables
+constexpr string SYNTHETIC_COMMON_WORDS[] = {
+    "the",   "and",    "of",     "to",     "that",  "in",    "he",     "shall",  "unto",
+    "for",   "i",      "his",    "a",      "lord",  "they",  "be",     "is",     "him",
+    "not",   "them",   "it",     "with",   "all",   "thou",  "thy",    "was",    "god",
+    "which", "my",     "me",     "said",   "but",   "ye",    "their",  "have",   "will",
+    "thee",  "from",   "as",     "are",    "when",  "this",  "out",    "were",   "upon",
+    "man",   "by",     "you",    "israel", "king",  "son",   "up",     "there",  "hath",
+    "then",  "people", "came",   "had",    "house", "on",    "into",   "her",    "come",
+    "one",   "we",     "children", "s",    "before", "your", "also",   "day",    "land",
+    "men",   "let",    "go",     "against", "over", "earth", "heaven", "light",  "word",
+};
+
+constexpr string SYNTHETIC_SYLLABLES[] = {
+    "ba", "be", "da", "el", "ha", "ja", "ka", "la", "ma", "na", "ra", "sa", "ta", "za",
+    "bi", "di", "hi", "ki", "li", "mi", "ni", "ri", "si", "ti", "zo", "mo", "no", "ro",
+};
+
+constexpr usize SYNTHETIC_VOCABULARY = 12000;
+
+struct SyntheticBible {
+    BenchRandom random;
+    // Cumulative Zipf weights of the vocabulary ranks, normalized to 1
+    f64* zipf;
+    Allocator allocator;
+
+    static SyntheticBible init(Allocator allocator, u64 seed) {
+        f64* zipf = allocator.alloc_array<f64>(SYNTHETIC_VOCABULARY);
+        if (zipf) {
+            f64 sum = 0;
+            for (usize rank = 0; rank < SYNTHETIC_VOCABULARY; rank++) {
+                sum += 1.0 / (f64)(rank + 1);
+                zipf[rank] = sum;
+            }
+            for (usize rank = 0; rank < SYNTHETIC_VOCABULARY; rank++) zipf[rank] /= sum;
+        }
+
+        return SyntheticBible{
+            .random = BenchRandom::init(seed),
+            .zipf = zipf,
+            .allocator = allocator,
+        };
+    }
+
+    void deinit() { allocator.free_array(zipf, SYNTHETIC_VOCABULARY); }
+
+    /// @brief Writes the word of vocabulary rank `rank` into `out` (at least 16 bytes).
+    /// @return Its length.
+    static usize word(usize rank, mut_string out) {
+        constexpr usize common = sizeof(SYNTHETIC_COMMON_WORDS) / sizeof(string);
+        constexpr usize syllables = sizeof(SYNTHETIC_SYLLABLES) / sizeof(string);
+
+        if (rank < common) {
+            usize len = strlen(SYNTHETIC_COMMON_WORDS[rank]);
+            memcpy(out, SYNTHETIC_COMMON_WORDS[rank], len);
+            return len;
+        }
+
+        // Two to four syllables, spelled from the rank's digits in base `syllables`
+        usize len = 0;
+        for (usize n = rank; n > 0 || len < 4; n /= syllables) {
+            memcpy(out + len, SYNTHETIC_SYLLABLES[n % syllables], 2);
+            len += 2;
+            if (len == 8) break;
+        }
+        return len;
+    }
+
+    /// @brief A vocabulary rank, frequent ones first.
+    usize next_rank() {
+        f64 target = random.unit();
+        f64* found = std::lower_bound(zipf, zipf + SYNTHETIC_VOCABULARY, target);
+        usize rank = (usize)(found - zipf);
+        return rank < SYNTHETIC_VOCABULARY ? rank : SYNTHETIC_VOCABULARY - 1;
+    }
+
+    /// @brief Writes the whole Bible to `path`.
+    /// @return False when out of memory or the file could not be written.
+    bool write(string path) {
+        if (!zipf) return false;
+
+        FILE* out = fopen(path, "wb");
+        if (!out) return false;
+
+        fputs("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n", out);
+        fputs("<XMLBIBLE biblename=\"Synthetic\">\n", out);
+
+        char word_buffer[16];
+        for (usize book = 0; book < BIBLE_BOOK_COUNT; book++) {
+            fprintf(
+                out,
+                "  <BIBLEBOOK bnumber=\"%zu\" bname=\"%s\">\n",
+                book + 1,
+                BIBLE_BOOK_NAMES[book]
+            );
+
+            for (usize chapter = 1; chapter <= SYNTHETIC_CHAPTER_COUNTS[book]; chapter++) {
+                fprintf(out, "    <CHAPTER cnumber=\"%zu\">\n", chapter);
+
+                usize verse_count = 10 + random.below(31);
+                for (usize verse = 1; verse <= verse_count; verse++) {
+                    fprintf(out, "      <VERS vnumber=\"%zu\">", verse);
+
+                    usize word_count = 8 + random.below(32);
+                    for (usize i = 0; i < word_count; i++) {
+                        usize len = word(next_rank(), word_buffer);
+                        if (i == 0) word_buffer[0] = (char)(word_buffer[0] - 'a' + 'A');
+                        if (i > 0) fputc(' ', out);
+                        fwrite(word_buffer, 1, len, out);
+
+                        u64 mark = random.below(100);
+                        if (i + 1 == word_count) {
+                            fputc('.', out);
+                        } else if (mark < 8) {
+                            fputc(',', out);
+                        } else if (mark < 10) {
+                            fputc(';', out);
+                        } else if (mark == 10) {
+                            fputs(" &amp;", out);
+                        }
+                    }
+
+                    fputs("</VERS>\n", out);
+                }
+
+                fputs("    </CHAPTER>\n", out);
+            }
+
+            fputs("  </BIBLEBOOK>\n", out);
+        }
+
+        fputs("</XMLBIBLE>\n", out);
+
+        bool ok = !ferror(out);
+        if (fclose(out) != 0) ok = false;
+        return ok;
+    }
+};
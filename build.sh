@@ -1,9 +1,34 @@
 set -e
 
-CC_FLAGS="-std=c++23 -g -Wall -Wextra -Wpedantic -Wno-writable-strings"
+CC_FLAGS="-std=c++23 -g -Wall -Wextra -Wpedantic -Wno-writable-strings -pthread"
 
 mkdir -p build
 
+# ./build.sh bench [options]: builds the end-to-end benchmarks optimized and runs them
+# ./build.sh bench-alloc [options]: the same for the allocator microbenchmarks
+# (see bench/bench.cpp and bench/alloc.cpp)
+if [ "$1" = "bench" ] || [ "$1" = "bench-alloc" ]; then
+    if [ "$1" = "bench" ]; then
+        SOURCE=bench/bench.cpp
+        OUTPUT=build/bench
+    else
+        SOURCE=bench/alloc.cpp
+        OUTPUT=build/bench_alloc
+    fi
+    shift
+
+    echo "Compiling benchmarks"
+
+    clang++ $CC_FLAGS -O2 -DNDEBUG -o $OUTPUT $SOURCE
+
+    echo "Compiled successfully"
+    echo "Executable: $OUTPUT"
+
+    chmod +x $OUTPUT
+    ./$OUTPUT "$@"
+    exit 0
+fi
+
 echo "Compiling application"
 
 clang++ $CC_FLAGS -o build/bible src/main.cpp
@@ -75,6 +75,14 @@ struct Allocator {
         return (T*)(ptr);
     }
 
+    /// @brief Resizes an array from alloc_array(), in place when the allocator can. On failure
+    /// the old array is left as it was.
+    template <typename T>
+    T* realloc_array(T* ptr, usize old_count, usize new_count) {
+        void* new_ptr = realloc(ptr, sizeof(T) * old_count, sizeof(T) * new_count, alignof(T));
+        return (T*)(new_ptr);
+    }
+
     template <typename T> 
     void free_array(T* ptr, usize count) {
         if (ptr) {
@@ -216,18 +224,30 @@ struct ArenaAllocator {
         usize offset;
     };
 
+    /// @brief A point in the arena to roll back to, see save() and restore().
+    struct Marker {
+        Block* block;
+        usize offset;
+    };
+
     Block* current_block;
+    // Blocks given back by restore() or reset(), kept for reuse until deinit()
+    Block* free_blocks;
     usize block_size;
     usize max_size;
+    // Held blocks, free ones included, so max_size bounds what is taken from the child
     usize total_allocated;
+    usize block_count;
 
     static ArenaAllocator init(Allocator child, usize block_size = 4096, usize max_size = 0) {
         return ArenaAllocator{
             .child_allocator = child,
             .current_block = nullptr,
+            .free_blocks = nullptr,
             .block_size = block_size,
             .max_size = max_size,
             .total_allocated = 0,
+            .block_count = 0,
         };
     }
 
@@ -236,17 +256,39 @@ struct ArenaAllocator {
     }
 
     void deinit() {
-        Block* block = current_block;
-        while (block) {
-            Block* next = block->next;
-            child_allocator.free(block, block->size + sizeof(Block), alignof(Block));
-            block = next;
-        }
+        free_list(current_block);
+        free_list(free_blocks);
 
         current_block = nullptr;
+        free_blocks = nullptr;
         total_allocated = 0;
+        block_count = 0;
     }
 
+    /// @brief Marks the current end of the arena, for restore() to roll back to.
+    Marker save() {
+        return Marker{
+            .block = current_block,
+            .offset = current_block ? current_block->offset : 0,
+        };
+    }
+
+    /// @brief Frees everything allocated since `marker` was saved. Blocks started since then go
+    /// to the free list instead of the child allocator. Markers saved after `marker` become
+    /// invalid.
+    void restore(Marker marker) {
+        while (current_block && current_block != marker.block) {
+            Block* block = current_block;
+            current_block = block->next;
+            block->next = free_blocks;
+            free_blocks = block;
+        }
+        if (current_block) current_block->offset = marker.offset;
+    }
+
+    /// @brief Frees every allocation but keeps the blocks for reuse, e.g. between requests.
+    void reset() { restore(Marker{.block = nullptr, .offset = 0}); }
+
   private:
     static void* alloc_impl(void* context, usize size, usize alignment) {
         ArenaAllocator* arena = (ArenaAllocator*)(context);
@@ -265,6 +307,19 @@ struct ArenaAllocator {
 
     static void*
     realloc_impl(void* context, void* ptr, usize old_size, usize new_size, usize alignment) {
+        ArenaAllocator* arena = (ArenaAllocator*)(context);
+
+        // Extend or shrink in place when this is the last allocation and it still fits
+        u8* start = arena->top_allocation(ptr, old_size);
+        if (start) {
+            u8* data = (u8*)(arena->current_block + 1);
+            if ((usize)(start - data) + new_size <= arena->current_block->size) {
+                arena->current_block->offset = (usize)(start - data) + new_size;
+                return ptr;
+            }
+        }
+
+        // Otherwise allocate new memory and copy
         void* new_ptr = alloc_impl(context, new_size, alignment);
 
         if (new_ptr && ptr) {
@@ -275,16 +330,39 @@ struct ArenaAllocator {
     }
 
     static void free_impl(void* context, void* ptr, usize size, usize alignment) {
-        (void)context;
-        (void)ptr;
-        (void)size;
+        ArenaAllocator* arena = (ArenaAllocator*)(context);
         (void)alignment;
-        // noop for arena allocator
+
+        // Only the last allocation can be given back, anything else waits for reset()
+        u8* start = arena->top_allocation(ptr, size);
+        if (start) arena->current_block->offset = (usize)(start - (u8*)(arena->current_block + 1));
+    }
+
+    // `ptr` when it is the most recent allocation of the current block, null otherwise
+    u8* top_allocation(void* ptr, usize size) {
+        if (!ptr || !current_block) return nullptr;
+
+        u8* end = (u8*)(current_block + 1) + current_block->offset;
+        if ((u8*)ptr + size != end) return nullptr;
+        return (u8*)ptr;
     }
 
     bool ensure_capacity(usize size, usize alignment) {
         if (!current_block ||
             align_forward(current_block->offset, alignment) + size > current_block->size) {
+            // A free block that fits comes before asking the child for a new one
+            Block** link = &free_blocks;
+            while (*link && (*link)->size < size) link = &(*link)->next;
+            if (*link) {
+                Block* block = *link;
+                *link = block->next;
+
+                block->next = current_block;
+                block->offset = 0;
+                current_block = block;
+                return true;
+            }
+
             usize new_block_size = size > block_size ? size : block_size;
             usize block_total_size = sizeof(Block) + new_block_size;
 
@@ -304,11 +382,20 @@ struct ArenaAllocator {
             new_block->offset = 0;
             current_block = new_block;
             total_allocated += block_total_size;
+            block_count++;
         }
 
         return true;
     }
 
+    void free_list(Block* block) {
+        while (block) {
+            Block* next = block->next;
+            child_allocator.free(block, block->size + sizeof(Block), alignof(Block));
+            block = next;
+        }
+    }
+
     usize align_forward(usize addr, usize alignment) {
         return (addr + alignment - 1) & ~(alignment - 1);
     }
@@ -223,13 +223,10 @@ template <typename T> struct ArrayList {
         while (new_capacity < min_capacity)
             new_capacity *= 2;
 
-        T* new_items = allocator.alloc_array<T>(new_capacity);
+        // An arena extends its last allocation in place instead of leaving the old copy behind
+        T* new_items = allocator.realloc_array<T>(items, capacity, new_capacity);
         if (!new_items) return false;
 
-        if (items && len > 0) memcpy(new_items, items, sizeof(T) * len);
-
-        if (items) allocator.free_array(items, capacity);
-
         items = new_items;
         capacity = new_capacity;
         return true;
@@ -1 +1,956 @@
 #pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "books.h"
+#include "compress.h"
+#include "def.h"
+#include "file.h"
+#include "number.h"
+#include "string.h"
+#include "timing.h"
+#include "trace.h"
+#include "versification.h"
+#include "xml.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <new>
+#include <optional>
+#include <thread>
+
+enum BibleError {
+    BibleFileNotFound,
+    BibleMalformedXml,
+    BibleOutOfMemory,
+    BibleEmpty,
+    BibleInvalidIndex,
+    BibleStaleIndex,
+    BibleWriteFailed,
+    BibleBookNotFound,
+    BibleChapterNotFound,
+};
+
+inline string bible_error_message(BibleError error) {
+    switch (error) {
+        case BibleFileNotFound: return "could not open file";
+        case BibleMalformedXml: return "malformed XML";
+        case BibleOutOfMemory: return "out of memory";
+        case BibleEmpty: return "no verses found";
+        case BibleInvalidIndex: return "not a valid index file";
+        case BibleStaleIndex: return "index is older than its source file";
+        case BibleWriteFailed: return "could not write file";
+        case BibleBookNotFound: return "book not found";
+        case BibleChapterNotFound: return "chapter not found";
+    }
+
+    return "unknown error";
+}
+
+// Canonical (Protestant) book order, used when a file does not carry book names.
+constexpr string BIBLE_BOOK_NAMES[] = {
+    "Genesis",         "Exodus",          "Leviticus",     "Numbers",         "Deuteronomy",
+    "Joshua",          "Judges",          "Ruth",          "1 Samuel",        "2 Samuel",
+    "1 Kings",         "2 Kings",         "1 Chronicles",  "2 Chronicles",    "Ezra",
+    "Nehemiah",        "Esther",          "Job",           "Psalms",          "Proverbs",
+    "Ecclesiastes",    "Song of Solomon", "Isaiah",        "Jeremiah",        "Lamentations",
+    "Ezekiel",         "Daniel",          "Hosea",         "Joel",            "Amos",
+    "Obadiah",         "Jonah",           "Micah",         "Nahum",           "Habakkuk",
+    "Zephaniah",       "Haggai",          "Zechariah",     "Malachi",         "Matthew",
+    "Mark",            "Luke",            "John",          "Acts",            "Romans",
+    "1 Corinthians",   "2 Corinthians",   "Galatians",     "Ephesians",       "Philippians",
+    "Colossians",      "1 Thessalonians", "2 Thessalonians", "1 Timothy",     "2 Timothy",
+    "Titus",           "Philemon",        "Hebrews",       "James",           "1 Peter",
+    "2 Peter",         "1 John",          "2 John",        "3 John",          "Jude",
+    "Revelation",
+};
+
+constexpr usize BIBLE_BOOK_COUNT = sizeof(BIBLE_BOOK_NAMES) / sizeof(BIBLE_BOOK_NAMES[0]);
+
+struct BibleBook {
+    // Canonical book number (1 = Genesis ... 66 = Revelation)
+    u8 id;
+    // Book name as written in the file. Empty when the file does not name its books.
+    StringSlice name;
+    // Range of this book's chapters in the chapter table
+    u32 first_chapter;
+    u32 chapter_count;
+};
+
+struct BibleChapter {
+    u16 number;
+    // Range of this chapter's verses in the verse table
+    u32 first_verse;
+    u32 verse_count;
+};
+
+/// @brief Verse rows [first, end).
+struct RowSpan {
+    u32 first;
+    u32 end;
+
+    bool is_empty() { return first >= end; }
+};
+
+/// @brief A Bible translation loaded from a Zefania (`<BIBLEBOOK>/<CHAPTER>/<VERS>`) or
+/// Beblia (`<book>/<chapter>/<verse>`) XML file.
+///
+/// The file is memory-mapped and never copied: verse text is served as slices of the mapping.
+/// Verses live in a structure-of-arrays table with one row per verse, so scans over a single
+/// column (e.g. all chapter numbers) stay dense in cache.
+struct Bible {
+    MappedFile file;
+    // Base pointer of the verse text. Text offsets are relative to it.
+    string text;
+    // Bytes at `text`, the end of the last coded verse
+    usize text_size;
+    // True when verse text is raw XML character data that still needs decoding
+    // (see xml_text_runs). False when it is plain UTF-8.
+    bool text_is_xml;
+    // Set (count > 0) when verse text is dictionary-coded (see compress.h). Text offsets then
+    // point at a verse's codes, and text lengths are its decoded length.
+    TextDictionary text_dictionary;
+
+    // Verse table, one row per verse, in document order
+    u8* verse_books;
+    u16* verse_chapters;
+    u16* verse_numbers;
+    u32* text_offsets;
+    u32* text_lengths;
+    usize verse_count;
+
+    BibleBook* books;
+    usize book_count;
+
+    BibleChapter* chapters;
+    usize chapter_count;
+
+    // How the file numbers its chapters and verses, see detect_versification()
+    Versification versification;
+
+    /// @brief Maps the XML file at `path` and builds the verse table.
+    /// The tables are allocated from `allocator` and live as long as it does; the mapping is
+    /// released by deinit().
+    static std::expected<Bible, BibleError> load(Allocator& allocator, string path) {
+        auto file = MappedFile::init(path);
+        if (!file.has_value()) return std::unexpected(BibleFileNotFound);
+
+        file->advise_sequential();
+
+        StatsTimer timer = StatsTimer::init(StatsPhaseParse);
+        auto bible = parse(allocator, file.value());
+        timer.stop();
+        process_stats.add_bytes(file->size);
+        if (!bible.has_value()) {
+            file->deinit();
+            return bible;
+        }
+
+        // After the initial scan lookups only touch the chapters they print
+        file->advise_random();
+        return bible;
+    }
+
+    /// @brief Builds the verse table from an XML document that is already in memory.
+    /// @param level Instruction set of the tokenizer's classifier, e.g. to check a vector path
+    /// against the scalar one.
+    static std::expected<Bible, BibleError>
+    parse(Allocator& allocator, MappedFile file, SimdLevel level = simd_level()) {
+        BibleBuilder builder = BibleBuilder::init(allocator);
+        defer { builder.deinit(); };
+
+        string data = (string)file.data;
+        auto tokenizer = XmlTokenizer::init(data, file.size, 0, level);
+
+        if (!builder.parse_range(tokenizer)) return std::unexpected(builder.error);
+        if (builder.verse_books.len == 0) return std::unexpected(BibleEmpty);
+
+        return builder.finish(file, data);
+    }
+
+    /// @brief Maps the XML file at `path` and parses only chapter `chapter` of the book matching
+    /// `book_query` (see find_book).
+    ///
+    /// Books and chapters that do not match are skipped by searching for their closing tag,
+    /// without tokenizing their contents, and parsing stops at the end of the requested chapter.
+    /// The result holds a single book with a single chapter.
+    static std::expected<Bible, BibleError>
+    load_chapter(Allocator& allocator, string path, StringSlice book_query, usize chapter) {
+        auto file = MappedFile::init(path);
+        if (!file.has_value()) return std::unexpected(BibleFileNotFound);
+
+        BibleBuilder builder = BibleBuilder::init(allocator);
+        defer { builder.deinit(); };
+
+        string data = (string)file->data;
+        auto tokenizer = XmlTokenizer::init(data, file->size);
+
+        StatsTimer timer = StatsTimer::init(StatsPhaseParse);
+        defer {
+            timer.stop();
+            process_stats.add_bytes(tokenizer.pos);
+        };
+
+        if (!builder.parse_chapter(tokenizer, book_query.trim(), chapter)) {
+            file->deinit();
+            return std::unexpected(builder.error);
+        }
+
+        return builder.finish(file.value(), data);
+    }
+
+    /// @brief Same as load(), but parses the books on up to `thread_count` worker threads.
+    ///
+    /// A quick pre-scan finds the top-level book elements. Workers then claim books one at a
+    /// time, parse each into their own ArenaAllocator, and the partial tables are merged into
+    /// `allocator` in document order. The result is identical to load().
+    /// @param thread_count Number of workers, or 0 for one per hardware thread.
+    static std::expected<Bible, BibleError>
+    load_parallel(Allocator& allocator, string path, usize thread_count = 0) {
+        if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+        if (thread_count <= 1) return load(allocator, path);
+
+        auto file = MappedFile::init(path);
+        if (!file.has_value()) return std::unexpected(BibleFileNotFound);
+
+        file->advise_sequential();
+
+        StatsTimer timer = StatsTimer::init(StatsPhaseParse);
+        auto bible = parse_parallel(allocator, file.value(), thread_count);
+        timer.stop();
+        process_stats.add_bytes(file->size);
+        if (!bible.has_value()) {
+            file->deinit();
+            return bible;
+        }
+
+        file->advise_random();
+        return bible;
+    }
+
+    static std::expected<Bible, BibleError>
+    parse_parallel(Allocator& allocator, MappedFile file, usize thread_count) {
+        string data = (string)file.data;
+
+        // Scratch for the pre-scan and the per-book results, released once merged
+        ArenaAllocator scratch_arena = ArenaAllocator::init(PageAllocator::init(), KB(64));
+        Allocator scratch = scratch_arena.allocator();
+        defer { scratch_arena.deinit(); };
+
+        auto ranges = ArrayList<BookRange>::init(scratch);
+        if (!find_book_ranges(data, file.size, ranges)) return std::unexpected(BibleOutOfMemory);
+        if (ranges.len < 2) return parse(allocator, file); // Nothing to split
+
+        BookResult* results = scratch.alloc_array<BookResult>(ranges.len);
+        if (!results) return std::unexpected(BibleOutOfMemory);
+
+        if (thread_count > ranges.len) thread_count = ranges.len;
+
+        ArenaAllocator* arenas = scratch.alloc_array<ArenaAllocator>(thread_count);
+        std::thread* workers = scratch.alloc_array<std::thread>(thread_count);
+        if (!arenas || !workers) return std::unexpected(BibleOutOfMemory);
+
+        std::atomic<usize> next_book = 0;
+
+        for (usize t = 0; t < thread_count; t++) {
+            arenas[t] = ArenaAllocator::init(PageAllocator::init(), MB(1));
+            new (&workers[t]) std::thread([&, t]() {
+                Allocator worker_allocator = arenas[t].allocator();
+                trace_thread_name("parse worker");
+
+                // Books are claimed one at a time, so a long book (Psalms) does not hold up a
+                // statically assigned share of the others
+                while (true) {
+                    usize i = next_book.fetch_add(1);
+                    if (i >= ranges.len) break;
+
+                    trace_scope("parse book", (i64)i);
+                    BookRange range = ranges.items[i];
+                    results[i].builder = BibleBuilder::init(worker_allocator);
+                    results[i].builder.book_ordinal_base = i;
+
+                    auto tokenizer = XmlTokenizer::init(data, range.end, range.start);
+                    results[i].ok = results[i].builder.parse_range(tokenizer);
+                }
+            });
+        }
+
+        for (usize t = 0; t < thread_count; t++) {
+            workers[t].join();
+            workers[t].~thread();
+        }
+
+        defer {
+            for (usize t = 0; t < thread_count; t++) {
+                arenas[t].deinit();
+            }
+        };
+
+        trace_scope("merge");
+        return merge(allocator, file, results, ranges.len);
+    }
+
+    void deinit() { file.deinit(); }
+
+    /// @brief Resolves a user query to a canonical book id without looking at any file: a
+    /// known name or abbreviation (see books.h), or the book number itself.
+    static std::optional<u8> book_id_from_query(StringSlice query) {
+        auto id = book_id_from_name(query);
+        if (id.has_value()) return id;
+
+        auto number = uint_from_digits<u8>(query.ptr, query.len);
+        if (number.has_value() && number.value() >= 1 && number.value() <= BIBLE_BOOK_COUNT) {
+            return number;
+        }
+
+        return std::nullopt;
+    }
+
+    /// @brief Finds a book by a known name or abbreviation, by its canonical number, or by the
+    /// name used in the file (ignoring ASCII case), for languages books.h does not cover.
+    std::optional<usize> find_book(StringSlice query) {
+        query = query.trim();
+        if (query.is_empty()) return std::nullopt;
+
+        auto id = book_id_from_query(query);
+        if (id.has_value()) return find_book_by_id(id.value());
+
+        for (usize i = 0; i < book_count; i++) {
+            if (books[i].name.equals_ignore_case(query)) return i;
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<usize> find_book_by_id(u8 id) {
+        // Complete Bibles keep their books in canonical order
+        if (id >= 1 && id <= book_count && books[id - 1].id == id) return id - 1;
+
+        for (usize i = 0; i < book_count; i++) {
+            if (books[i].id == id) return i;
+        }
+
+        return std::nullopt;
+    }
+
+    /// @brief Finds chapter `number` of the book at `book_index`.
+    /// @return The index into the chapter table.
+    std::optional<usize> find_chapter(usize book_index, usize number) {
+        BibleBook& book = books[book_index];
+
+        // Chapters are almost always numbered 1..n in order
+        if (number >= 1 && number <= book.chapter_count) {
+            usize guess = book.first_chapter + number - 1;
+            if (chapters[guess].number == number) return guess;
+        }
+
+        for (usize i = book.first_chapter; i < book.first_chapter + book.chapter_count; i++) {
+            if (chapters[i].number == number) return i;
+        }
+
+        return std::nullopt;
+    }
+
+    /// @brief Finds verse `number` of the chapter at `chapter_index`.
+    /// @return The row in the verse table.
+    std::optional<usize> find_verse(usize chapter_index, usize number) {
+        BibleChapter& chapter = chapters[chapter_index];
+
+        if (number >= 1 && number <= chapter.verse_count) {
+            usize guess = chapter.first_verse + number - 1;
+            if (verse_numbers[guess] == number) return guess;
+        }
+
+        for (usize i = chapter.first_verse; i < chapter.first_verse + chapter.verse_count; i++) {
+            if (verse_numbers[i] == number) return i;
+        }
+
+        return std::nullopt;
+    }
+
+    /// @brief Finds the verses of the book at `book_index` between `first` and `last`
+    /// (inclusive), both packed as chapter << 16 | verse (see reference.h).
+    /// @return The rows as [first, end); empty when no verse is in between.
+    RowSpan find_verse_span(usize book_index, u32 first, u32 last) {
+        BibleBook& book = books[book_index];
+        if (book.chapter_count == 0) return RowSpan{.first = 0, .end = 0};
+
+        BibleChapter& last_chapter = chapters[book.first_chapter + book.chapter_count - 1];
+        u32 low = chapters[book.first_chapter].first_verse;
+        u32 high = last_chapter.first_verse + last_chapter.verse_count;
+
+        // Rows of a book are in chapter and verse order
+        auto key = [&](u32 row) { return (u32)verse_chapters[row] << 16 | verse_numbers[row]; };
+        auto lower_bound = [&](u32 value) {
+            u32 begin = low;
+            u32 end = high;
+            while (begin < end) {
+                u32 mid = begin + (end - begin) / 2;
+                if (key(mid) < value) {
+                    begin = mid + 1;
+                } else {
+                    end = mid;
+                }
+            }
+            return begin;
+        };
+
+        u32 span_first = lower_bound(first);
+        u32 span_end = last == UINT32_MAX ? high : lower_bound(last + 1);
+        if (span_end < span_first) span_end = span_first;
+        return RowSpan{.first = span_first, .end = span_end};
+    }
+
+    /// @brief Finds the row of a canonical verse id, in whatever numbering the file uses.
+    /// Books, chapters and verses are normally numbered densely, so this is a table lookup and
+    /// three direct index probes.
+    std::optional<usize> find_verse_by_id(VerseId canonical) {
+        VerseId id = versification_from_canonical(versification, canonical);
+
+        auto book_index = find_book_by_id(verse_id_book(id));
+        if (!book_index.has_value()) return std::nullopt;
+
+        auto chapter_index = find_chapter(book_index.value(), verse_id_chapter(id));
+        if (!chapter_index.has_value()) return std::nullopt;
+
+        return find_verse(chapter_index.value(), verse_id_verse(id));
+    }
+
+    VerseId verse_id_of(usize row) {
+        return verse_id(verse_books[row], verse_chapters[row], verse_numbers[row]);
+    }
+
+    /// @brief The canonical id of the verse at `row`, the one find_verse_by_id() takes.
+    /// @return Nothing for verses KJV numbering has no place for.
+    std::optional<VerseId> canonical_id_of(usize row) {
+        return versification_to_canonical(versification, verse_id_of(row));
+    }
+
+    /// @brief Number of verses in chapter `chapter` of canonical book `id`, 0 when it is missing.
+    usize chapter_size(u8 id, usize chapter) {
+        auto book_index = find_book_by_id(id);
+        if (!book_index.has_value()) return 0;
+
+        auto chapter_index = find_chapter(book_index.value(), chapter);
+        return chapter_index.has_value() ? chapters[chapter_index.value()].verse_count : 0;
+    }
+
+    /// @brief Guesses the versification from the shape of the books that differ the most.
+    /// Books that are missing do not count, so a partial Bible is taken as KJV.
+    Versification detect_versification() {
+        // Hebrew Bibles end Malachi at 3:24 and number Joel 2:28-32 as a chapter of five verses
+        if (chapter_size(39, 3) >= 24 && chapter_size(39, 4) == 0) return VersificationHebrew;
+        if (chapter_size(29, 3) == 5 && chapter_size(29, 4) > 0) return VersificationHebrew;
+
+        // The Septuagint and the Vulgate join Psalms 9 and 10, and 114 and 115
+        if (chapter_size(19, 9) >= 38 && chapter_size(19, 113) >= 20) return VersificationVulgate;
+
+        return VersificationKjv;
+    }
+
+    /// @brief Returns the text of the verse at `row` as a slice of the mapped file. This is the
+    /// raw text, which may still be XML; use verse_text_runs() or verse_plain_text() to read it.
+    /// Dictionary-coded text has no raw slice.
+    StringSlice verse_text(usize row) {
+        return StringSlice::init(text + text_offsets[row], text_lengths[row]);
+    }
+
+    bool text_is_coded() { return text_dictionary.count > 0; }
+
+    /// @brief Calls `emit(StringSlice)` with the pieces of the verse's plain text, in order.
+    /// The pieces point into the mapping (or the dictionary), so nothing is copied.
+    template <typename F> void verse_text_runs(usize row, F emit) {
+        if (text_is_coded()) {
+            // A verse's codes end where the next verse's begin
+            usize codes_end = row + 1 < verse_count ? text_offsets[row + 1] : text_size;
+            text_dictionary.decode(
+                (const u8*)text + text_offsets[row],
+                codes_end - text_offsets[row],
+                text_lengths[row],
+                emit
+            );
+        } else if (text_is_xml) {
+            xml_text_runs(verse_text(row), emit);
+        } else {
+            emit(verse_text(row));
+        }
+    }
+
+    /// @brief Bytes that always hold the plain text of the verse at `row`: decoding XML only
+    /// ever shrinks it, and coded verses store their decoded length.
+    usize verse_text_capacity(usize row) { return text_lengths[row]; }
+
+    /// @brief Plain text of a verse: the slice itself for plain Bibles, or decoded into
+    /// `scratch`, which must hold verse_text_capacity(row) bytes.
+    StringSlice verse_plain_text(usize row, mut_string scratch) {
+        if (text_is_coded()) {
+            usize len = 0;
+            verse_text_runs(row, [&](StringSlice run) {
+                memcpy(scratch + len, run.ptr, run.len);
+                len += run.len;
+            });
+            return StringSlice::init(scratch, len);
+        }
+
+        StringSlice raw = verse_text(row);
+        if (!text_is_xml) return raw;
+
+        return StringSlice::init(scratch, xml_decode_text(raw, scratch));
+    }
+
+    /// @brief Returns a printable name for the book at `book_index`.
+    StringSlice book_name(usize book_index) {
+        BibleBook& book = books[book_index];
+        if (!book.name.is_empty()) return book.name;
+
+        string english = book_name_fallback(book.id);
+        return english ? StringSlice::from_cstr(english) : StringSlice::from_cstr("?");
+    }
+
+  private:
+    static string book_name_fallback(u8 id) {
+        if (id == 0 || id > BIBLE_BOOK_COUNT) return nullptr;
+        return BIBLE_BOOK_NAMES[id - 1];
+    }
+
+    // Byte range of one top-level book element, from its start tag to the end of its close tag
+    struct BookRange {
+        usize start;
+        usize end;
+    };
+
+    struct BookResult;
+
+    // Finds the book elements with plain byte searches. Book elements never nest, so the first
+    // close tag after a start tag always ends it.
+    static bool find_book_ranges(string data, usize size, ArrayList<BookRange>& ranges) {
+        string tag_names[] = {"BIBLEBOOK", "book"};
+
+        for (string tag_name : tag_names) {
+            char open_tag[16];
+            char close_tag[16];
+            i32 open_len = snprintf(open_tag, sizeof(open_tag), "<%s", tag_name);
+            i32 close_len = snprintf(close_tag, sizeof(close_tag), "</%s>", tag_name);
+
+            usize pos = 0;
+            while (pos < size) {
+                string open = string_find_bytes(data + pos, size - pos, open_tag, open_len);
+                if (!open) break;
+
+                usize start = (usize)(open - data);
+                usize after_name = start + open_len;
+                char next = after_name < size ? data[after_name] : '\0';
+                if (next != ' ' && next != '>' && next != '\t' && next != '\n' && next != '\r') {
+                    pos = after_name; // A longer tag name that starts the same way
+                    continue;
+                }
+
+                string close =
+                    string_find_bytes(data + after_name, size - after_name, close_tag, close_len);
+                usize end = close ? (usize)(close - data) + close_len : size;
+
+                if (!ranges.append(BookRange{.start = start, .end = end})) return false;
+                pos = end;
+            }
+
+            if (ranges.len > 0) return true;
+        }
+
+        return true;
+    }
+
+    // Concatenates per-book tables in document order, rebasing chapter and verse indexes.
+    static std::expected<Bible, BibleError>
+    merge(Allocator& allocator, MappedFile file, BookResult* results, usize result_count) {
+        usize book_count = 0;
+        usize chapter_count = 0;
+        usize verse_count = 0;
+
+        for (usize i = 0; i < result_count; i++) {
+            if (!results[i].ok) return std::unexpected(results[i].builder.error);
+
+            book_count += results[i].builder.books.len;
+            chapter_count += results[i].builder.chapters.len;
+            verse_count += results[i].builder.verse_books.len;
+        }
+
+        if (verse_count == 0) return std::unexpected(BibleEmpty);
+
+        Bible bible = Bible{
+            .file = file,
+            .text = (string)file.data,
+            .text_size = file.size,
+            .text_is_xml = true,
+            .text_dictionary = {},
+            .verse_books = allocator.alloc_array<u8>(verse_count),
+            .verse_chapters = allocator.alloc_array<u16>(verse_count),
+            .verse_numbers = allocator.alloc_array<u16>(verse_count),
+            .text_offsets = allocator.alloc_array<u32>(verse_count),
+            .text_lengths = allocator.alloc_array<u32>(verse_count),
+            .verse_count = verse_count,
+            .books = allocator.alloc_array<BibleBook>(book_count),
+            .book_count = book_count,
+            .chapters = allocator.alloc_array<BibleChapter>(chapter_count),
+            .chapter_count = chapter_count,
+            .versification = VersificationKjv,
+        };
+
+        if (!bible.verse_books || !bible.verse_chapters || !bible.verse_numbers ||
+            !bible.text_offsets || !bible.text_lengths || (book_count > 0 && !bible.books) ||
+            (chapter_count > 0 && !bible.chapters)) {
+            return std::unexpected(BibleOutOfMemory);
+        }
+
+        usize book_at = 0;
+        usize chapter_at = 0;
+        usize verse_at = 0;
+
+        for (usize i = 0; i < result_count; i++) {
+            BibleBuilder& part = results[i].builder;
+            usize verses = part.verse_books.len;
+
+            for (usize b = 0; b < part.books.len; b++) {
+                BibleBook book = part.books.items[b];
+                book.first_chapter += (u32)chapter_at;
+                bible.books[book_at++] = book;
+            }
+
+            for (usize c = 0; c < part.chapters.len; c++) {
+                BibleChapter chapter = part.chapters.items[c];
+                chapter.first_verse += (u32)verse_at;
+                bible.chapters[chapter_at++] = chapter;
+            }
+
+            if (verses > 0) {
+                memcpy(bible.verse_books + verse_at, part.verse_books.items, sizeof(u8) * verses);
+                memcpy(
+                    bible.verse_chapters + verse_at,
+                    part.verse_chapters.items,
+                    sizeof(u16) * verses
+                );
+                memcpy(
+                    bible.verse_numbers + verse_at,
+                    part.verse_numbers.items,
+                    sizeof(u16) * verses
+                );
+                memcpy(
+                    bible.text_offsets + verse_at,
+                    part.text_offsets.items,
+                    sizeof(u32) * verses
+                );
+                memcpy(
+                    bible.text_lengths + verse_at,
+                    part.text_lengths.items,
+                    sizeof(u32) * verses
+                );
+            }
+            verse_at += verses;
+        }
+
+        bible.versification = bible.detect_versification();
+        return bible;
+    }
+
+    // Accumulates the tables while the document is scanned.
+    struct BibleBuilder {
+        ArrayList<u8> verse_books;
+        ArrayList<u16> verse_chapters;
+        ArrayList<u16> verse_numbers;
+        ArrayList<u32> text_offsets;
+        ArrayList<u32> text_lengths;
+        ArrayList<BibleBook> books;
+        ArrayList<BibleChapter> chapters;
+        BibleError error;
+        // Number of books that precede the parsed range, for files without book numbers
+        usize book_ordinal_base;
+
+        static BibleBuilder init(Allocator& allocator) {
+            return BibleBuilder{
+                .verse_books = ArrayList<u8>::init(allocator),
+                .verse_chapters = ArrayList<u16>::init(allocator),
+                .verse_numbers = ArrayList<u16>::init(allocator),
+                .text_offsets = ArrayList<u32>::init(allocator),
+                .text_lengths = ArrayList<u32>::init(allocator),
+                .books = ArrayList<BibleBook>::init(allocator),
+                .chapters = ArrayList<BibleChapter>::init(allocator),
+                .error = BibleMalformedXml,
+                .book_ordinal_base = 0,
+            };
+        }
+
+        // Columns are handed over to the Bible by finish(), so there is nothing to free on
+        // success. On failure the partial columns are released here.
+        void deinit() {
+            verse_books.deinit();
+            verse_chapters.deinit();
+            verse_numbers.deinit();
+            text_offsets.deinit();
+            text_lengths.deinit();
+            books.deinit();
+            chapters.deinit();
+        }
+
+        bool parse_range(XmlTokenizer& tokenizer) {
+            bool in_book = false;
+            bool in_chapter = false;
+
+            while (true) {
+                XmlToken token = tokenizer.next();
+
+                switch (token.kind) {
+                    case XmlEnd: return true;
+                    case XmlError: return fail(BibleMalformedXml);
+                    case XmlText: break;
+
+                    case XmlOpen:
+                    case XmlSelfClose: {
+                        if (is_book_tag(token.name)) {
+                            if (!begin_book(token)) return false;
+                            in_book = token.kind == XmlOpen;
+                            in_chapter = false;
+                        } else if (in_book && is_chapter_tag(token.name)) {
+                            if (!begin_chapter(token)) return false;
+                            in_chapter = token.kind == XmlOpen;
+                        } else if (in_chapter && is_verse_tag(token.name)) {
+                            if (!add_verse(tokenizer, token)) return false;
+                        }
+                    } break;
+
+                    case XmlClose: {
+                        if (is_book_tag(token.name)) {
+                            in_book = false;
+                            in_chapter = false;
+                        } else if (is_chapter_tag(token.name)) {
+                            in_chapter = false;
+                        }
+                    } break;
+                }
+            }
+        }
+
+        // Streaming variant of parse_range() that only builds one chapter.
+        bool parse_chapter(XmlTokenizer& tokenizer, StringSlice book_query, usize chapter_number) {
+            bool in_book = false;
+            // Resolved once, so each skipped book costs an id compare
+            auto query_id = Bible::book_id_from_query(book_query);
+
+            while (true) {
+                XmlToken token = tokenizer.next();
+
+                switch (token.kind) {
+                    case XmlEnd: return fail(in_book ? BibleChapterNotFound : BibleBookNotFound);
+                    case XmlError: return fail(BibleMalformedXml);
+                    case XmlText:
+                    case XmlSelfClose: break;
+
+                    case XmlOpen: {
+                        if (!in_book && is_book_tag(token.name)) {
+                            if (!begin_book(token)) return false;
+
+                            BibleBook& book = books.items[books.len - 1];
+                            bool matches = query_id.has_value()
+                                               ? book.id == query_id.value()
+                                               : book.name.equals_ignore_case(book_query);
+                            if (matches) {
+                                in_book = true;
+                            } else {
+                                books.pop();
+                                if (!skip_element(tokenizer, token)) return false;
+                            }
+                        } else if (in_book && is_chapter_tag(token.name)) {
+                            auto number = number_attribute(token.attributes, "cnumber");
+                            if (!number.has_value() || number.value() != chapter_number) {
+                                if (!skip_element(tokenizer, token)) return false;
+                                break;
+                            }
+
+                            if (!begin_chapter(token)) return false;
+
+                            while (true) {
+                                XmlToken inner = tokenizer.next();
+                                if (inner.kind == XmlEnd || inner.kind == XmlError) {
+                                    return fail(BibleMalformedXml);
+                                }
+                                if (inner.kind == XmlClose && is_chapter_tag(inner.name)) {
+                                    return true; // Done, the rest of the file is never read
+                                }
+                                if ((inner.kind == XmlOpen || inner.kind == XmlSelfClose) &&
+                                    is_verse_tag(inner.name)) {
+                                    if (!add_verse(tokenizer, inner)) return false;
+                                }
+                            }
+                        }
+                    } break;
+
+                    case XmlClose: {
+                        if (in_book && is_book_tag(token.name)) return fail(BibleChapterNotFound);
+                    } break;
+                }
+            }
+        }
+
+        // Jumps past the closing tag of the element opened by `open` without tokenizing its
+        // contents. Only used for book and chapter elements, which never nest.
+        bool skip_element(XmlTokenizer& tokenizer, XmlToken& open) {
+            char close_tag[64];
+            if (open.name.len + 3 > sizeof(close_tag)) return fail(BibleMalformedXml);
+
+            close_tag[0] = '<';
+            close_tag[1] = '/';
+            memcpy(close_tag + 2, open.name.ptr, open.name.len);
+            close_tag[open.name.len + 2] = '>';
+            usize close_len = open.name.len + 3;
+
+            string found = string_find_bytes(
+                tokenizer.data + open.end,
+                tokenizer.len - open.end,
+                close_tag,
+                close_len
+            );
+            if (!found) return fail(BibleMalformedXml);
+
+            tokenizer.pos = (usize)(found - tokenizer.data) + close_len;
+            return true;
+        }
+
+        Bible finish(MappedFile file, string text) {
+            Bible bible = Bible{
+                .file = file,
+                .text = text,
+                .text_size = file.size - (usize)((const u8*)text - file.data),
+                .text_is_xml = true,
+                .text_dictionary = {},
+                .verse_books = verse_books.items,
+                .verse_chapters = verse_chapters.items,
+                .verse_numbers = verse_numbers.items,
+                .text_offsets = text_offsets.items,
+                .text_lengths = text_lengths.items,
+                .verse_count = verse_books.len,
+                .books = books.items,
+                .book_count = books.len,
+                .chapters = chapters.items,
+                .chapter_count = chapters.len,
+                .versification = VersificationKjv,
+            };
+            bible.versification = bible.detect_versification();
+
+            // Ownership moved to the Bible
+            *this = BibleBuilder::init(verse_books.allocator);
+            return bible;
+        }
+
+        bool begin_book(XmlToken& token) {
+            auto number = number_attribute(token.attributes, "bnumber");
+            auto name = xml_find_attribute(token.attributes, "bname");
+            if (!name.has_value()) name = xml_find_attribute(token.attributes, "name");
+
+            u8 id = (u8)(book_ordinal_base + books.len + 1);
+            if (number.has_value() && number.value() > 0 && number.value() <= 255) {
+                id = (u8)number.value();
+            }
+
+            BibleBook book = BibleBook{
+                .id = id,
+                .name = name.has_value() ? name.value() : StringSlice::init(nullptr, 0),
+                .first_chapter = (u32)chapters.len,
+                .chapter_count = 0,
+            };
+
+            if (!books.append(book)) return fail(BibleOutOfMemory);
+            return true;
+        }
+
+        bool begin_chapter(XmlToken& token) {
+            auto number = number_attribute(token.attributes, "cnumber");
+            BibleBook& book = books.items[books.len - 1];
+
+            BibleChapter chapter = BibleChapter{
+                .number = number.has_value() ? number.value() : (u16)(book.chapter_count + 1),
+                .first_verse = (u32)verse_books.len,
+                .verse_count = 0,
+            };
+
+            if (!chapters.append(chapter)) return fail(BibleOutOfMemory);
+            book.chapter_count++;
+            return true;
+        }
+
+        bool add_verse(XmlTokenizer& tokenizer, XmlToken& open) {
+            BibleBook& book = books.items[books.len - 1];
+            BibleChapter& chapter = chapters.items[chapters.len - 1];
+
+            auto number = number_attribute(open.attributes, "vnumber");
+
+            usize text_start = open.end;
+            usize text_end = open.end;
+
+            if (open.kind == XmlOpen) {
+                // Verse text may contain nested markup (<STYLE>, <gr>, <NOTE>...). Skip to the
+                // matching close tag and keep the raw range; it is decoded when printed.
+                usize depth = 0;
+                while (true) {
+                    XmlToken token = tokenizer.next();
+                    if (token.kind == XmlEnd || token.kind == XmlError) {
+                        return fail(BibleMalformedXml);
+                    }
+
+                    if (token.kind == XmlOpen && token.name.equals(open.name)) depth++;
+                    if (token.kind == XmlClose && token.name.equals(open.name)) {
+                        if (depth == 0) {
+                            text_end = token.start;
+                            break;
+                        }
+                        depth--;
+                    }
+                }
+            }
+
+            StringSlice raw = StringSlice::init(tokenizer.data + text_start, text_end - text_start);
+            StringSlice trimmed = raw.trim();
+
+            bool ok = verse_books.append(book.id) &&
+                      verse_chapters.append(chapter.number) &&
+                      verse_numbers.append(
+                          number.has_value() ? number.value() : (u16)(chapter.verse_count + 1)
+                      ) &&
+                      text_offsets.append((u32)(trimmed.ptr - tokenizer.data)) &&
+                      text_lengths.append((u32)trimmed.len);
+            if (!ok) return fail(BibleOutOfMemory);
+
+            chapter.verse_count++;
+            return true;
+        }
+
+        bool fail(BibleError e) {
+            error = e;
+            return false;
+        }
+
+        // Zefania uses bnumber/cnumber/vnumber, Beblia uses a plain `number` attribute.
+        static std::optional<u16> number_attribute(StringSlice attributes, string zefania_name) {
+            auto value = xml_find_attribute(attributes, zefania_name);
+            if (!value.has_value()) value = xml_find_attribute(attributes, "number");
+            if (!value.has_value()) return std::nullopt;
+
+            StringSlice digits = value->trim();
+            return uint_from_digits<u16>(digits.ptr, digits.len);
+        }
+
+        static bool is_book_tag(StringSlice name) {
+            return name.equals_ignore_case("BIBLEBOOK") || name.equals_ignore_case("book");
+        }
+
+        static bool is_chapter_tag(StringSlice name) { return name.equals_ignore_case("chapter"); }
+
+        static bool is_verse_tag(StringSlice name) {
+            return name.equals_ignore_case("VERS") || name.equals_ignore_case("verse");
+        }
+    };
+
+    // Output slot of one book in a parallel parse, written by exactly one worker
+    struct BookResult {
+        BibleBuilder builder;
+        bool ok;
+    };
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include "def.h"
+#include "normalize.h"
+#include "string.h"
+#include <bit>
+#include <cstring>
+#include <optional>
+
+// Book name resolver
+//
+// Maps book names and abbreviations in English, Portuguese, Spanish and German to canonical book
+// ids (1 = Genesis ... 66 = Revelation). Names are normalized first: ASCII is lowercased, spaces,
+// dots, dashes and underscores are dropped, and accented Latin-1 letters are folded to their
+// base letters, so "1 Coríntios", "1Cor" and "1 co." all become "1corintios", "1cor", "1co".
+//
+// The lookup table is a minimal-probe perfect hash built entirely at compile time, in the style
+// of CHD (hash, displace): keys are spread over buckets, and each bucket gets a displacement
+// that sends all its keys to free slots. A lookup is one hash, one displacement read and one key
+// compare. Two aliases that normalize to the same key but name different books fail the build.
+
+// Aliases per book, separated by '|'. Spellings that differ only in accents or spacing are
+// listed once, since they normalize to the same key.
+constexpr string BOOK_ALIASES[] = {
+    "Genesis|Gen|Ge|Gn|Gênesis|Génesis|1 Mose|1 Mo",
+    "Exodus|Exod|Exo|Ex|Êxodo|Éxodo|2 Mose|2 Mo",
+    "Leviticus|Lev|Le|Lv|Levítico|3 Mose|3 Mo",
+    "Numbers|Num|Nu|Nm|Nb|Números|4 Mose|4 Mo",
+    "Deuteronomy|Deut|Deu|Dt|Deuteronômio|Deuteronomio|5 Mose|5 Mo",
+    "Joshua|Josh|Jos|Jsh|Josué|Josua",
+    "Judges|Judg|Jdg|Jg|Juízes|Jz|Jueces|Jue|Richter|Ri",
+    "Ruth|Rut|Ru|Rt",
+    "1 Samuel|1 Sam|1 Sa|1 Sm",
+    "2 Samuel|2 Sam|2 Sa|2 Sm",
+    "1 Kings|1 Kgs|1 Ki|1 Kg|1 Reis|1 Rs|1 Reyes|1 Re|1 Könige|1 Kön",
+    "2 Kings|2 Kgs|2 Ki|2 Kg|2 Reis|2 Rs|2 Reyes|2 Re|2 Könige|2 Kön",
+    "1 Chronicles|1 Chron|1 Chr|1 Ch|1 Crônicas|1 Crónicas|1 Cr|1 Cro|1 Chronik",
+    "2 Chronicles|2 Chron|2 Chr|2 Ch|2 Crônicas|2 Crónicas|2 Cr|2 Cro|2 Chronik",
+    "Ezra|Ezr|Esdras|Esd|Esra",
+    "Nehemiah|Neh|Ne|Neemias|Nehemías|Nehemia",
+    "Esther|Esth|Est|Es|Ester",
+    "Job|Jb|Jó|Hiob|Hi",
+    "Psalms|Psalm|Ps|Psa|Pss|Salmos|Sal|Sl|Psalmen",
+    "Proverbs|Prov|Pro|Prv|Pr|Pv|Provérbios|Proverbios|Sprüche|Sprueche|Spr",
+    "Ecclesiastes|Eccl|Eccles|Ecc|Ec|Qoh|Eclesiastes|Ecl|Prediger|Pred|Kohelet",
+    "Song of Solomon|Song of Songs|Song|SOS|Sg|Cânticos|Cântico dos Cânticos|Cantares|"
+    "Cantar de los Cantares|Ct|Cant|Hoheslied|Hld",
+    "Isaiah|Isa|Is|Isaías|Jesaja|Jes",
+    "Jeremiah|Jer|Je|Jr|Jeremias|Jeremia",
+    "Lamentations|Lam|La|Lm|Lamentações|Lamentacoes|Lamentaciones|Klagelieder|Klgl",
+    "Ezekiel|Ezek|Eze|Ezk|Ez|Ezequiel|Hesekiel|Hes",
+    "Daniel|Dan|Da|Dn",
+    "Hosea|Hos|Ho|Oséias|Oseas|Os",
+    "Joel|Jl|Joe",
+    "Amos|Am|Amós",
+    "Obadiah|Obad|Ob|Obadias|Abdías|Abd|Obadja",
+    "Jonah|Jon|Jnh|Jonas|Jona",
+    "Micah|Mic|Mi|Mq|Miquéias|Miqueias|Miqueas|Micha",
+    "Nahum|Nah|Na|Naum",
+    "Habakkuk|Hab|Hc|Habacuque|Habacuc|Habakuk",
+    "Zephaniah|Zeph|Zep|Zp|Sofonias|Sf|Zefanja|Zef",
+    "Haggai|Hag|Hg|Ageu|Ageo|Ag",
+    "Zechariah|Zech|Zec|Zc|Zacarias|Zac|Sacharja|Sach",
+    "Malachi|Mal|Ml|Malaquias|Maleachi",
+    "Matthew|Matt|Mat|Mt|Mateus|Mateo|Matthäus|Matthaeus",
+    "Mark|Mrk|Mar|Mk|Mc|Mr|Marcos|Markus",
+    "Luke|Luk|Lk|Lu|Lc|Lucas|Lukas",
+    "John|Jhn|Jn|João|Juan|Johannes|Joh",
+    "Acts|Act|Ac|Atos|At|Hechos|Hch|Apostelgeschichte|Apg",
+    "Romans|Rom|Ro|Rm|Romanos|Römer|Roemer",
+    "1 Corinthians|1 Cor|1 Co|1 Coríntios|1 Korinther|1 Kor",
+    "2 Corinthians|2 Cor|2 Co|2 Coríntios|2 Korinther|2 Kor",
+    "Galatians|Gal|Ga|Gl|Gálatas|Galater",
+    "Ephesians|Eph|Ephes|Ep|Efésios|Efesios|Epheser|Ef",
+    "Philippians|Phil|Php|Pp|Filipenses|Fp|Fil|Flp|Philipper",
+    "Colossians|Col|Colossenses|Colosenses|Cl|Kolosser|Kol",
+    "1 Thessalonians|1 Thess|1 Thes|1 Th|1 Tessalonicenses|1 Tesalonicenses|1 Ts|1 Tes|"
+    "1 Thessalonicher",
+    "2 Thessalonians|2 Thess|2 Thes|2 Th|2 Tessalonicenses|2 Tesalonicenses|2 Ts|2 Tes|"
+    "2 Thessalonicher",
+    "1 Timothy|1 Tim|1 Ti|1 Tm|1 Timóteo|1 Timoteo|1 Timotheus",
+    "2 Timothy|2 Tim|2 Ti|2 Tm|2 Timóteo|2 Timoteo|2 Timotheus",
+    "Titus|Tit|Tt|Tito",
+    "Philemon|Philem|Phlm|Phm|Filemom|Filemón|Fm|Flm",
+    "Hebrews|Heb|Hb|Hebreus|Hebreos|Hebräer|Hebraeer|Hebr",
+    "James|Jas|Jm|Tiago|Tg|Santiago|Stg|Jakobus|Jak",
+    "1 Peter|1 Pet|1 Pe|1 Pt|1 Pedro|1 Ped|1 Petrus",
+    "2 Peter|2 Pet|2 Pe|2 Pt|2 Pedro|2 Ped|2 Petrus",
+    "1 John|1 Jn|1 Jo|1 João|1 Juan|1 Johannes|1 Joh",
+    "2 John|2 Jn|2 Jo|2 João|2 Juan|2 Johannes|2 Joh",
+    "3 John|3 Jn|3 Jo|3 João|3 Juan|3 Johannes|3 Joh",
+    "Jude|Jud|Jd|Judas",
+    "Revelation|Rev|Re|Rv|Apocalipse|Apocalipsis|Apocalypse|Ap|Apoc|Offenbarung|Offb",
+};
+constexpr usize BOOK_ALIAS_BOOKS = sizeof(BOOK_ALIASES) / sizeof(BOOK_ALIASES[0]);
+static_assert(BOOK_ALIAS_BOOKS == 66, "BOOK_ALIASES needs one entry per canonical book");
+
+// Longest normalized key, in bytes
+constexpr usize BOOK_KEY_MAX = 24;
+
+/// @brief Normalizes a book name into `out` (BOOK_KEY_MAX bytes).
+/// @return The key length, or 0 if the name is empty, too long or has characters no alias can
+/// contain.
+constexpr usize book_normalize(string name, usize len, char* out) {
+    usize key_len = 0;
+
+    for (usize i = 0; i < len; i++) {
+        u8 c = (u8)name[i];
+        if (c == ' ' || c == '\t' || c == '.' || c == '-' || c == '_') continue;
+
+        char single[2] = {(char)c, 0};
+        string folded = single;
+        if (c >= 'A' && c <= 'Z') {
+            single[0] = (char)(c + ('a' - 'A'));
+        } else if (c == 0xC3 && i + 1 < len && ((u8)name[i + 1] & 0xC0) == 0x80) {
+            folded = NORMALIZE_FOLD[(u8)name[++i] & 0x3F];
+            if (!folded) return 0;
+        } else if (c >= 0x80) {
+            return 0;
+        }
+
+        for (; *folded; folded++) {
+            if (key_len == BOOK_KEY_MAX) return 0;
+            out[key_len++] = *folded;
+        }
+    }
+
+    return key_len;
+}
+
+constexpr u64 book_hash(string key, usize len) {
+    u64 hash = 0xcbf29ce484222325ull;
+
+    for (usize i = 0; i < len; i++) {
+        hash ^= (u8)key[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+constexpr usize book_alias_count() {
+    usize count = 0;
+
+    for (usize book = 0; book < BOOK_ALIAS_BOOKS; book++) {
+        count++;
+        for (string c = BOOK_ALIASES[book]; *c; c++) {
+            if (*c == '|') count++;
+        }
+    }
+
+    return count;
+}
+
+constexpr usize BOOK_ALIAS_COUNT = book_alias_count();
+// About four keys per bucket, and a table at most half full, keep displacement searches short
+constexpr usize BOOK_BUCKET_COUNT = BOOK_ALIAS_COUNT / 4 + 1;
+constexpr usize BOOK_TABLE_SIZE = std::bit_ceil(BOOK_ALIAS_COUNT * 2);
+constexpr u16 BOOK_SLOT_EMPTY = 0xFFFF;
+static_assert(BOOK_ALIAS_COUNT < BOOK_SLOT_EMPTY, "Too many aliases for u16 key indices");
+
+constexpr u32 book_bucket(u64 hash) { return (u32)((hash >> 32) % BOOK_BUCKET_COUNT); }
+
+constexpr u32 book_slot(u64 hash, u16 displacement) {
+    u64 mixed = hash ^ ((u64)displacement * 0x9e3779b97f4a7c15ull);
+    mixed ^= mixed >> 33;
+    mixed *= 0xff51afd7ed558ccdull;
+    mixed ^= mixed >> 33;
+    return (u32)mixed & (u32)(BOOK_TABLE_SIZE - 1);
+}
+
+struct BookKey {
+    char text[BOOK_KEY_MAX];
+    u8 len;
+    u8 id;
+};
+
+struct BookTable {
+    BookKey keys[BOOK_ALIAS_COUNT];
+    u16 displacements[BOOK_BUCKET_COUNT];
+    // Index into `keys`, or BOOK_SLOT_EMPTY
+    u16 slots[BOOK_TABLE_SIZE];
+
+    // Build errors, checked by the static_asserts below
+    bool invalid_alias;
+    bool conflicting_alias;
+    bool unplaced_bucket;
+};
+
+constexpr BookTable book_table_build() {
+    BookTable table = {};
+    u64 hashes[BOOK_ALIAS_COUNT] = {};
+
+    // Split and normalize the aliases
+    usize key_count = 0;
+    for (usize book = 0; book < BOOK_ALIAS_BOOKS; book++) {
+        string alias = BOOK_ALIASES[book];
+
+        while (true) {
+            usize len = 0;
+            while (alias[len] && alias[len] != '|') len++;
+
+            BookKey& key = table.keys[key_count];
+            key.len = (u8)book_normalize(alias, len, key.text);
+            key.id = (u8)(book + 1);
+            if (key.len == 0) table.invalid_alias = true;
+
+            hashes[key_count++] = book_hash(key.text, key.len);
+
+            if (!alias[len]) break;
+            alias += len + 1;
+        }
+    }
+
+    // Group the keys by bucket (counting sort)
+    u16 bucket_starts[BOOK_BUCKET_COUNT + 1] = {};
+    u16 members[BOOK_ALIAS_COUNT] = {};
+    for (usize i = 0; i < key_count; i++) bucket_starts[book_bucket(hashes[i]) + 1]++;
+    for (usize b = 0; b < BOOK_BUCKET_COUNT; b++) bucket_starts[b + 1] += bucket_starts[b];
+
+    u16 fill[BOOK_BUCKET_COUNT] = {};
+    for (usize i = 0; i < key_count; i++) {
+        u32 bucket = book_bucket(hashes[i]);
+        members[bucket_starts[bucket] + fill[bucket]++] = (u16)i;
+    }
+
+    // Place the largest buckets first, while the table is emptiest
+    u16 sizes[BOOK_BUCKET_COUNT] = {};
+    u16 order[BOOK_BUCKET_COUNT] = {};
+    for (usize b = 0; b < BOOK_BUCKET_COUNT; b++) {
+        sizes[b] = (u16)(bucket_starts[b + 1] - bucket_starts[b]);
+
+        usize j = b;
+        while (j > 0 && sizes[order[j - 1]] < sizes[b]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (u16)b;
+    }
+
+    for (usize i = 0; i < BOOK_TABLE_SIZE; i++) table.slots[i] = BOOK_SLOT_EMPTY;
+
+    for (usize o = 0; o < BOOK_BUCKET_COUNT; o++) {
+        u16 bucket = order[o];
+
+        // Keep one copy of keys listed twice; identical keys always share a bucket
+        u16 keys[BOOK_ALIAS_COUNT] = {};
+        usize count = 0;
+        for (usize m = bucket_starts[bucket]; m < bucket_starts[bucket + 1]; m++) {
+            BookKey& key = table.keys[members[m]];
+            bool duplicate = false;
+
+            for (usize k = 0; k < count && !duplicate; k++) {
+                BookKey& other = table.keys[keys[k]];
+                if (hashes[keys[k]] != hashes[members[m]] || other.len != key.len) continue;
+
+                duplicate = true;
+                for (usize c = 0; c < key.len; c++) {
+                    if (other.text[c] != key.text[c]) duplicate = false;
+                }
+                if (duplicate && other.id != key.id) table.conflicting_alias = true;
+            }
+
+            if (!duplicate) keys[count++] = members[m];
+        }
+
+        if (count == 0) continue;
+
+        bool placed = false;
+        for (u32 displacement = 0; displacement < BOOK_SLOT_EMPTY && !placed; displacement++) {
+            placed = true;
+
+            for (usize k = 0; k < count && placed; k++) {
+                u32 slot = book_slot(hashes[keys[k]], (u16)displacement);
+                if (table.slots[slot] != BOOK_SLOT_EMPTY) placed = false;
+
+                for (usize previous = 0; previous < k && placed; previous++) {
+                    if (book_slot(hashes[keys[previous]], (u16)displacement) == slot) {
+                        placed = false;
+                    }
+                }
+            }
+
+            if (!placed) continue;
+
+            for (usize k = 0; k < count; k++) {
+                table.slots[book_slot(hashes[keys[k]], (u16)displacement)] = keys[k];
+            }
+            table.displacements[bucket] = (u16)displacement;
+        }
+
+        if (!placed) table.unplaced_bucket = true;
+    }
+
+    return table;
+}
+
+inline constexpr BookTable BOOK_TABLE = book_table_build();
+static_assert(!BOOK_TABLE.invalid_alias, "A book alias is empty, too long or not Latin-1");
+static_assert(!BOOK_TABLE.conflicting_alias, "Two book aliases normalize to the same key");
+static_assert(!BOOK_TABLE.unplaced_bucket, "No displacement found for a book alias bucket");
+
+/// @brief Resolves a book name or abbreviation in any supported language to its canonical id.
+/// Costs one normalization pass, one hash and one key compare; nothing is allocated.
+inline std::optional<u8> book_id_from_name(StringSlice name) {
+    char key[BOOK_KEY_MAX];
+    usize len = book_normalize(name.ptr, name.len, key);
+    if (len == 0) return std::nullopt;
+
+    u64 hash = book_hash(key, len);
+    u16 index = BOOK_TABLE.slots[book_slot(hash, BOOK_TABLE.displacements[book_bucket(hash)])];
+    if (index == BOOK_SLOT_EMPTY) return std::nullopt;
+
+    const BookKey& entry = BOOK_TABLE.keys[index];
+    if (entry.len != len || memcmp(entry.text, key, len) != 0) return std::nullopt;
+
+    return entry.id;
+}
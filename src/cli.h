@@ -4,6 +4,9 @@
 #include "array.h"
 #include "def.h"
 #include "string.h"
+#include "timing.h"
+#include "trace.h"
+#include "writer.h"
 #include <optional>
 #include <print>
 
@@ -110,6 +113,8 @@ struct CLIParser {
     std::optional<CLICommand> current_command;
     std::optional<CLICommand> main_command;
     ArrayList<CLICommand> commands;
+    // Where to write the spans of the run, from the global `--trace` option
+    std::optional<string> trace_path;
 
     static CLIParser init(Allocator& allocator, string program_name, i32 max_commands = 20) {
         auto commands = ArrayList<CLICommand>::init(allocator, max_commands);
@@ -119,6 +124,7 @@ struct CLIParser {
             .current_command = std::nullopt,
             .main_command = std::nullopt,
             .commands = commands,
+            .trace_path = std::nullopt,
         };
     }
 
@@ -143,14 +149,32 @@ struct CLIParser {
             return 1;
         }
 
+        i32 status = 0;
         if (current_command && current_command->callback) {
-            return current_command->execute() ? 0 : 1;
+            status = current_command->execute() ? 0 : 1;
         }
 
-        return 0;
+        if (process_stats.is_enabled()) process_stats.print(stderr);
+        if (trace_path.has_value() && !trace_write(trace_path.value())) {
+            std::println(stderr, "Error: Could not write trace '{}'", trace_path.value());
+            return 1;
+        }
+        return status;
     }
 
-    bool parse(i32 argc, char* argv[]) {
+    /// @brief Picks the command and its options out of `argv`. The global `--stats` flag and
+    /// `--trace <file>` option may appear anywhere; they are removed from `argv` and turn on
+    /// process_stats and tracing.
+    bool parse(i32& argc, char* argv[]) {
+        // Stats and tracing are turned on below, so this timer is started by hand
+        u64 start_ns = stats_now_ns();
+        StatsTimer timer = StatsTimer{.phase = StatsPhaseArguments, .start_ns = start_ns};
+        defer { timer.stop(); };
+
+        if (take_flag(argc, argv, "--stats")) process_stats.enable(start_ns);
+        if (!take_option(argc, argv, "--trace", trace_path)) return false;
+        if (trace_path.has_value()) trace_enable(start_ns);
+
         // If no arguments or first argument is an option, use main command
         if (argc < 2 || is_option(argv[1])) {
             if (!main_command.has_value()) {
@@ -199,7 +223,7 @@ struct CLIParser {
         // Parse options starting from argv[2] for named commands
         for (i32 i = 2; i < argc; i++) {
             if (is_option(argv[i])) {
-                i32 consumed = parse_option(argv, i, argc, current_command.value());
+                i32 consumed = parse_option(argv, argc, i, current_command.value());
                 if (consumed == -1) {
                     return false;
                 }
@@ -211,27 +235,33 @@ struct CLIParser {
     }
 
     void print_help() {
-        std::println("Usage {} [options]", program_name);
+        Writer out = Writer::init(PageAllocator::init(), stdout);
+        defer { out.deinit(); };
 
-        if (main_command.has_value()) {
-            std::println("       {} <command> [options]\n", program_name);
-        } else {
-            std::println("       {} <command> [options]\n", program_name);
-        }
+        out.println("Usage: {} [options]", program_name);
+        out.println("       {} <command> [options]\n", program_name);
 
         if (main_command.has_value()) {
-            std::println("Main command:");
-            std::println("{:<15} {}\n", "(default)", main_command->description);
+            out.println("Main command:");
+            out.println("{:<15} {}\n", "(default)", main_command->description);
         }
 
+        out.println("Global options:");
+        out.println("{:<15} {}", "--stats", "Print phase timings and memory use to stderr");
+        out.println(
+            "{:<15} {}\n",
+            "--trace <file>",
+            "Write a timeline of the run (Chrome trace format, e.g. for ui.perfetto.dev)"
+        );
+
         if (commands.len > 0) {
-            std::println("Commands:");
+            out.println("Commands:");
             for (auto& cmd : commands) {
-                std::println("{:<15} {}", cmd.name, cmd.description);
+                out.println("{:<15} {}", cmd.name, cmd.description);
             }
         }
 
-        std::println(
+        out.println(
             "\nUse '{} --help' or '{} <command> --help' for more information.\n",
             program_name,
             program_name
@@ -239,31 +269,34 @@ struct CLIParser {
     }
 
     void print_command_help(CLICommand& command) {
-        std::println("Usage: {} {} [options]\n", program_name, command.name);
-        std::println("{}\n", command.description);
+        Writer out = Writer::init(PageAllocator::init(), stdout);
+        defer { out.deinit(); };
+
+        // The main command has no name
+        if (command.name) {
+            out.println("Usage: {} {} [options]\n", program_name, command.name);
+        } else {
+            out.println("Usage: {} [options]\n", program_name);
+        }
+        out.println("{}\n", command.description);
 
         if (command.options.len > 0) {
-            std::println("Options:");
+            out.println("Options:");
 
             for (auto& option : command.options) {
-                std::print("  ");
+                out.write("  ");
 
+                // The names are stored with their dashes
                 if (option.short_name) {
-                    std::print("-{}", option.short_name);
-                    if (option.long_name) {
-                        std::print(", ");
-                    }
+                    out.write(option.short_name);
+                    if (option.long_name) out.write(", ");
                 }
 
-                if (option.long_name) {
-                    std::print("--{}", option.long_name);
-                }
+                if (option.long_name) out.write(option.long_name);
+                if (!option.flag_option) out.write(" <value>");
 
-                if (option.value.has_value()) {
-                    std::print(" <value>");
-                }
-
-                std::println("\n{}", option.description);
+                out.write("\n    ");
+                out.println("{}", option.description);
             }
         }
     }
@@ -305,4 +338,40 @@ struct CLIParser {
     }
 
     bool is_option(char* arg) { return arg[0] == '-'; }
+
+    // Removes every `flag` from `argv`.
+    // @return Whether there was one.
+    static bool take_flag(i32& argc, char* argv[], string flag) {
+        i32 kept = 0;
+        for (i32 i = 0; i < argc; i++) {
+            if (i > 0 && string_equals(argv[i], flag)) continue;
+            argv[kept++] = argv[i];
+        }
+
+        bool found = kept != argc;
+        argc = kept;
+        argv[argc] = nullptr;
+        return found;
+    }
+
+    // Removes every `option` and its value from `argv`, keeping the last value in `value`.
+    // @return False when an `option` has no value.
+    static bool take_option(i32& argc, char* argv[], string option, std::optional<string>& value) {
+        i32 kept = 0;
+        for (i32 i = 0; i < argc; i++) {
+            if (i > 0 && string_equals(argv[i], option)) {
+                if (i + 1 == argc) {
+                    std::println("Option {} requires a value.", option);
+                    return false;
+                }
+                value = argv[++i];
+                continue;
+            }
+            argv[kept++] = argv[i];
+        }
+
+        argc = kept;
+        argv[argc] = nullptr;
+        return true;
+    }
 };
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "allocator.h"
+#include "def.h"
+#include "hash_map.h"
+#include "string.h"
+#include <algorithm>
+#include <cstring>
+
+// Dictionary-coded verse text
+//
+// Verse text is split into tokens: words (runs of ASCII letters, digits and UTF-8 bytes) and
+// the runs of punctuation and spaces between them. Every distinct token of the corpus goes into
+// one static dictionary, most frequent first, and a verse is stored as the codes of its tokens.
+// The single space between two words, by far the most common token, is implied.
+//
+// Codes are one byte for the 192 most frequent tokens, two bytes for the next 16128 and three
+// bytes beyond that:
+//
+//   0x00..0xBF            entry b
+//   0xC0..0xFE, b1        entry 0xC0 + ((b - 0xC0) << 8 | b1)
+//   0xFF, b1, b2          entry 0xC0 + 0x3F00 + (b1 << 8 | b2)
+//
+// No code refers to earlier text, so every verse decodes on its own from its offset, and a
+// lookup touches only the codes of the verses it prints. Decoding emits slices of the
+// dictionary itself, so printing copies nothing.
+
+constexpr u32 TEXT_CODE_SHORT_COUNT = 0xC0;
+constexpr u32 TEXT_CODE_MEDIUM_COUNT = (0xFF - 0xC0) << 8;
+constexpr u32 TEXT_DICTIONARY_MAX = TEXT_CODE_SHORT_COUNT + TEXT_CODE_MEDIUM_COUNT + 0x10000;
+// Worst case code bytes per text byte: one-byte tokens with three-byte codes
+constexpr usize TEXT_CODE_EXPANSION = 3;
+
+inline bool text_is_word_byte(u8 c) {
+    return c >= 0x80 || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+/// @brief A read-only dictionary, usually pointing into a mapped index: entry i is
+/// `bytes[offsets[i], offsets[i + 1])`.
+struct TextDictionary {
+    const u32* offsets;
+    string bytes;
+    u32 count;
+
+    StringSlice entry(u32 index) {
+        return StringSlice::init(bytes + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+
+    /// @brief Calls `emit(StringSlice)` with the pieces of a text of `length` bytes coded in
+    /// the `codes_size` bytes at `codes`. Decoding stops early at the end of the codes, a code
+    /// past the dictionary or a token longer than what is left, so a damaged index yields short
+    /// text rather than overrunning the caller or the mapping.
+    template <typename F> void decode(const u8* codes, usize codes_size, usize length, F emit) {
+        const u8* codes_end = codes + codes_size;
+        bool after_word = false;
+
+        while (length > 0 && codes < codes_end) {
+            u32 index = *codes++;
+            if (index == 0xFF) {
+                if (codes_end - codes < 2) return;
+                index = TEXT_CODE_SHORT_COUNT + TEXT_CODE_MEDIUM_COUNT + ((u32)codes[0] << 8) +
+                        codes[1];
+                codes += 2;
+            } else if (index >= TEXT_CODE_SHORT_COUNT) {
+                if (codes == codes_end) return;
+                index = TEXT_CODE_SHORT_COUNT + ((index - TEXT_CODE_SHORT_COUNT) << 8) + *codes++;
+            }
+            if (index >= count) return;
+
+            StringSlice token = entry(index);
+            if (token.is_empty()) return;
+
+            bool word = text_is_word_byte((u8)token.ptr[0]);
+            usize needed = token.len + (word && after_word ? 1 : 0);
+            if (needed > length) return;
+
+            if (word && after_word) emit(StringSlice::init(" ", 1));
+            emit(token);
+            length -= needed;
+            after_word = word;
+        }
+    }
+};
+
+/// @brief Builds a dictionary from a corpus and codes texts with it: add() every text, then
+/// finish(), then encode() each text.
+struct TextDictionaryBuilder {
+    struct Token {
+        StringSlice bytes;
+        u32 count;
+    };
+
+    // Occurrences per token until finish(), the token's entry index after
+    StringMap<u32> tokens;
+    // Entries in code order, pointing at the map's copies of the keys
+    Token* entries;
+    usize entry_count;
+    Allocator allocator;
+
+    static TextDictionaryBuilder init(Allocator allocator) {
+        return TextDictionaryBuilder{
+            .tokens = StringMap<u32>::init(allocator, 16384),
+            .entries = nullptr,
+            .entry_count = 0,
+            .allocator = allocator,
+        };
+    }
+
+    void deinit() {
+        allocator.free_array(entries, entry_count);
+        tokens.deinit();
+    }
+
+    /// @return False when out of memory.
+    bool add(StringSlice text) {
+        if (!tokens.entries) return false;
+
+        bool ok = true;
+        for_each_token(text, [&](StringSlice token) {
+            u32* count = tokens.get_or_insert(token, 0);
+            if (!count) {
+                ok = false;
+                return;
+            }
+            (*count)++;
+        });
+
+        return ok;
+    }
+
+    /// @brief Orders the entries by frequency and assigns codes.
+    /// @return False when out of memory or when the corpus has more than TEXT_DICTIONARY_MAX
+    /// distinct tokens.
+    bool finish() {
+        if (tokens.len > TEXT_DICTIONARY_MAX) return false;
+
+        entries = allocator.alloc_array<Token>(tokens.len > 0 ? tokens.len : 1);
+        if (!entries) return false;
+        entry_count = tokens.len > 0 ? tokens.len : 1;
+
+        usize count = 0;
+        for (usize i = 0; i < tokens.capacity; i++) {
+            if (!tokens.entries[i].used) continue;
+            entries[count++] = Token{
+                .bytes = tokens.entries[i].key,
+                .count = tokens.entries[i].value,
+            };
+        }
+
+        // Ties are broken by the bytes, so the same corpus always gives the same dictionary
+        std::sort(entries, entries + count, [](Token& a, Token& b) {
+            if (a.count != b.count) return a.count > b.count;
+
+            usize len = a.bytes.len < b.bytes.len ? a.bytes.len : b.bytes.len;
+            i32 order = memcmp(a.bytes.ptr, b.bytes.ptr, len);
+            return order != 0 ? order < 0 : a.bytes.len < b.bytes.len;
+        });
+
+        for (usize i = 0; i < count; i++) *tokens.get(entries[i].bytes) = (u32)i;
+        return true;
+    }
+
+    usize dictionary_count() { return tokens.len; }
+
+    /// @brief Size of the serialized dictionary: the offset table, then the entry bytes.
+    usize dictionary_size() {
+        usize size = sizeof(u32) * (tokens.len + 1);
+        for (usize i = 0; i < tokens.len; i++) size += entries[i].bytes.len;
+        return size;
+    }
+
+    /// @brief Serializes the dictionary into `out` (dictionary_size() bytes, 4-byte aligned).
+    /// A TextDictionary reads it with `offsets` at `out` and `bytes` right after the table.
+    void write_dictionary(u8* out) {
+        u32* offsets = (u32*)out;
+        char* bytes = (char*)(out + sizeof(u32) * (tokens.len + 1));
+
+        u32 offset = 0;
+        for (usize i = 0; i < tokens.len; i++) {
+            offsets[i] = offset;
+            memcpy(bytes + offset, entries[i].bytes.ptr, entries[i].bytes.len);
+            offset += (u32)entries[i].bytes.len;
+        }
+        offsets[tokens.len] = offset;
+    }
+
+    /// @brief Codes `text`, which must have been add()ed, into `out`
+    /// (TEXT_CODE_EXPANSION * text.len bytes).
+    /// @return The number of code bytes.
+    usize encode(StringSlice text, u8* out) {
+        usize size = 0;
+        for_each_token(text, [&](StringSlice token) {
+            size += encode_index(*tokens.get(token), out + size);
+        });
+
+        return size;
+    }
+
+  private:
+    static usize encode_index(u32 index, u8* out) {
+        if (index < TEXT_CODE_SHORT_COUNT) {
+            out[0] = (u8)index;
+            return 1;
+        }
+
+        index -= TEXT_CODE_SHORT_COUNT;
+        if (index < TEXT_CODE_MEDIUM_COUNT) {
+            out[0] = (u8)(TEXT_CODE_SHORT_COUNT + (index >> 8));
+            out[1] = (u8)index;
+            return 2;
+        }
+
+        index -= TEXT_CODE_MEDIUM_COUNT;
+        out[0] = 0xFF;
+        out[1] = (u8)(index >> 8);
+        out[2] = (u8)index;
+        return 3;
+    }
+
+    // Calls `emit` with the tokens of `text` that get a code. Runs alternate between word and
+    // separator bytes, so a lone space after a word is followed by a word or ends the text; the
+    // first case is implied and skipped.
+    template <typename F> static void for_each_token(StringSlice text, F emit) {
+        bool after_word = false;
+        usize i = 0;
+        while (i < text.len) {
+            usize start = i;
+            bool word = text_is_word_byte((u8)text.ptr[i]);
+            while (i < text.len && text_is_word_byte((u8)text.ptr[i]) == word) i++;
+
+            bool lone_space = i - start == 1 && text.ptr[start] == ' ';
+            if (!(lone_space && after_word && i < text.len)) {
+                emit(StringSlice::init(text.ptr + start, i - start));
+            }
+            after_word = word;
+        }
+    }
+};
@@ -0,0 +1,430 @@
+#pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "bible.h"
+#include "def.h"
+#include "hash_map.h"
+#include "search.h"
+#include "string.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <expected>
+#include <new>
+#include <thread>
+
+// Concordance statistics
+//
+// Word, bigram and trigram frequencies over the whole Bible and per book, plus verse and chapter
+// length distributions. Words are split and folded the way the search index does it
+// (WordIterator, search_normalize), so "LORD" and "Lord" count as one word. N-grams never cross
+// a verse.
+//
+// The pass is map-reduce: workers take whole books from a shared counter and count into hash
+// maps in their own ArenaAllocator, with no locks and no shared writes. The maps are merged
+// once all workers are done, and only the top entries are kept.
+
+// Longest n-gram key: three words and two spaces
+constexpr usize CONCORDANCE_MAX_KEY = 3 * SEARCH_MAX_WORD + 2;
+
+struct ConcordanceCount {
+    StringSlice key;
+    u32 count;
+};
+
+/// @brief Summary of a length distribution.
+struct ConcordanceDistribution {
+    u32 min;
+    u32 median;
+    u32 p90;
+    u32 max;
+    double mean;
+
+    /// @brief Summarizes `values`, sorting them in place.
+    static ConcordanceDistribution of(u32* values, usize count) {
+        if (count == 0) return ConcordanceDistribution{};
+
+        std::sort(values, values + count);
+
+        u64 sum = 0;
+        for (usize i = 0; i < count; i++) sum += values[i];
+
+        return ConcordanceDistribution{
+            .min = values[0],
+            .median = values[count / 2],
+            .p90 = values[count * 9 / 10],
+            .max = values[count - 1],
+            .mean = (double)sum / (double)count,
+        };
+    }
+};
+
+struct ConcordanceBook {
+    // Index into Bible::books
+    usize book_index;
+    u32 verse_count;
+    u32 word_count;
+    u32 distinct_words;
+    // Most frequent words, by count
+    ArrayList<ConcordanceCount> words;
+};
+
+struct Concordance {
+    u32 verse_count;
+    u32 word_count;
+    u32 distinct_words;
+    u32 distinct_bigrams;
+    u32 distinct_trigrams;
+
+    // Most frequent entries of the whole Bible, by count
+    ArrayList<ConcordanceCount> words;
+    ArrayList<ConcordanceCount> bigrams;
+    ArrayList<ConcordanceCount> trigrams;
+
+    // Words per verse and verses per chapter
+    ConcordanceDistribution verse_words;
+    ConcordanceDistribution chapter_verses;
+
+    // One per book of the Bible, in Bible::books order
+    ConcordanceBook* books;
+    usize book_count;
+
+    Allocator allocator;
+
+    /// @brief Counts the whole Bible. The results, keys included, live in `allocator`; the
+    /// working maps are freed before returning.
+    /// @param limit Entries kept in each whole-Bible list.
+    /// @param book_limit Words kept in each book's list.
+    /// @param thread_count Number of workers, or 0 for one per hardware thread.
+    static std::expected<Concordance, BibleError> build(
+        Allocator allocator,
+        Bible& bible,
+        usize limit,
+        usize book_limit,
+        usize thread_count = 0
+    ) {
+        trace_scope("concordance");
+
+        if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+        if (thread_count == 0) thread_count = 1;
+        if (thread_count > bible.book_count) thread_count = bible.book_count;
+        if (thread_count == 0) thread_count = 1;
+
+        Concordance concordance = Concordance{
+            .verse_count = (u32)bible.verse_count,
+            .word_count = 0,
+            .distinct_words = 0,
+            .distinct_bigrams = 0,
+            .distinct_trigrams = 0,
+            .words = ArrayList<ConcordanceCount>::init(allocator),
+            .bigrams = ArrayList<ConcordanceCount>::init(allocator),
+            .trigrams = ArrayList<ConcordanceCount>::init(allocator),
+            .verse_words = {},
+            .chapter_verses = {},
+            .books = allocator.alloc_array<ConcordanceBook>(bible.book_count),
+            .book_count = bible.book_count,
+            .allocator = allocator,
+        };
+        if (!concordance.books && bible.book_count > 0) {
+            return std::unexpected(BibleOutOfMemory);
+        }
+        for (usize i = 0; i < bible.book_count; i++) {
+            concordance.books[i] = ConcordanceBook{
+                .book_index = i,
+                .verse_count = 0,
+                .word_count = 0,
+                .distinct_words = 0,
+                .words = ArrayList<ConcordanceCount>::init(allocator),
+            };
+        }
+
+        ArenaAllocator scratch_arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+        Allocator scratch = scratch_arena.allocator();
+        defer { scratch_arena.deinit(); };
+
+        usize verse_capacity = bible.verse_count > 0 ? bible.verse_count : 1;
+        u32* verse_words = scratch.alloc_array<u32>(verse_capacity);
+        u32* chapter_verses =
+            scratch.alloc_array<u32>(bible.chapter_count > 0 ? bible.chapter_count : 1);
+        StringMap<u32>* book_words = scratch.alloc_array<StringMap<u32>>(bible.book_count + 1);
+        usize* book_order = scratch.alloc_array<usize>(bible.book_count + 1);
+        Worker* workers = scratch.alloc_array<Worker>(thread_count);
+        std::thread* threads = scratch.alloc_array<std::thread>(thread_count);
+        if (!verse_words || !chapter_verses || !book_words || !book_order || !workers ||
+            !threads) {
+            concordance.deinit();
+            return std::unexpected(BibleOutOfMemory);
+        }
+
+        memset(verse_words, 0, sizeof(u32) * verse_capacity);
+
+        // Largest books first, so the last book taken is a small one and workers finish together
+        for (usize i = 0; i < bible.book_count; i++) book_order[i] = i;
+        std::sort(book_order, book_order + bible.book_count, [&](usize a, usize b) {
+            return book_rows(bible, a).end - book_rows(bible, a).first >
+                   book_rows(bible, b).end - book_rows(bible, b).first;
+        });
+
+        usize max_text = 0;
+        for (usize row = 0; row < bible.verse_count; row++) {
+            usize len = bible.verse_text_capacity(row);
+            if (len > max_text) max_text = len;
+        }
+
+        std::atomic<usize> next_book = 0;
+        for (usize t = 0; t < thread_count; t++) {
+            new (&workers[t]) Worker{
+                .arena = ArenaAllocator::init(PageAllocator::init(), MB(1)),
+                .bigrams = {},
+                .trigrams = {},
+                .ok = false,
+            };
+            new (&threads[t]) std::thread([&, t]() {
+                Worker& worker = workers[t];
+                Allocator worker_allocator = worker.arena.allocator();
+                trace_thread_name("concordance worker");
+                worker.bigrams = StringMap<u32>::init(worker_allocator, 4096);
+                worker.trigrams = StringMap<u32>::init(worker_allocator, 4096);
+                if (!worker.bigrams.entries || !worker.trigrams.entries) return;
+
+                char* text_scratch = worker_allocator.alloc_array<char>(max_text + 1);
+                if (!text_scratch) return;
+
+                for (usize i = next_book++; i < bible.book_count; i = next_book++) {
+                    usize book = book_order[i];
+                    trace_scope("count book", (i64)book);
+                    book_words[book] = StringMap<u32>::init(worker_allocator, 1024);
+                    if (!book_words[book].entries) return;
+
+                    RowSpan rows = book_rows(bible, book);
+                    for (u32 row = rows.first; row < rows.end; row++) {
+                        StringSlice text = bible.verse_plain_text(row, text_scratch);
+                        if (!count_verse(worker, book_words[book], text, verse_words[row])) {
+                            return;
+                        }
+                    }
+                }
+
+                worker.ok = true;
+            });
+        }
+
+        for (usize t = 0; t < thread_count; t++) {
+            threads[t].join();
+            threads[t].~thread();
+        }
+
+        defer {
+            for (usize t = 0; t < thread_count; t++) workers[t].arena.deinit();
+        };
+
+        bool ok = true;
+        for (usize t = 0; t < thread_count; t++) ok = ok && workers[t].ok;
+
+        // Reduce: books into the whole-Bible word map, workers' n-grams into one map each
+        auto words = StringMap<u32>::init(scratch, 16384);
+        auto bigrams = StringMap<u32>::init(scratch, 16384);
+        auto trigrams = StringMap<u32>::init(scratch, 16384);
+        ok = ok && words.entries && bigrams.entries && trigrams.entries;
+
+        // Sized for every key of their sources up front, so merging never stops to rehash
+        usize book_keys = 0;
+        for (usize i = 0; i < bible.book_count && ok; i++) book_keys += book_words[i].len;
+        usize bigram_keys = 0;
+        usize trigram_keys = 0;
+        for (usize t = 0; t < thread_count && ok; t++) {
+            bigram_keys += workers[t].bigrams.len;
+            trigram_keys += workers[t].trigrams.len;
+        }
+        ok = ok && words.reserve(book_keys) && bigrams.reserve(bigram_keys) &&
+             trigrams.reserve(trigram_keys);
+
+        for (usize i = 0; i < bible.book_count && ok; i++) {
+            ConcordanceBook& book = concordance.books[i];
+            RowSpan rows = book_rows(bible, i);
+            book.verse_count = rows.end - rows.first;
+            for (u32 row = rows.first; row < rows.end; row++) book.word_count += verse_words[row];
+            book.distinct_words = (u32)book_words[i].len;
+
+            concordance.word_count += book.word_count;
+            ok = merge(words, book_words[i]) && top(book_words[i], book_limit, book.words);
+        }
+        for (usize t = 0; t < thread_count && ok; t++) {
+            ok = merge(bigrams, workers[t].bigrams) && merge(trigrams, workers[t].trigrams);
+        }
+
+        ok = ok && top(words, limit, concordance.words) &&
+             top(bigrams, limit, concordance.bigrams) &&
+             top(trigrams, limit, concordance.trigrams);
+        if (!ok) {
+            concordance.deinit();
+            return std::unexpected(BibleOutOfMemory);
+        }
+
+        concordance.distinct_words = (u32)words.len;
+        concordance.distinct_bigrams = (u32)bigrams.len;
+        concordance.distinct_trigrams = (u32)trigrams.len;
+
+        for (usize i = 0; i < bible.chapter_count; i++) {
+            chapter_verses[i] = bible.chapters[i].verse_count;
+        }
+        concordance.verse_words = ConcordanceDistribution::of(verse_words, bible.verse_count);
+        concordance.chapter_verses =
+            ConcordanceDistribution::of(chapter_verses, bible.chapter_count);
+
+        return concordance;
+    }
+
+    void deinit() {
+        free_keys(words);
+        free_keys(bigrams);
+        free_keys(trigrams);
+
+        for (usize i = 0; i < book_count; i++) free_keys(books[i].words);
+        allocator.free_array(books, book_count);
+        books = nullptr;
+        book_count = 0;
+    }
+
+  private:
+    struct Worker {
+        ArenaAllocator arena;
+        StringMap<u32> bigrams;
+        StringMap<u32> trigrams;
+        bool ok;
+    };
+
+    static RowSpan book_rows(Bible& bible, usize book_index) {
+        BibleBook& book = bible.books[book_index];
+        if (book.chapter_count == 0) return RowSpan{.first = 0, .end = 0};
+
+        BibleChapter& first = bible.chapters[book.first_chapter];
+        BibleChapter& last = bible.chapters[book.first_chapter + book.chapter_count - 1];
+        return RowSpan{.first = first.first_verse, .end = last.first_verse + last.verse_count};
+    }
+
+    // Counts the words of one verse into `book_words` and its n-grams into the worker's maps
+    static bool
+    count_verse(Worker& worker, StringMap<u32>& book_words, StringSlice text, u32& word_count) {
+        // The last three normalized words, the newest at (count - 1) % 3
+        char window[3][SEARCH_MAX_WORD];
+        usize window_len[3];
+        usize count = 0;
+
+        auto words = WordIterator::init(text);
+        while (auto word = words.next()) {
+            usize slot = count % 3;
+            window_len[slot] = search_normalize(word.value(), window[slot]);
+            if (window_len[slot] == 0) continue;
+            count++;
+
+            u32* entry = book_words.get_or_insert(
+                StringSlice::init(window[slot], window_len[slot]),
+                0
+            );
+            if (!entry) return false;
+            (*entry)++;
+
+            if (count >= 2 && !count_ngram(worker.bigrams, window, window_len, count, 2)) {
+                return false;
+            }
+            if (count >= 3 && !count_ngram(worker.trigrams, window, window_len, count, 3)) {
+                return false;
+            }
+        }
+
+        word_count = (u32)count;
+        return true;
+    }
+
+    // Counts the n-gram made of the last `n` words of the window, joined by spaces
+    static bool count_ngram(
+        StringMap<u32>& map,
+        char (&window)[3][SEARCH_MAX_WORD],
+        usize (&window_len)[3],
+        usize count,
+        usize n
+    ) {
+        char key[CONCORDANCE_MAX_KEY];
+        usize key_len = 0;
+
+        for (usize i = count - n; i < count; i++) {
+            if (key_len > 0) key[key_len++] = ' ';
+            memcpy(key + key_len, window[i % 3], window_len[i % 3]);
+            key_len += window_len[i % 3];
+        }
+
+        u32* entry = map.get_or_insert(StringSlice::init(key, key_len), 0);
+        if (!entry) return false;
+
+        (*entry)++;
+        return true;
+    }
+
+    static bool merge(StringMap<u32>& into, StringMap<u32>& from) {
+        for (usize i = 0; i < from.capacity; i++) {
+            if (!from.entries[i].used) continue;
+
+            u32* entry = into.get_or_insert(from.entries[i].key, 0);
+            if (!entry) return false;
+            *entry += from.entries[i].value;
+        }
+
+        return true;
+    }
+
+    // Appends the `limit` most frequent entries of `map` to `out`, by count and then by key,
+    // with the keys copied into `out`'s allocator
+    static bool top(StringMap<u32>& map, usize limit, ArrayList<ConcordanceCount>& out) {
+        auto entries = ArrayList<ConcordanceCount>::init(map.allocator);
+        defer { entries.deinit(); };
+        if (!entries.reserve(map.len)) return false;
+
+        for (usize i = 0; i < map.capacity; i++) {
+            if (!map.entries[i].used) continue;
+            entries.items[entries.len++] = ConcordanceCount{
+                .key = map.entries[i].key,
+                .count = map.entries[i].value,
+            };
+        }
+
+        usize kept = limit < entries.len ? limit : entries.len;
+        std::partial_sort(
+            entries.items,
+            entries.items + kept,
+            entries.items + entries.len,
+            [](ConcordanceCount& a, ConcordanceCount& b) {
+                if (a.count != b.count) return a.count > b.count;
+
+                usize len = a.key.len < b.key.len ? a.key.len : b.key.len;
+                i32 order = memcmp(a.key.ptr, b.key.ptr, len);
+                return order != 0 ? order < 0 : a.key.len < b.key.len;
+            }
+        );
+
+        if (!out.reserve(kept)) return false;
+        for (usize i = 0; i < kept; i++) {
+            StringSlice key = entries.items[i].key;
+            char* copy = out.allocator.alloc_array<char>(key.len > 0 ? key.len : 1);
+            if (!copy) return false;
+
+            memcpy(copy, key.ptr, key.len);
+            out.items[out.len++] = ConcordanceCount{
+                .key = StringSlice::init(copy, key.len),
+                .count = entries.items[i].count,
+            };
+        }
+
+        return true;
+    }
+
+    static void free_keys(ArrayList<ConcordanceCount>& list) {
+        for (usize i = 0; i < list.len; i++) {
+            StringSlice key = list.items[i].key;
+            list.allocator.free_array((char*)key.ptr, key.len > 0 ? key.len : 1);
+        }
+        list.deinit();
+    }
+};
@@ -31,12 +31,14 @@ template <typename F> struct Defer {
 
 template <typename F> Defer<F> makeDefer(F f) { return Defer<F>(f); };
 
-#define __defer(line) defer_##line
-#define _defer(line) __defer(line)
+// Not named __defer: identifiers with double underscores are reserved, and glibc's pthread.h
+// declares a member called __defer.
+#define defer_name_concat(line) defer_##line
+#define defer_name(line) defer_name_concat(line)
 
 struct defer_dummy {};
 template <typename F> Defer<F> operator+(defer_dummy, F&& f) {
     return makeDefer<F>(std::forward<F>(f));
 }
 
-#define defer auto _defer(__LINE__) = defer_dummy() + [&]()
+#define defer auto defer_name(__LINE__) = defer_dummy() + [&]()
@@ -0,0 +1,259 @@
+#pragma once
+
+#include "def.h"
+#include "timing.h"
+#include <cstdio>
+#include <optional>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/// @brief Whether `stream` is attached to a terminal, e.g. to decide on colored output.
+inline bool file_is_terminal(FILE* stream) {
+#ifdef _WIN32
+    return _isatty(_fileno(stream)) != 0;
+#else
+    return isatty(fileno(stream)) != 0;
+#endif
+}
+
+/// @brief Width in columns of the terminal `stream` is attached to, or 80 when it is not one.
+inline usize file_terminal_width(FILE* stream) {
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(stream));
+    if (GetConsoleScreenBufferInfo(handle, &info)) {
+        return (usize)(info.srWindow.Right - info.srWindow.Left + 1);
+    }
+#else
+    struct winsize size;
+    if (ioctl(fileno(stream), TIOCGWINSZ, &size) == 0 && size.ws_col > 0) return size.ws_col;
+#endif
+    return 80;
+}
+
+struct FileInfo {
+    u64 size;
+    i64 modified_time;
+
+    /// @brief Reads the size and modification time of the file at `path`.
+    static std::optional<FileInfo> init(string path) {
+        struct stat st;
+        if (stat(path, &st) != 0) return std::nullopt;
+
+        return FileInfo{
+            .size = (u64)st.st_size,
+            .modified_time = (i64)st.st_mtime,
+        };
+    }
+
+    bool equals(FileInfo other) {
+        return size == other.size && modified_time == other.modified_time;
+    }
+};
+
+/// @brief Rounds `offset` up to the 8-byte boundary the sections of index files start on.
+inline u64 file_align(u64 offset) { return (offset + 7) & ~(u64)7; }
+
+/// @brief Writes a file next to `path` and renames it into place on commit(), so readers never
+/// see a half-written file. Sections are written at increasing offsets with zeros in between.
+/// A failed write is remembered and reported by commit().
+///
+/// The temporary file is named after the process and created exclusively, so processes writing
+/// the same file at once (e.g. two first searches building the index) never write into each
+/// other's copy; the last rename wins with a whole file.
+struct AtomicFileWriter {
+    FILE* out;
+    string path;
+    char temp_path[4096];
+    u64 position;
+    bool ok;
+
+    /// @return The writer, or std::nullopt if the temporary file could not be created.
+    static std::optional<AtomicFileWriter> init(string path) {
+        AtomicFileWriter writer = AtomicFileWriter{
+            .out = nullptr,
+            .path = path,
+            .temp_path = {},
+            .position = 0,
+            .ok = true,
+        };
+
+#ifdef _WIN32
+        i32 pid = _getpid();
+#else
+        i32 pid = (i32)getpid();
+#endif
+        i32 written =
+            snprintf(writer.temp_path, sizeof(writer.temp_path), "%s.%d.tmp", path, pid);
+        if (written < 0 || (usize)written >= sizeof(writer.temp_path)) return std::nullopt;
+
+        // "x" fails rather than truncating a file that is already there
+        writer.out = fopen(writer.temp_path, "wbx");
+        if (!writer.out) return std::nullopt;
+
+        return writer;
+    }
+
+    void write(const void* data, usize size) {
+        if (size == 0 || !ok) return;
+        if (fwrite(data, 1, size, out) != size) ok = false;
+        position += size;
+    }
+
+    /// @brief Writes zeros up to `offset`.
+    void pad_to(u64 offset) {
+        static const u8 zeros[8] = {};
+        while (position < offset && ok) {
+            u64 count = offset - position;
+            write(zeros, count < sizeof(zeros) ? (usize)count : sizeof(zeros));
+        }
+    }
+
+    void write_section(u64 offset, const void* data, usize size) {
+        pad_to(offset);
+        write(data, size);
+    }
+
+    /// @brief Closes the file and moves it to `path`, replacing what was there. On failure the
+    /// temporary file is removed.
+    /// @return False when a write, the close or the rename failed.
+    bool commit() {
+        if (fclose(out) != 0) ok = false;
+        out = nullptr;
+
+        if (!ok) {
+            remove(temp_path);
+            return false;
+        }
+
+#ifdef _WIN32
+        remove(path); // rename() does not replace existing files on Windows
+#endif
+        if (rename(temp_path, path) != 0) {
+            remove(temp_path);
+            return false;
+        }
+
+        return true;
+    }
+};
+
+/// @brief A read-only memory mapping of a whole file.
+/// Pages are faulted in by the OS on first touch, so only the regions that are actually read
+/// cost anything.
+struct MappedFile {
+    u8* data;
+    usize size;
+#ifdef _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#endif
+
+    /// @brief Maps the file at `path` read-only.
+    /// @return The mapping, or std::nullopt if the file could not be opened or mapped.
+    static std::optional<MappedFile> init(string path) {
+        StatsTimer timer = StatsTimer::init(StatsPhaseOpen);
+        defer { timer.stop(); };
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(
+            path,
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr
+        );
+        if (file == INVALID_HANDLE_VALUE) return std::nullopt;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size)) {
+            CloseHandle(file);
+            return std::nullopt;
+        }
+
+        MappedFile mapped = MappedFile{
+            .data = nullptr,
+            .size = (usize)file_size.QuadPart,
+            .file_handle = file,
+            .mapping_handle = nullptr,
+        };
+        if (mapped.size == 0) return mapped;
+
+        mapped.mapping_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapped.mapping_handle) {
+            CloseHandle(file);
+            return std::nullopt;
+        }
+
+        mapped.data = (u8*)MapViewOfFile(mapped.mapping_handle, FILE_MAP_READ, 0, 0, 0);
+        if (!mapped.data) {
+            CloseHandle(mapped.mapping_handle);
+            CloseHandle(file);
+            return std::nullopt;
+        }
+
+        return mapped;
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return std::nullopt;
+        defer { close(fd); }; // The mapping keeps its own reference to the file
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return std::nullopt;
+
+        MappedFile mapped = MappedFile{
+            .data = nullptr,
+            .size = (usize)st.st_size,
+        };
+        if (mapped.size == 0) return mapped;
+
+        void* data = mmap(nullptr, mapped.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) return std::nullopt;
+
+        mapped.data = (u8*)data;
+        return mapped;
+#endif
+    }
+
+    void deinit() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping_handle) CloseHandle(mapping_handle);
+        if (file_handle) CloseHandle(file_handle);
+        file_handle = nullptr;
+        mapping_handle = nullptr;
+#else
+        if (data) munmap(data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    /// @brief Hints that the whole mapping is about to be read front to back.
+    void advise_sequential() {
+#ifndef _WIN32
+        if (data) madvise(data, size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    /// @brief Hints that the mapping is read at scattered offsets, so read-ahead is wasted.
+    void advise_random() {
+#ifndef _WIN32
+        if (data) madvise(data, size, MADV_RANDOM);
+#endif
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "books.h"
+#include "def.h"
+#include "string.h"
+#include <cstring>
+
+// Fuzzy book name matching
+//
+// Fallback for book names that books.h does not know, such as "Phillipians" or "Revelations".
+// Every alias key is ranked by its edit distance to the normalized query, using the bit-parallel
+// algorithm of Myers as reformulated by Hyyrö: the pattern (the query, at most BOOK_KEY_MAX
+// bytes) fits in one u64 column, so each candidate costs one pass of a few word operations per
+// character. Adjacent transpositions ("Jhon") count as one edit (optimal string alignment).
+
+constexpr usize FUZZY_MAX_SUGGESTIONS = 3;
+
+struct BookSuggestion {
+    u8 id;
+    u8 distance;
+};
+
+struct BookSuggestions {
+    // Closest books first
+    BookSuggestion items[FUZZY_MAX_SUGGESTIONS];
+    usize len;
+
+    /// @brief Whether a single book is strictly closer than all the others, so it can be used
+    /// without asking.
+    bool unambiguous() { return len == 1 || (len > 1 && items[0].distance < items[1].distance); }
+};
+
+/// @brief Edits allowed for a query of `len` bytes. Very short queries are never corrected,
+/// since almost every abbreviation is within one or two edits of them.
+constexpr u32 fuzzy_max_distance(usize len) {
+    if (len <= 2) return 0;
+    if (len <= 5) return 1;
+    if (len <= 9) return 2;
+    return 3;
+}
+
+/// @brief Optimal string alignment distance between the pattern described by `peq` and
+/// `text`. `peq[c]` has bit i set when pattern byte i is c; `pattern_len` is at most 64.
+inline u32 fuzzy_distance(const u64* peq, usize pattern_len, string text, usize text_len) {
+    u64 last_bit = (u64)1 << (pattern_len - 1);
+    u64 positive = ~(u64)0; // Vertical deltas of +1
+    u64 negative = 0;       // Vertical deltas of -1
+    u64 previous_zero = 0;
+    u64 previous_eq = 0;
+    u32 distance = (u32)pattern_len;
+
+    for (usize j = 0; j < text_len; j++) {
+        u64 eq = peq[(u8)text[j]];
+
+        // Diagonal zero deltas; the first term lets a swapped pair match with one edit
+        u64 transposed = (((~previous_zero) & eq) << 1) & previous_eq;
+        u64 zero = (((eq & positive) + positive) ^ positive) | eq | negative | transposed;
+
+        u64 horizontal_positive = negative | ~(zero | positive);
+        u64 horizontal_negative = positive & zero;
+
+        if (horizontal_positive & last_bit) distance++;
+        if (horizontal_negative & last_bit) distance--;
+
+        // The top row is D[0][j] = j, so every column starts with a +1
+        horizontal_positive = (horizontal_positive << 1) | 1;
+        horizontal_negative <<= 1;
+
+        positive = horizontal_negative | ~(zero | horizontal_positive);
+        negative = horizontal_positive & zero;
+        previous_zero = zero;
+        previous_eq = eq;
+    }
+
+    return distance;
+}
+
+/// @brief Ranks the books whose names or abbreviations are within a few edits of `name`.
+/// Meant for names book_id_from_name() rejected; it does not allocate.
+inline BookSuggestions book_suggest(StringSlice name) {
+    BookSuggestions suggestions = {};
+
+    char pattern[BOOK_KEY_MAX];
+    usize pattern_len = book_normalize(name.ptr, name.len, pattern);
+    u32 max_distance = fuzzy_max_distance(pattern_len);
+    if (pattern_len == 0 || max_distance == 0) return suggestions;
+
+    u64 peq[256];
+    memset(peq, 0, sizeof(peq));
+    for (usize i = 0; i < pattern_len; i++) {
+        peq[(u8)pattern[i]] |= (u64)1 << i;
+    }
+
+    // Closest distance per book id
+    u8 best[BOOK_ALIAS_BOOKS + 1];
+    memset(best, 0xFF, sizeof(best));
+
+    for (usize i = 0; i < BOOK_ALIAS_COUNT; i++) {
+        const BookKey& key = BOOK_TABLE.keys[i];
+
+        // The distance is at least the length difference
+        usize length_gap = key.len > pattern_len ? key.len - pattern_len : pattern_len - key.len;
+        if (length_gap > max_distance) continue;
+
+        u32 distance = fuzzy_distance(peq, pattern_len, key.text, key.len);
+        if (distance <= max_distance && distance < best[key.id]) best[key.id] = (u8)distance;
+    }
+
+    // Keep the closest books, lowest id first among equals
+    for (usize id = 1; id <= BOOK_ALIAS_BOOKS; id++) {
+        if (best[id] == 0xFF) continue;
+
+        BookSuggestion suggestion = BookSuggestion{.id = (u8)id, .distance = best[id]};
+        usize at = suggestions.len;
+        while (at > 0 && suggestions.items[at - 1].distance > suggestion.distance) at--;
+        if (at == FUZZY_MAX_SUGGESTIONS) continue;
+
+        usize end = suggestions.len < FUZZY_MAX_SUGGESTIONS ? suggestions.len : suggestions.len - 1;
+        for (usize k = end; k > at; k--) suggestions.items[k] = suggestions.items[k - 1];
+        suggestions.items[at] = suggestion;
+        if (suggestions.len < FUZZY_MAX_SUGGESTIONS) suggestions.len++;
+    }
+
+    return suggestions;
+}
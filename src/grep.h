@@ -0,0 +1,276 @@
+#pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "bible.h"
+#include "def.h"
+#include "simd.h"
+#include "string.h"
+#include "timing.h"
+#include "trace.h"
+#include "xml.h"
+#include <cstring>
+#include <new>
+#include <thread>
+
+// Literal substring search
+//
+// The vector paths use the first/last byte filter: compare a block of candidate start positions
+// against the needle's first byte and, shifted by the needle length, against its last byte. Only
+// positions where both match are verified with memcmp, so for ordinary text almost every block
+// is rejected with two compares and a movemask.
+
+using FindBytesFn = string (*)(string haystack, usize haystack_len, string needle, usize len);
+
+inline string find_bytes_scalar(string haystack, usize haystack_len, string needle, usize len) {
+    return string_find_bytes(haystack, haystack_len, needle, len);
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE2 inline string
+find_bytes_sse2(string haystack, usize haystack_len, string needle, usize len) {
+    if (len < 2 || len > haystack_len) {
+        return string_find_bytes(haystack, haystack_len, needle, len);
+    }
+
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[len - 1]);
+
+    usize i = 0;
+    for (; i + len - 1 + 16 <= haystack_len; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(haystack + i + len - 1));
+        __m128i both =
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last));
+
+        u32 mask = (u32)_mm_movemask_epi8(both);
+        while (mask) {
+            u32 bit = simd_ctz64(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, len - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return string_find_bytes(haystack + i, haystack_len - i, needle, len);
+}
+
+SIMD_TARGET_AVX2 inline string
+find_bytes_avx2(string haystack, usize haystack_len, string needle, usize len) {
+    if (len < 2 || len > haystack_len) {
+        return string_find_bytes(haystack, haystack_len, needle, len);
+    }
+
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[len - 1]);
+
+    usize i = 0;
+    for (; i + len - 1 + 32 <= haystack_len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(haystack + i + len - 1));
+        __m256i both = _mm256_and_si256(
+            _mm256_cmpeq_epi8(block_first, first),
+            _mm256_cmpeq_epi8(block_last, last)
+        );
+
+        u32 mask = (u32)_mm256_movemask_epi8(both);
+        while (mask) {
+            u32 bit = simd_ctz64(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, len - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    return string_find_bytes(haystack + i, haystack_len - i, needle, len);
+}
+#endif
+
+inline FindBytesFn find_bytes_for(SimdLevel level) {
+#if SIMD_X86
+    if (level == SimdAvx2) return find_bytes_avx2;
+    if (level == SimdSse2) return find_bytes_sse2;
+#endif
+    (void)level;
+    return find_bytes_scalar;
+}
+
+// A worker's share of a grep: verses [first, end)
+struct GrepRange {
+    usize first;
+    usize end;
+    ArrayList<u32> rows;
+    bool ok;
+};
+
+/// @brief Scans verses `[first, end)` for `needle` and appends the matching rows in order.
+/// `scratch` must hold the longest verse of the range (see Bible::verse_text_capacity).
+inline bool grep_rows(
+    Bible& bible,
+    StringSlice needle,
+    FindBytesFn find,
+    usize first,
+    usize end,
+    mut_string scratch,
+    ArrayList<u32>& rows
+) {
+    if (bible.text_is_coded()) {
+        for (usize row = first; row < end; row++) {
+            StringSlice text = bible.verse_plain_text(row, scratch);
+            if (find(text.ptr, text.len, needle.ptr, needle.len) && !rows.append((u32)row)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    if (bible.text_is_xml) {
+        for (usize row = first; row < end; row++) {
+            StringSlice text = bible.verse_text(row);
+            if (memchr(text.ptr, '<', text.len) || memchr(text.ptr, '&', text.len)) {
+                text = StringSlice::init(scratch, xml_decode_text(text, scratch));
+            }
+
+            if (find(text.ptr, text.len, needle.ptr, needle.len) && !rows.append((u32)row)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Decoded verses are packed back to back in document order, so the range is one blob
+    string cursor = bible.text + bible.text_offsets[first];
+    string blob_end = bible.text + bible.text_offsets[end - 1] + bible.text_lengths[end - 1];
+    usize row = first;
+
+    while (cursor < blob_end) {
+        string match = find(cursor, (usize)(blob_end - cursor), needle.ptr, needle.len);
+        if (!match) break;
+
+        usize offset = (usize)(match - bible.text);
+        while (bible.text_offsets[row] + bible.text_lengths[row] <= offset) row++;
+
+        string verse_end = bible.text + bible.text_offsets[row] + bible.text_lengths[row];
+        if (match + needle.len > verse_end) {
+            // Straddles two verses
+            cursor = match + 1;
+            continue;
+        }
+
+        if (!rows.append((u32)row)) return false;
+        cursor = verse_end;
+        row++;
+    }
+
+    return true;
+}
+
+/// @brief Finds every verse whose plain text contains `needle`, without any index.
+///
+/// The verses are split into contiguous row ranges of roughly equal text size, one per worker,
+/// and each worker collects its matches into its own ArenaAllocator. The ranges are appended to
+/// `rows` in order, so the result is in canonical (document) order whatever the thread count.
+///
+/// Decoded text (a .bidx index) is scanned as one blob per range: matches are mapped back to
+/// verses by offset, and the scan resumes at the next verse. Verses backed by raw XML are
+/// scanned one by one, and decoded first when they contain markup or entities. Dictionary-coded
+/// verses are decoded one by one into the worker's scratch.
+/// @param thread_count Number of workers, or 0 for one per hardware thread.
+/// @return False when out of memory.
+inline bool bible_grep(
+    Bible& bible,
+    StringSlice needle,
+    ArrayList<u32>& rows,
+    usize thread_count = 0,
+    SimdLevel level = simd_level()
+) {
+    rows.clear();
+    if (needle.is_empty() || bible.verse_count == 0) return true;
+
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 1;
+
+    usize total_size = 0;
+    for (usize row = 0; row < bible.verse_count; row++) {
+        total_size += bible.text_lengths[row];
+    }
+    process_stats.add_bytes(total_size);
+
+    ArenaAllocator scratch_arena = ArenaAllocator::init(PageAllocator::init(), KB(4));
+    Allocator scratch = scratch_arena.allocator();
+    defer { scratch_arena.deinit(); };
+
+    GrepRange* ranges = scratch.alloc_array<GrepRange>(thread_count);
+    if (!ranges) return false;
+
+    // Split at verse boundaries; the last range takes whatever is left
+    usize range_size = total_size / thread_count + 1;
+    usize range_count = 0;
+    for (usize row = 0; row < bible.verse_count;) {
+        usize first = row;
+        usize size = 0;
+        bool last = range_count + 1 == thread_count;
+
+        while (row < bible.verse_count && (last || size < range_size)) {
+            size += bible.text_lengths[row++];
+        }
+
+        ranges[range_count++] = GrepRange{.first = first, .end = row, .rows = {}, .ok = false};
+    }
+
+    FindBytesFn find = find_bytes_for(level);
+
+    ArenaAllocator* arenas = scratch.alloc_array<ArenaAllocator>(range_count);
+    std::thread* workers = scratch.alloc_array<std::thread>(range_count);
+    if (!arenas || !workers) return false;
+
+    for (usize t = 0; t < range_count; t++) {
+        arenas[t] = ArenaAllocator::init(PageAllocator::init(), KB(64));
+        new (&workers[t]) std::thread([&, t]() {
+            Allocator worker_allocator = arenas[t].allocator();
+            GrepRange& range = ranges[t];
+            trace_thread_name("grep worker");
+            trace_scope("grep range", (i64)t);
+            range.rows = ArrayList<u32>::init(worker_allocator);
+
+            usize max_text = 0;
+            if (bible.text_is_xml || bible.text_is_coded()) {
+                for (usize row = range.first; row < range.end; row++) {
+                    usize len = bible.verse_text_capacity(row);
+                    if (len > max_text) max_text = len;
+                }
+            }
+
+            char* verse_scratch = worker_allocator.alloc_array<char>(max_text + 1);
+            if (!verse_scratch) return;
+
+            range.ok =
+                grep_rows(bible, needle, find, range.first, range.end, verse_scratch, range.rows);
+        });
+    }
+
+    for (usize t = 0; t < range_count; t++) {
+        workers[t].join();
+        workers[t].~thread();
+    }
+
+    defer {
+        for (usize t = 0; t < range_count; t++) {
+            arenas[t].deinit();
+        }
+    };
+
+    for (usize t = 0; t < range_count; t++) {
+        if (!ranges[t].ok) return false;
+
+        for (usize i = 0; i < ranges[t].rows.len; i++) {
+            if (!rows.append(ranges[t].rows.items[i])) return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "allocator.h"
+#include "def.h"
+#include "string.h"
+#include <cstring>
+
+/// @brief FNV-1a hash of a byte range.
+inline u64 hash_bytes(string data, usize len) {
+    u64 hash = 0xcbf29ce484222325ull;
+
+    for (usize i = 0; i < len; i++) {
+        hash ^= (u8)data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/// @brief Open-addressing hash map from byte strings to `V`.
+/// Keys are copied into the map's allocator on insertion, so callers can pass slices of scratch
+/// buffers. Values are plain data and are never destroyed by the map.
+template <typename V> struct StringMap {
+    struct Entry {
+        StringSlice key;
+        u64 hash;
+        V value;
+        bool used;
+    };
+
+    Entry* entries;
+    usize capacity; // Always a power of two
+    usize len;
+    Allocator allocator;
+
+    static StringMap<V> init(Allocator allocator, usize initial_capacity = 64) {
+        usize capacity = 16;
+        while (capacity < initial_capacity) capacity *= 2;
+
+        Entry* entries = allocator.alloc_array<Entry>(capacity);
+        if (entries) memset((void*)entries, 0, sizeof(Entry) * capacity);
+
+        return StringMap<V>{
+            .entries = entries,
+            .capacity = entries ? capacity : 0,
+            .len = 0,
+            .allocator = allocator,
+        };
+    }
+
+    void deinit() {
+        for (usize i = 0; i < capacity; i++) {
+            if (!entries[i].used) continue;
+            allocator.free_array((char*)entries[i].key.ptr, entries[i].key.len);
+        }
+
+        allocator.free_array(entries, capacity);
+        entries = nullptr;
+        capacity = 0;
+        len = 0;
+    }
+
+    V* get(StringSlice key) {
+        if (capacity == 0) return nullptr;
+
+        u64 hash = hash_bytes(key.ptr, key.len);
+        Entry* entry = find_slot(entries, capacity, key, hash);
+        return entry->used ? &entry->value : nullptr;
+    }
+
+    /// @brief Returns the value for `key`, inserting `initial` first if the key is new.
+    /// @return Pointer to the value, valid until the next insertion, or nullptr when out of
+    /// memory.
+    V* get_or_insert(StringSlice key, V initial) {
+        if ((len + 1) * 4 > capacity * 3 && !grow()) return nullptr;
+
+        u64 hash = hash_bytes(key.ptr, key.len);
+        Entry* entry = find_slot(entries, capacity, key, hash);
+        if (entry->used) return &entry->value;
+
+        char* key_copy = allocator.alloc_array<char>(key.len > 0 ? key.len : 1);
+        if (!key_copy) return nullptr;
+        memcpy(key_copy, key.ptr, key.len);
+
+        *entry = Entry{
+            .key = StringSlice::init(key_copy, key.len),
+            .hash = hash,
+            .value = initial,
+            .used = true,
+        };
+        len++;
+
+        return &entry->value;
+    }
+
+    /// @brief Grows the map so `count` keys fit without growing again.
+    /// @return False when out of memory.
+    bool reserve(usize count) {
+        while (count * 4 > capacity * 3) {
+            if (!grow()) return false;
+        }
+
+        return true;
+    }
+
+  private:
+    // The home slot of `hash`: murmur3's 64-bit finalizer over the hash seeded with the table
+    // size. FNV-1a's low bits are poorly mixed, and tables of different sizes must not order keys
+    // alike, or walking one map in slot order into a smaller one piles the keys into one run.
+    static usize home_slot(u64 hash, usize table_capacity) {
+        u64 slot = hash ^ (u64)table_capacity;
+        slot ^= slot >> 33;
+        slot *= 0xff51afd7ed558ccdull;
+        slot ^= slot >> 33;
+        slot *= 0xc4ceb9fe1a85ec53ull;
+        slot ^= slot >> 33;
+
+        return (usize)slot & (table_capacity - 1);
+    }
+
+    static Entry* find_slot(Entry* table, usize table_capacity, StringSlice key, u64 hash) {
+        usize mask = table_capacity - 1;
+        usize i = home_slot(hash, table_capacity);
+
+        while (table[i].used) {
+            if (table[i].hash == hash && table[i].key.equals(key)) return &table[i];
+            i = (i + 1) & mask;
+        }
+
+        return &table[i];
+    }
+
+    bool grow() {
+        usize new_capacity = capacity > 0 ? capacity * 2 : 16;
+        Entry* new_entries = allocator.alloc_array<Entry>(new_capacity);
+        if (!new_entries) return false;
+        memset((void*)new_entries, 0, sizeof(Entry) * new_capacity);
+
+        for (usize i = 0; i < capacity; i++) {
+            if (!entries[i].used) continue;
+
+            Entry* slot = find_slot(new_entries, new_capacity, entries[i].key, entries[i].hash);
+            *slot = entries[i];
+        }
+
+        if (entries) allocator.free_array(entries, capacity);
+        entries = new_entries;
+        capacity = new_capacity;
+        return true;
+    }
+};
@@ -0,0 +1,475 @@
+#pragma once
+
+#include "allocator.h"
+#include "bible.h"
+#include "compress.h"
+#include "def.h"
+#include "file.h"
+#include "string.h"
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <optional>
+
+// Precompiled binary index (.bidx)
+//
+// A flat, mmap-able snapshot of a parsed Bible. Loading one is a header check plus pointer
+// arithmetic; lookups are array indexes into the mapping. All integers are stored in host
+// (little-endian) byte order and every section starts on an 8-byte boundary.
+//
+//   BibleIndexHeader
+//   BibleIndexBook[book_count]
+//   BibleChapter[chapter_count]
+//   u8  verse_books[verse_count]
+//   u16 verse_chapters[verse_count]
+//   u16 verse_numbers[verse_count]
+//   u32 text_offsets[verse_count]   relative to the text blob
+//   u32 text_lengths[verse_count]
+//   names blob                      book names, referenced by BibleIndexBook
+//   dictionary                      optional, see below
+//   text blob                       decoded plain UTF-8 verse text, packed back to back
+//
+// An index built with --compress stores the text blob dictionary-coded (see compress.h): the
+// dictionary section holds u32 entry offsets[dictionary_count + 1] followed by the entry bytes,
+// text offsets point at each verse's codes, and text lengths stay the decoded lengths. Every
+// verse decodes on its own, so the text offsets double as the block table.
+
+constexpr char BIBLE_INDEX_MAGIC[4] = {'B', 'I', 'D', 'X'};
+constexpr u32 BIBLE_INDEX_VERSION = 3;
+constexpr string BIBLE_INDEX_EXTENSION = ".bidx";
+
+struct BibleIndexHeader {
+    char magic[4];
+    u32 version;
+    // Size and modification time of the XML file the index was built from
+    u64 source_size;
+    i64 source_modified_time;
+
+    u32 book_count;
+    u32 chapter_count;
+    u32 verse_count;
+    // A Versification, detected when the index is built
+    u32 versification;
+
+    u64 books_offset;
+    u64 chapters_offset;
+    u64 verse_books_offset;
+    u64 verse_chapters_offset;
+    u64 verse_numbers_offset;
+    u64 text_offsets_offset;
+    u64 text_lengths_offset;
+    u64 names_offset;
+    u64 names_size;
+    u64 text_offset;
+    u64 text_size;
+    // Zero when the text blob is plain
+    u64 dictionary_offset;
+    u64 dictionary_size;
+    u32 dictionary_count;
+    u32 reserved;
+};
+
+struct BibleIndexBook {
+    u8 id;
+    u8 reserved[3];
+    // Name range in the names blob
+    u32 name_offset;
+    u32 name_length;
+    u32 first_chapter;
+    u32 chapter_count;
+};
+
+// Chapters are stored in the index exactly as they are laid out in memory
+static_assert(sizeof(BibleChapter) == 12, "BibleChapter layout is part of the index format");
+
+struct BibleIndex {
+    /// @brief Writes `<xml_path>.bidx` into `out`.
+    /// @return False if the buffer is too small.
+    static bool path_for(string xml_path, mut_string out, usize out_size) {
+        i32 written = snprintf(out, out_size, "%s%s", xml_path, BIBLE_INDEX_EXTENSION);
+        return written > 0 && (usize)written < out_size;
+    }
+
+    static bool is_index_path(string path) {
+        usize len = strlen(path);
+        usize extension_len = strlen(BIBLE_INDEX_EXTENSION);
+
+        return len >= extension_len &&
+               string_equals(path + len - extension_len, BIBLE_INDEX_EXTENSION);
+    }
+
+    /// @brief Compiles `bible` into an index file at `path`.
+    /// The file is written next to its final location and renamed into place, so readers never
+    /// see a half-written index.
+    /// @param source Size and modification time of the XML the Bible was loaded from.
+    /// @param compress Dictionary-code the verse text. A corpus with more distinct words than
+    /// the code space holds is written plain.
+    static std::optional<BibleError> write(
+        Allocator& allocator,
+        Bible& bible,
+        FileInfo source,
+        string path,
+        bool compress = false
+    ) {
+        trace_scope("index build");
+
+        // Decode all verse text into one packed blob
+        usize raw_size = 0;
+        for (usize row = 0; row < bible.verse_count; row++) {
+            raw_size += bible.text_lengths[row];
+        }
+
+        char* text = allocator.alloc_array<char>(raw_size > 0 ? raw_size : 1);
+        u32* text_offsets = allocator.alloc_array<u32>(bible.verse_count);
+        u32* text_lengths = allocator.alloc_array<u32>(bible.verse_count);
+        BibleIndexBook* books = allocator.alloc_array<BibleIndexBook>(bible.book_count);
+        if (!text || !text_offsets || !text_lengths || !books) return BibleOutOfMemory;
+
+        defer {
+            allocator.free_array(text, raw_size > 0 ? raw_size : 1);
+            allocator.free_array(text_offsets, bible.verse_count);
+            allocator.free_array(text_lengths, bible.verse_count);
+            allocator.free_array(books, bible.book_count);
+        };
+
+        usize text_size = 0;
+        for (usize row = 0; row < bible.verse_count; row++) {
+            usize length = 0;
+            bible.verse_text_runs(row, [&](StringSlice run) {
+                memcpy(text + text_size + length, run.ptr, run.len);
+                length += run.len;
+            });
+
+            text_offsets[row] = (u32)text_size;
+            text_lengths[row] = (u32)length;
+            text_size += length;
+        }
+
+        // Coding needs a few times the text size in scratch, more than the caller's arena is
+        // sized for, so it gets its own
+        ArenaAllocator compress_arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+        Allocator compress_allocator = compress_arena.allocator();
+        defer { compress_arena.deinit(); };
+
+        auto dictionary = TextDictionaryBuilder::init(compress_allocator);
+        if (compress) {
+            for (usize row = 0; row < bible.verse_count; row++) {
+                StringSlice verse = StringSlice::init(text + text_offsets[row], text_lengths[row]);
+                if (!dictionary.add(verse)) return BibleOutOfMemory;
+            }
+
+            if (dictionary.dictionary_count() > TEXT_DICTIONARY_MAX) {
+                compress = false;
+            } else if (!dictionary.finish()) {
+                return BibleOutOfMemory;
+            }
+        }
+
+        // The codes replace the plain blob, and the offsets are rewritten to point at them
+        u8* codes = nullptr;
+        usize codes_size = 0;
+        u8* dictionary_bytes = nullptr;
+        usize dictionary_size = 0;
+        if (compress) {
+            codes = compress_allocator.alloc_array<u8>(TEXT_CODE_EXPANSION * text_size + 1);
+            dictionary_size = dictionary.dictionary_size();
+            dictionary_bytes = compress_allocator.alloc_array<u8>(dictionary_size);
+            if (!codes || !dictionary_bytes) return BibleOutOfMemory;
+
+            for (usize row = 0; row < bible.verse_count; row++) {
+                StringSlice verse = StringSlice::init(text + text_offsets[row], text_lengths[row]);
+                text_offsets[row] = (u32)codes_size;
+                codes_size += dictionary.encode(verse, codes + codes_size);
+            }
+
+            dictionary.write_dictionary(dictionary_bytes);
+        }
+
+        usize names_size = 0;
+        for (usize i = 0; i < bible.book_count; i++) {
+            BibleBook& book = bible.books[i];
+            books[i] = BibleIndexBook{
+                .id = book.id,
+                .reserved = {0, 0, 0},
+                .name_offset = (u32)names_size,
+                .name_length = (u32)book.name.len,
+                .first_chapter = book.first_chapter,
+                .chapter_count = book.chapter_count,
+            };
+            names_size += book.name.len;
+        }
+
+        BibleIndexHeader header = {};
+        memcpy(header.magic, BIBLE_INDEX_MAGIC, sizeof(header.magic));
+        header.version = BIBLE_INDEX_VERSION;
+        header.source_size = source.size;
+        header.source_modified_time = source.modified_time;
+        header.book_count = (u32)bible.book_count;
+        header.chapter_count = (u32)bible.chapter_count;
+        header.verse_count = (u32)bible.verse_count;
+        header.versification = bible.versification;
+
+        usize verse_count = bible.verse_count;
+        u64 offset = file_align(sizeof(BibleIndexHeader));
+        header.books_offset = offset;
+        offset = file_align(offset + sizeof(BibleIndexBook) * bible.book_count);
+        header.chapters_offset = offset;
+        offset = file_align(offset + sizeof(BibleChapter) * bible.chapter_count);
+        header.verse_books_offset = offset;
+        offset = file_align(offset + sizeof(u8) * verse_count);
+        header.verse_chapters_offset = offset;
+        offset = file_align(offset + sizeof(u16) * verse_count);
+        header.verse_numbers_offset = offset;
+        offset = file_align(offset + sizeof(u16) * verse_count);
+        header.text_offsets_offset = offset;
+        offset = file_align(offset + sizeof(u32) * verse_count);
+        header.text_lengths_offset = offset;
+        offset = file_align(offset + sizeof(u32) * verse_count);
+        header.names_offset = offset;
+        header.names_size = names_size;
+        offset = file_align(offset + names_size);
+        if (compress) {
+            header.dictionary_offset = offset;
+            header.dictionary_size = dictionary_size;
+            header.dictionary_count = (u32)dictionary.dictionary_count();
+            offset = file_align(offset + dictionary_size);
+        }
+        header.text_offset = offset;
+        header.text_size = compress ? codes_size : text_size;
+
+        auto opened = AtomicFileWriter::init(path);
+        if (!opened.has_value()) return BibleWriteFailed;
+
+        AtomicFileWriter& writer = opened.value();
+        writer.write_section(0, &header, sizeof(header));
+        writer.write_section(header.books_offset, books, sizeof(BibleIndexBook) * bible.book_count);
+        writer.write_section(
+            header.chapters_offset,
+            bible.chapters,
+            sizeof(BibleChapter) * bible.chapter_count
+        );
+        writer.write_section(
+            header.verse_books_offset,
+            bible.verse_books,
+            sizeof(u8) * verse_count
+        );
+        writer.write_section(
+            header.verse_chapters_offset,
+            bible.verse_chapters,
+            sizeof(u16) * verse_count
+        );
+        writer.write_section(
+            header.verse_numbers_offset,
+            bible.verse_numbers,
+            sizeof(u16) * verse_count
+        );
+        writer.write_section(header.text_offsets_offset, text_offsets, sizeof(u32) * verse_count);
+        writer.write_section(header.text_lengths_offset, text_lengths, sizeof(u32) * verse_count);
+
+        writer.pad_to(header.names_offset);
+        for (usize i = 0; i < bible.book_count; i++) {
+            writer.write(bible.books[i].name.ptr, bible.books[i].name.len);
+        }
+
+        if (compress) {
+            writer.write_section(header.dictionary_offset, dictionary_bytes, dictionary_size);
+            writer.write_section(header.text_offset, codes, codes_size);
+        } else {
+            writer.write_section(header.text_offset, text, text_size);
+        }
+
+        if (!writer.commit()) return BibleWriteFailed;
+
+        return std::nullopt;
+    }
+
+    /// @brief Maps an index file and points a Bible at its tables. Nothing is parsed or copied
+    /// except the book table (a few dozen entries).
+    /// @param source When set, the index is rejected as stale unless it was built from a file
+    /// with this size and modification time.
+    static std::expected<Bible, BibleError>
+    load(Allocator& allocator, string path, std::optional<FileInfo> source = std::nullopt) {
+        auto file = MappedFile::init(path);
+        if (!file.has_value()) return std::unexpected(BibleFileNotFound);
+
+        auto bible = from_mapping(allocator, file.value(), source);
+        if (!bible.has_value()) file->deinit();
+
+        return bible;
+    }
+
+  private:
+    // Sections start on an 8-byte boundary, so their tables can be read in place
+    static bool section_fits(MappedFile& file, u64 offset, u64 size) {
+        return offset % 8 == 0 && offset <= file.size && size <= file.size - offset;
+    }
+
+    // Checks the dictionary section: offsets must be in order and inside the entry bytes
+    static std::optional<TextDictionary>
+    dictionary_from_mapping(MappedFile& file, BibleIndexHeader& header) {
+        u64 table_size = sizeof(u32) * ((u64)header.dictionary_count + 1);
+        if (header.dictionary_count > TEXT_DICTIONARY_MAX || header.dictionary_size < table_size) {
+            return std::nullopt;
+        }
+
+        const u32* offsets = (const u32*)(file.data + header.dictionary_offset);
+        u64 bytes_size = header.dictionary_size - table_size;
+        for (u32 i = 0; i < header.dictionary_count; i++) {
+            if (offsets[i] > offsets[i + 1]) return std::nullopt;
+        }
+        if (offsets[0] != 0 || offsets[header.dictionary_count] > bytes_size) return std::nullopt;
+
+        return TextDictionary{
+            .offsets = offsets,
+            .bytes = (string)(file.data + header.dictionary_offset + table_size),
+            .count = header.dictionary_count,
+        };
+    }
+
+    static std::expected<Bible, BibleError>
+    from_mapping(Allocator& allocator, MappedFile file, std::optional<FileInfo> source) {
+        if (file.size < sizeof(BibleIndexHeader)) return std::unexpected(BibleInvalidIndex);
+
+        BibleIndexHeader* header = (BibleIndexHeader*)file.data;
+        if (memcmp(header->magic, BIBLE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != BIBLE_INDEX_VERSION) {
+            return std::unexpected(BibleInvalidIndex);
+        }
+
+        if (source.has_value()) {
+            FileInfo built_from = FileInfo{
+                .size = header->source_size,
+                .modified_time = header->source_modified_time,
+            };
+            if (!built_from.equals(source.value())) return std::unexpected(BibleStaleIndex);
+        }
+
+        u64 verse_count = header->verse_count;
+        bool valid =
+            header->book_count <= 255 && header->versification < VERSIFICATION_COUNT &&
+            section_fits(file, header->books_offset, sizeof(BibleIndexBook) * header->book_count) &&
+            section_fits(
+                file,
+                header->chapters_offset,
+                sizeof(BibleChapter) * header->chapter_count
+            ) &&
+            section_fits(file, header->verse_books_offset, sizeof(u8) * verse_count) &&
+            section_fits(file, header->verse_chapters_offset, sizeof(u16) * verse_count) &&
+            section_fits(file, header->verse_numbers_offset, sizeof(u16) * verse_count) &&
+            section_fits(file, header->text_offsets_offset, sizeof(u32) * verse_count) &&
+            section_fits(file, header->text_lengths_offset, sizeof(u32) * verse_count) &&
+            section_fits(file, header->names_offset, header->names_size) &&
+            section_fits(file, header->text_offset, header->text_size) &&
+            section_fits(file, header->dictionary_offset, header->dictionary_size);
+        if (!valid) return std::unexpected(BibleInvalidIndex);
+
+        TextDictionary dictionary = {};
+        if (header->dictionary_count > 0) {
+            auto mapped = dictionary_from_mapping(file, *header);
+            if (!mapped.has_value()) return std::unexpected(BibleInvalidIndex);
+            dictionary = mapped.value();
+        }
+
+        // Chapters must cover rows of the verse table
+        BibleChapter* chapters = (BibleChapter*)(file.data + header->chapters_offset);
+        for (u32 i = 0; i < header->chapter_count; i++) {
+            if ((u64)chapters[i].first_verse + chapters[i].verse_count > verse_count) {
+                return std::unexpected(BibleInvalidIndex);
+            }
+        }
+
+        // Verses must be in order and inside the text section. Plain verses must not overlap,
+        // as grep scans them as one blob; coded verses end where the next begins, and their
+        // lengths are decoded ones.
+        const u32* text_offsets = (const u32*)(file.data + header->text_offsets_offset);
+        const u32* text_lengths = (const u32*)(file.data + header->text_lengths_offset);
+        u64 text_end = 0;
+        for (u64 row = 0; row < verse_count; row++) {
+            if (text_offsets[row] < text_end) return std::unexpected(BibleInvalidIndex);
+
+            text_end = text_offsets[row];
+            if (header->dictionary_count == 0) text_end += text_lengths[row];
+            if (text_end > header->text_size) return std::unexpected(BibleInvalidIndex);
+        }
+
+        BibleIndexBook* index_books = (BibleIndexBook*)(file.data + header->books_offset);
+        string names = (string)(file.data + header->names_offset);
+
+        BibleBook* books = allocator.alloc_array<BibleBook>(header->book_count);
+        if (!books && header->book_count > 0) return std::unexpected(BibleOutOfMemory);
+
+        for (u32 i = 0; i < header->book_count; i++) {
+            BibleIndexBook& book = index_books[i];
+            if ((u64)book.name_offset + book.name_length > header->names_size ||
+                (u64)book.first_chapter + book.chapter_count > header->chapter_count) {
+                return std::unexpected(BibleInvalidIndex);
+            }
+
+            books[i] = BibleBook{
+                .id = book.id,
+                .name = StringSlice::init(names + book.name_offset, book.name_length),
+                .first_chapter = book.first_chapter,
+                .chapter_count = book.chapter_count,
+            };
+        }
+
+        // Lookups only touch the pages of the chapter they print
+        file.advise_random();
+
+        return Bible{
+            .file = file,
+            .text = (string)(file.data + header->text_offset),
+            .text_size = (usize)header->text_size,
+            .text_is_xml = false,
+            .text_dictionary = dictionary,
+            .verse_books = file.data + header->verse_books_offset,
+            .verse_chapters = (u16*)(file.data + header->verse_chapters_offset),
+            .verse_numbers = (u16*)(file.data + header->verse_numbers_offset),
+            .text_offsets = (u32*)text_offsets,
+            .text_lengths = (u32*)text_lengths,
+            .verse_count = (usize)verse_count,
+            .books = books,
+            .book_count = header->book_count,
+            .chapters = chapters,
+            .chapter_count = header->chapter_count,
+            .versification = (Versification)header->versification,
+        };
+    }
+};
+
+/// @brief Opens a Bible the fastest way available: a `.bidx` path is mapped directly, an XML
+/// path uses its sibling `<path>.bidx` when that index is up to date, and falls back to parsing
+/// the XML otherwise.
+inline std::expected<Bible, BibleError> bible_open(Allocator& allocator, string path) {
+    if (BibleIndex::is_index_path(path)) return BibleIndex::load(allocator, path);
+
+    auto source = FileInfo::init(path);
+    if (!source.has_value()) return std::unexpected(BibleFileNotFound);
+
+    char index_path[4096];
+    if (BibleIndex::path_for(path, index_path, sizeof(index_path))) {
+        auto indexed = BibleIndex::load(allocator, index_path, source);
+        if (indexed.has_value()) return indexed;
+    }
+
+    return Bible::load_parallel(allocator, path);
+}
+
+/// @brief Opens just enough of a Bible to print one chapter: an up-to-date index when there is
+/// one, otherwise a streaming parse that stops at the end of the requested chapter.
+inline std::expected<Bible, BibleError>
+bible_open_chapter(Allocator& allocator, string path, StringSlice book_query, usize chapter) {
+    if (BibleIndex::is_index_path(path)) return BibleIndex::load(allocator, path);
+
+    auto source = FileInfo::init(path);
+    if (!source.has_value()) return std::unexpected(BibleFileNotFound);
+
+    char index_path[4096];
+    if (BibleIndex::path_for(path, index_path, sizeof(index_path))) {
+        auto indexed = BibleIndex::load(allocator, index_path, source);
+        if (indexed.has_value()) return indexed;
+    }
+
+    return Bible::load_chapter(allocator, path, book_query, chapter);
+}
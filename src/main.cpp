@@ -1,6 +1,19 @@
+#include "bible.h"
 #include "cli.h"
+#include "concordance.h"
+#include "fuzzy.h"
+#include "grep.h"
+#include "index.h"
 #include "number.h"
+#include "reference.h"
+#include "search.h"
+#include "serve.h"
 #include "string.h"
+#include "timing.h"
+#include "trace.h"
+#include "writer.h"
+#include "xref.h"
+#include <cstdio>
 #include <format>
 
 struct Application {
@@ -11,119 +24,1648 @@ struct Application {
     // The book name. Examples: "John", "1 Corinthians", "1 Corinthians" The name should be in the
     // same language as the Bible file.
     std::optional<string> book;
-    // The chapter number
-    std::optional<usize> chapter;
-    /// The verses range that is gonna be read
-    /// If not set, the whole chapter is read
-    ArrayList<usize> verses;
+    // The chapters and verses to read, sorted and merged (see reference.h)
+    ArrayList<VerseRange> ranges;
+    // The spec the ranges were parsed from, e.g. "3:16-18"
+    StringSlice spec;
 
     static Application init(Allocator& allocator) {
         return Application{
             .allocator = allocator,
             .file_path = std::nullopt,
             .book = std::nullopt,
-            .chapter = std::nullopt,
-            .verses = ArrayList<usize>::init(allocator, 2)
+            .ranges = ArrayList<VerseRange>::init(allocator),
+            .spec = StringSlice::init("", 0),
         };
     }
 
-    void deinit() { verses.deinit(); }
+    void deinit() { ranges.deinit(); }
+};
+
+// Writes the verse text by reference to the mapped file, decoding entities or codes on the fly.
+void print_verse_text(Writer& out, Bible& bible, usize row) {
+    bible.verse_text_runs(row, [&](StringSlice run) { out.write_ref(run); });
+    out.write('\n');
+    process_stats.add_verses(1);
+}
+
+void print_verse(Writer& out, Bible& bible, usize row) {
+    out.write_number(bible.verse_numbers[row]);
+    out.write(' ');
+    print_verse_text(out, bible, row);
+}
+
+// "John 3:16 "
+void print_reference(Writer& out, Bible& bible, usize row) {
+    auto book_index = bible.find_book_by_id(bible.verse_books[row]);
+    StringSlice book_name =
+        book_index.has_value() ? bible.book_name(book_index.value()) : StringSlice::from_cstr("?");
+
+    out.write(book_name);
+    out.write(' ');
+    out.write_number(bible.verse_chapters[row]);
+    out.write(':');
+    out.write_number(bible.verse_numbers[row]);
+    out.write(' ');
+}
+
+// Prints a verse with its full reference, e.g. "John 3:16 For God so loved..."
+void print_verse_with_reference(Writer& out, Bible& bible, usize row) {
+    print_reference(out, bible, row);
+    print_verse_text(out, bible, row);
+}
+
+// Prints a search result with its reference, highlighting the matched spans (ANSI bold red) when
+// `color` is set. `hits` are the result's spans, ordered by start. `scratch` must hold the verse's
+// plain text (see Bible::verse_text_capacity).
+void print_search_result(
+    Writer& out,
+    Bible& bible,
+    usize row,
+    SearchHit* hits,
+    usize hit_count,
+    mut_string scratch,
+    bool color
+) {
+    print_reference(out, bible, row);
+
+    // The text is in `scratch`, which the next result reuses, so it is copied
+    StringSlice text = bible.verse_plain_text(row, scratch);
+    usize written = 0;
+    for (usize i = 0; i < hit_count && color; i++) {
+        // Overlapping spans (a phrase inside a longer one) are merged into the earlier one
+        usize start = hits[i].start > written ? hits[i].start : written;
+        usize end = hits[i].end < text.len ? hits[i].end : text.len;
+        if (start >= end) continue;
+
+        out.write(text.sub(written, start - written));
+        out.write("\x1b[1;31m");
+        out.write(text.sub(start, end - start));
+        out.write("\x1b[0m");
+        written = end;
+    }
+
+    out.write(text.sub(written));
+    out.write('\n');
+    process_stats.add_verses(1);
+}
+
+// Falls back to fuzzy matching for a book name that matched nothing. A single closest book is
+// used directly, otherwise the closest ones are listed.
+// Returns the canonical name to retry with.
+std::optional<StringSlice> correct_book_query(Writer& out, Writer& err, string query) {
+    BookSuggestions suggestions = book_suggest(StringSlice::from_cstr(query));
+
+    if (suggestions.len > 0 && suggestions.unambiguous()) {
+        string name = BIBLE_BOOK_NAMES[suggestions.items[0].id - 1];
+        err.println("Book '{}' not found, showing {}", query, name);
+        err.flush(); // Before the verses, on a terminal
+        return StringSlice::from_cstr(name);
+    }
+
+    out.print("Error: Book '{}' not found", query);
+    for (usize i = 0; i < suggestions.len; i++) {
+        out.print(
+            "{}{}",
+            i == 0 ? ". Did you mean " : i + 1 == suggestions.len ? " or " : ", ",
+            BIBLE_BOOK_NAMES[suggestions.items[i].id - 1]
+        );
+    }
+    out.println("{}", suggestions.len > 0 ? "?" : "");
+    return std::nullopt;
+}
+
+// Cross references printed under each verse (--refs and --depth)
+struct CrossReferences {
+    XrefGraph graph;
+    usize limit;
+    usize depth;
+    ArrayList<XrefVisit> visits;
+};
+
+// Prints the cross references of the verse at `row` under it, best voted first, e.g.
+// "    [347] Romans 5:8 But God commendeth...". A walk deeper than one reference also shows how
+// many references away each verse is. References to verses this Bible lacks are skipped.
+bool print_cross_references(Writer& out, Bible& bible, CrossReferences& refs, usize row) {
+    auto id = bible.canonical_id_of(row);
+    if (!id.has_value()) return true;
+
+    if (!refs.graph.walk(id.value(), refs.limit, refs.depth, refs.visits)) {
+        out.println("Error: Out of memory");
+        return false;
+    }
+
+    for (usize i = 0; i < refs.visits.len; i++) {
+        XrefVisit& visit = refs.visits.items[i];
+        auto first = bible.find_verse_by_id(visit.edge.target);
+        if (!first.has_value()) continue;
+
+        auto last = bible.find_verse_by_id(visit.edge.target_last);
+        usize last_row = last.has_value() && last.value() > first.value() ? last.value()
+                                                                           : first.value();
+
+        out.write("    ");
+        if (refs.depth > 1) out.print("{} ", visit.depth);
+        out.print("[{}] ", visit.edge.votes);
+
+        // "Isaiah 40:26-28" or "Genesis 1:31-2:3" for a range
+        usize first_row = first.value();
+        auto book_index = bible.find_book_by_id(bible.verse_books[first_row]);
+        out.write(
+            book_index.has_value() ? bible.book_name(book_index.value())
+                                   : StringSlice::from_cstr("?")
+        );
+        out.print(" {}:{}", bible.verse_chapters[first_row], bible.verse_numbers[first_row]);
+        if (last_row != first_row) {
+            out.write('-');
+            if (bible.verse_chapters[last_row] != bible.verse_chapters[first_row]) {
+                out.print("{}:", bible.verse_chapters[last_row]);
+            }
+            out.write_number(bible.verse_numbers[last_row]);
+        }
+
+        for (usize verse = first_row; verse <= last_row; verse++) {
+            out.write(' ');
+            bible.verse_text_runs(verse, [&](StringSlice run) { out.write_ref(run); });
+        }
+        out.write('\n');
+    }
+
+    return true;
+}
+
+// Prints the verses of `ranges` under a "Book C" heading per chapter. `book` is the name as
+// given, for messages, and `book_query` the name to look up, which may already be a corrected
+// one. The verse text is written by reference, so `out` is flushed before returning.
+// `refs`, when set, adds the cross references of each verse under it.
+bool print_ranges(
+    Writer& out,
+    Writer& err,
+    Bible& bible,
+    string book,
+    StringSlice book_query,
+    ArrayList<VerseRange>& ranges,
+    CrossReferences* refs = nullptr
+) {
+    StatsTimer lookup_timer = StatsTimer::init(StatsPhaseLookup);
+    defer { lookup_timer.stop(); };
+
+    auto book_index = bible.find_book(book_query);
+    if (!book_index.has_value()) {
+        // Indexed Bibles load whole, so a misspelled name only shows up here
+        auto corrected = correct_book_query(out, err, book);
+        if (!corrected.has_value()) return false;
+
+        book_index = bible.find_book(corrected.value());
+    }
+    if (!book_index.has_value()) {
+        out.println("Error: Book '{}' not found", book);
+        return false;
+    }
+
+    // Every range must exist before anything is printed
+    for (usize i = 0; i < ranges.len; i++) {
+        VerseRange range = ranges.items[i];
+        u16 chapter = verse_position_chapter(range.first);
+        u16 verse = verse_position_verse(range.first);
+
+        bool whole_book = range.first == verse_position(1, 1) &&
+                          verse_position_chapter(range.last) == REFERENCE_END;
+        if (!whole_book && !bible.find_chapter(book_index.value(), chapter).has_value()) {
+            out.println("Error: {} has no chapter {}", book, chapter);
+            return false;
+        }
+
+        if (bible.find_verse_span(book_index.value(), range.first, range.last).is_empty()) {
+            out.println("Error: Verse {} not found", verse);
+            return false;
+        }
+    }
+
+    lookup_timer.stop();
+    lookup_timer = StatsTimer::init(StatsPhaseOutput);
+
+    StringSlice book_name = bible.book_name(book_index.value());
+    u16 heading = 0;
+    for (usize i = 0; i < ranges.len; i++) {
+        RowSpan span =
+            bible.find_verse_span(book_index.value(), ranges.items[i].first, ranges.items[i].last);
+
+        for (u32 row = span.first; row < span.end; row++) {
+            if (bible.verse_chapters[row] != heading) {
+                if (heading != 0) out.write('\n');
+                heading = bible.verse_chapters[row];
+
+                out.write(book_name);
+                out.write(' ');
+                out.write_number(heading);
+                out.write('\n');
+            }
+
+            print_verse(out, bible, row);
+            if (refs && !print_cross_references(out, bible, *refs, row)) return false;
+        }
+    }
+
+    out.flush();
+    return true;
+}
+
+// Prints the verses matching `query`, at most `limit` of them, and the number found.
+bool print_search(
+    Writer& out,
+    Allocator& allocator,
+    Bible& bible,
+    SearchIndex& index,
+    StringSlice query,
+    bool phrase,
+    usize limit,
+    bool color
+) {
+    auto hits = ArrayList<SearchHit>::init(allocator);
+    defer { hits.deinit(); };
+
+    StatsTimer timer = StatsTimer::init(StatsPhaseLookup);
+    defer { timer.stop(); };
+
+    if (!index.search(query, phrase, hits)) {
+        out.println("Error: Out of memory");
+        return false;
+    }
+
+    timer.stop();
+    timer = StatsTimer::init(StatsPhaseOutput);
+
+    usize max_text = 0;
+    for (usize i = 0; i < hits.len; i++) {
+        usize len = bible.verse_text_capacity(hits.items[i].row);
+        if (len > max_text) max_text = len;
+    }
+
+    char* scratch = allocator.alloc_array<char>(max_text + 1);
+    if (!scratch) {
+        out.println("Error: Out of memory");
+        return false;
+    }
+    defer { allocator.free_array(scratch, max_text + 1); };
+
+    usize verse_count = 0;
+    for (usize i = 0; i < hits.len;) {
+        usize first = i;
+        while (i < hits.len && hits.items[i].row == hits.items[first].row) i++;
+
+        if (verse_count < limit) {
+            print_search_result(
+                out,
+                bible,
+                hits.items[first].row,
+                hits.items + first,
+                i - first,
+                scratch,
+                color
+            );
+        }
+        verse_count++;
+    }
+
+    out.println("{} verse(s) found", verse_count);
+    return true;
+}
+
+constexpr usize MAX_TRANSLATIONS = 16;
+
+// One column of a side-by-side view. Each translation is loaded on its own thread into its own
+// arena, since the allocators are not thread-safe.
+struct Translation {
+    string path;
+    ArenaAllocator arena;
+    std::expected<Bible, BibleError> loaded;
+    // Plain text of the verse being printed
+    char* scratch;
+    usize scratch_size;
+
+    StringSlice short_name() {
+        StringSlice name = StringSlice::from_cstr(path);
+        for (usize i = name.len; i > 0; i--) {
+            if (name.ptr[i - 1] == '/' || name.ptr[i - 1] == '\\') {
+                name = name.sub(i);
+                break;
+            }
+        }
+
+        for (usize i = name.len; i > 0; i--) {
+            if (name.ptr[i - 1] == '.') return name.sub(0, i - 1);
+        }
+
+        return name;
+    }
+};
+
+// Takes the next line of at most `width` code points from `text`, breaking at a space when
+// there is one.
+StringSlice next_wrapped_line(StringSlice& text, usize width) {
+    while (text.len > 0 && text.ptr[0] == ' ') text = text.sub(1);
+
+    usize columns = 0;
+    usize last_space = 0;
+    usize i = 0;
+    for (; i < text.len; i++) {
+        if (((u8)text.ptr[i] & 0xC0) == 0x80) continue; // UTF-8 continuation byte
+
+        if (columns == width) {
+            if (last_space > 0) i = last_space;
+            break;
+        }
+        if (text.ptr[i] == ' ') last_space = i;
+        columns++;
+    }
+
+    StringSlice line = text.sub(0, i);
+    text = text.sub(i);
+    while (line.len > 0 && line.ptr[line.len - 1] == ' ') line.len--;
+    return line;
+}
+
+usize count_columns(StringSlice text) {
+    usize columns = 0;
+    for (usize i = 0; i < text.len; i++) {
+        if (((u8)text.ptr[i] & 0xC0) != 0x80) columns++;
+    }
+    return columns;
+}
+
+constexpr usize SIDE_BY_SIDE_LABEL = 5;
+constexpr usize SIDE_BY_SIDE_GAP = 2;
+
+// Prints `line` and pads it to `column_width`, unless it is the last column.
+void print_column(Writer& out, StringSlice line, usize column_width, bool last) {
+    out.write(line);
+    if (last) return;
+
+    usize used = count_columns(line);
+    usize padding = (used < column_width ? column_width - used : 0) + SIDE_BY_SIDE_GAP;
+    for (usize i = 0; i < padding; i++) out.write(' ');
+}
+
+// Prints one verse of every translation side by side: wrapped columns of `column_width` code
+// points, or one tab-separated line when `column_width` is 0. Translations without the verse
+// get an empty column, and a verse no translation has is skipped.
+void print_verse_row(
+    Writer& out,
+    Translation* translations,
+    usize count,
+    VerseId id,
+    usize column_width
+) {
+    StringSlice texts[MAX_TRANSLATIONS];
+    bool found = false;
+    for (usize i = 0; i < count; i++) {
+        texts[i] = StringSlice::init("", 0);
+        if (!translations[i].loaded.has_value()) continue;
+
+        Bible& bible = translations[i].loaded.value();
+        auto row = bible.find_verse_by_id(id);
+        if (row.has_value()) {
+            texts[i] = bible.verse_plain_text(row.value(), translations[i].scratch);
+            found = true;
+        }
+    }
+
+    if (!found) return;
+
+    if (column_width == 0) {
+        out.write_number(verse_id_verse(id));
+        for (usize i = 0; i < count; i++) {
+            out.write('\t');
+            out.write(texts[i]);
+        }
+        out.write('\n');
+        return;
+    }
+
+    for (bool first_line = true;; first_line = false) {
+        bool remaining = false;
+        for (usize i = 0; i < count; i++) remaining = remaining || texts[i].len > 0;
+        if (!remaining && !first_line) break;
+
+        if (first_line) {
+            out.print("{:<5}", verse_id_verse(id));
+        } else {
+            out.print("{:<5}", "");
+        }
+
+        for (usize i = 0; i < count; i++) {
+            StringSlice line = next_wrapped_line(texts[i], column_width);
+            print_column(out, line, column_width, i + 1 == count);
+        }
+        out.write('\n');
+    }
+}
+
+// Side-by-side view of one chapter in several translations, `file_list` being comma-separated.
+bool print_translations(Application* app, string file_list) {
+    Translation translations[MAX_TRANSLATIONS];
+    usize count = 0;
+
+    // Split the list in place in a copy, so each path is NUL-terminated
+    usize list_len = strlen(file_list);
+    char* paths = app->allocator.alloc_array<char>(list_len + 1);
+    if (!paths) {
+        std::println("Error: Out of memory");
+        return false;
+    }
+    memcpy(paths, file_list, list_len + 1);
+
+    for (char* path = paths; path;) {
+        char* comma = strchr(path, ',');
+        if (comma) *comma = 0;
+
+        if (*path) {
+            if (count == MAX_TRANSLATIONS) {
+                std::println("Error: At most {} files can be compared", MAX_TRANSLATIONS);
+                return false;
+            }
+            translations[count++] = Translation{
+                .path = path,
+                .arena = ArenaAllocator::init(PageAllocator::init(), 4096, MB(8)),
+                .loaded = std::unexpected(BibleFileNotFound),
+                .scratch = nullptr,
+                .scratch_size = 0,
+            };
+        }
+
+        path = comma ? comma + 1 : nullptr;
+    }
+
+    defer {
+        for (usize i = 0; i < count; i++) {
+            if (translations[i].loaded.has_value()) translations[i].loaded->deinit();
+            translations[i].arena.deinit();
+        }
+    };
+
+    // One chapter is compared at a time
+    u16 chapter = verse_position_chapter(app->ranges.items[0].first);
+    for (usize i = 0; i < app->ranges.len; i++) {
+        if (!app->ranges.items[i].within_chapter() ||
+            verse_position_chapter(app->ranges.items[i].first) != chapter) {
+            std::println("Error: Side-by-side view shows one chapter at a time");
+            return false;
+        }
+    }
+
+    // Whole Bibles: where a chapter starts depends on the file's versification, which is only
+    // known from the layout of its books
+    std::thread workers[MAX_TRANSLATIONS];
+    for (usize i = 0; i < count; i++) {
+        workers[i] = std::thread([&, i]() {
+            Translation& translation = translations[i];
+            Allocator allocator = translation.arena.allocator();
+            trace_thread_name("translation loader");
+            trace_scope("open translation", (i64)i);
+            translation.loaded = bible_open(allocator, translation.path);
+        });
+    }
+
+    for (usize i = 0; i < count; i++) workers[i].join();
+
+    // The book is resolved against every file; a misspelled name is corrected once for all
+    StringSlice book_query = StringSlice::from_cstr(app->book.value());
+    std::optional<u8> book_id;
+    for (usize attempt = 0; attempt < 2 && !book_id.has_value(); attempt++) {
+        for (usize i = 0; i < count && !book_id.has_value(); i++) {
+            if (!translations[i].loaded.has_value()) continue;
+
+            Bible& bible = translations[i].loaded.value();
+            auto book_index = bible.find_book(book_query);
+            if (book_index.has_value()) book_id = bible.books[book_index.value()].id;
+        }
+
+        if (book_id.has_value() || attempt > 0) break;
+
+        Writer out = Writer::init(app->allocator, stdout);
+        Writer err = Writer::init(app->allocator, stderr);
+        defer {
+            out.deinit();
+            err.deinit();
+        };
+
+        auto corrected = correct_book_query(out, err, app->book.value());
+        if (!corrected.has_value()) return false;
+        book_query = corrected.value();
+    }
+
+    for (usize i = 0; i < count; i++) {
+        auto& loaded = translations[i].loaded;
+        if (!loaded.has_value()) {
+            std::println(
+                "Error: Could not load '{}': {}",
+                translations[i].path,
+                bible_error_message(loaded.error())
+            );
+            return false;
+        }
+    }
+
+    if (!book_id.has_value()) {
+        std::println("Error: Book '{}' not found", app->book.value());
+        return false;
+    }
+
+    // Verse range: the union over every translation that has the chapter. Verses are matched
+    // by canonical id, so a chapter numbered differently in some file still lines up.
+    usize last_verse = 0;
+    std::optional<StringSlice> book_name;
+    for (usize i = 0; i < count; i++) {
+        if (!translations[i].loaded.has_value()) continue;
+
+        Bible& bible = translations[i].loaded.value();
+        auto book_index = bible.find_book_by_id(book_id.value());
+        if (!book_index.has_value() || chapter > VERSE_ID_MAX_CHAPTER) continue;
+
+        VerseId chapter_first = verse_id(book_id.value(), chapter, 1);
+        VerseId chapter_last = verse_id(book_id.value(), chapter, REFERENCE_END);
+        bool has_chapter = false;
+
+        BibleBook& book = bible.books[book_index.value()];
+        for (u32 c = book.first_chapter; c < book.first_chapter + book.chapter_count; c++) {
+            BibleChapter& found = bible.chapters[c];
+            for (u32 row = found.first_verse; row < found.first_verse + found.verse_count; row++) {
+                auto id = bible.canonical_id_of(row);
+                if (!id.has_value() || id.value() < chapter_first || id.value() > chapter_last) {
+                    continue;
+                }
+
+                has_chapter = true;
+                u16 verse = verse_id_verse(id.value());
+                if (verse > last_verse) last_verse = verse;
+
+                usize len = bible.verse_text_capacity(row);
+                if (len > translations[i].scratch_size) translations[i].scratch_size = len;
+            }
+        }
+        if (!has_chapter) continue;
+
+        if (!book_name.has_value()) book_name = bible.book_name(book_index.value());
+
+        Allocator allocator = translations[i].arena.allocator();
+        translations[i].scratch = allocator.alloc_array<char>(translations[i].scratch_size + 1);
+        if (!translations[i].scratch) {
+            std::println("Error: Out of memory");
+            return false;
+        }
+    }
+
+    if (!book_name.has_value()) {
+        std::println("Error: {} has no chapter {}", app->book.value(), chapter);
+        return false;
+    }
+
+    usize first_verse = verse_position_verse(app->ranges.items[0].first);
+    usize requested_last = verse_position_verse(app->ranges.items[app->ranges.len - 1].last);
+    if (requested_last < last_verse) last_verse = requested_last;
+
+    // Columns on a terminal, tab-separated otherwise
+    usize column_width = 0;
+    if (file_is_terminal(stdout)) {
+        usize width = file_terminal_width(stdout);
+        usize chrome = SIDE_BY_SIDE_LABEL + SIDE_BY_SIDE_GAP * (count - 1);
+        column_width = width > chrome + 10 * count ? (width - chrome) / count : 10;
+    }
+
+    Writer out = Writer::init(app->allocator, stdout);
+    defer { out.deinit(); };
+
+    out.write(book_name.value());
+    out.write(' ');
+    out.write_number(chapter);
+    out.write('\n');
+
+    if (column_width > 0) {
+        out.print("{:<5}", "");
+        for (usize i = 0; i < count; i++) {
+            print_column(out, translations[i].short_name(), column_width, i + 1 == count);
+        }
+        out.write('\n');
+    }
+
+    usize range = 0;
+    for (usize verse = first_verse; verse <= last_verse; verse++) {
+        // Skip the gaps between the ranges, e.g. verse 19 of "3:16-18,20"
+        VersePosition position = verse_position(chapter, (u16)verse);
+        while (range < app->ranges.len && app->ranges.items[range].last < position) range++;
+        if (range == app->ranges.len) break;
+        if (position < app->ranges.items[range].first) continue;
+
+        VerseId id = verse_id(book_id.value(), chapter, (u16)verse);
+        print_verse_row(out, translations, count, id, column_width);
+    }
+
+    return true;
+}
+
+bool main_command_handler(CLICommand& command, void* user_data) {
+    auto app = (Application*)user_data;
+
+    // Handle file option
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
+        return false;
+    }
+    app->file_path = file_opt->value.value();
+
+    // Handle book option
+    auto book_opt = command.get_option("book");
+    if (!book_opt.has_value() || !book_opt->value.has_value()) {
+        std::println("Error: Book name is required. Use -b or --book to specify.");
+        return false;
+    }
+    app->book = book_opt->value.value();
+
+    // Handle chapter and verse options. Without them the book option can hold a whole
+    // reference, e.g. "John 3:16-18,20" or just "Jude".
+    auto chapter_opt = command.get_option("chapter");
+    auto verse_opt = command.get_option("verse");
+    bool has_chapter = chapter_opt.has_value() && chapter_opt->value.has_value();
+    bool has_verse = verse_opt.has_value() && verse_opt->value.has_value();
+
+    char spec_buffer[256];
+    char book_buffer[256];
+    if (has_chapter) {
+        string chapter_text = chapter_opt->value.value();
+        auto chapter_parsed = int_from_str<usize>(chapter_text);
+        if (!chapter_parsed.has_value() || chapter_parsed.value() == 0 ||
+            chapter_parsed.value() >= REFERENCE_END) {
+            std::println("Error: Invalid chapter number '{}'", chapter_text);
+            return false;
+        }
+
+        // "-c 3 -v 16-18" reads as "3:16-18"
+        string verse_text = has_verse ? verse_opt->value.value() : "";
+        i32 written = snprintf(
+            spec_buffer,
+            sizeof(spec_buffer),
+            has_verse ? "%zu:%s" : "%zu",
+            chapter_parsed.value(),
+            verse_text
+        );
+        if (written < 0 || written >= (i32)sizeof(spec_buffer)) written = 0;
+
+        app->spec = StringSlice::init(spec_buffer, (usize)written);
+        if (app->spec.is_empty() || !Reference::parse_ranges(app->spec, app->ranges)) {
+            std::println("Error: Invalid verse number or range '{}'", verse_text);
+            return false;
+        }
+    } else if (has_verse) {
+        std::println("Error: Chapter number is required. Use -c or --chapter to specify.");
+        return false;
+    } else {
+        auto reference = Reference::parse(StringSlice::from_cstr(app->book.value()), app->ranges);
+        if (!reference.has_value() || reference->book.len >= sizeof(book_buffer)) {
+            std::println("Error: Invalid reference '{}'", app->book.value());
+            return false;
+        }
+
+        memcpy(book_buffer, reference->book.ptr, reference->book.len);
+        book_buffer[reference->book.len] = 0;
+        app->book = book_buffer;
+        app->spec = reference->spec;
+    }
+
+    // Cross references: the `limit` best of each verse, walked `depth` references deep
+    auto refs_opt = command.get_option("refs");
+    auto depth_opt = command.get_option("depth");
+    bool has_refs = refs_opt.has_value() && refs_opt->value.has_value();
+    usize refs_limit = 0;
+    usize refs_depth = 1;
+    if (has_refs) {
+        auto limit_parsed = int_from_str<usize>(refs_opt->value.value());
+        if (!limit_parsed.has_value() || limit_parsed.value() == 0) {
+            std::println("Error: Invalid number of references '{}'", refs_opt->value.value());
+            return false;
+        }
+        refs_limit = limit_parsed.value();
+    }
+    if (depth_opt.has_value() && depth_opt->value.has_value()) {
+        auto depth_parsed = int_from_str<usize>(depth_opt->value.value());
+        if (!depth_parsed.has_value() || depth_parsed.value() == 0) {
+            std::println("Error: Invalid depth '{}'", depth_opt->value.value());
+            return false;
+        }
+        if (!has_refs) {
+            std::println("Error: --depth needs --refs");
+            return false;
+        }
+        refs_depth = depth_parsed.value();
+    }
+
+    if (strchr(app->file_path.value(), ',')) {
+        if (has_refs) {
+            std::println("Error: --refs needs a single Bible file");
+            return false;
+        }
+        return print_translations(app, app->file_path.value());
+    }
+
+    std::optional<CrossReferences> refs = std::nullopt;
+    defer {
+        if (refs.has_value()) {
+            refs->visits.deinit();
+            refs->graph.deinit();
+        }
+    };
+    if (has_refs) {
+        char graph_path[4096];
+        if (!XrefGraph::path_for(app->file_path.value(), graph_path, sizeof(graph_path))) {
+            std::println("Error: File path is too long");
+            return false;
+        }
+
+        auto graph = XrefGraph::load(graph_path);
+        if (!graph.has_value()) {
+            std::println(
+                "Error: Could not load cross references '{}': {}. Build them with "
+                "`bible index -f {} -x <cross_references.txt>`",
+                graph_path,
+                bible_error_message(graph.error()),
+                app->file_path.value()
+            );
+            return false;
+        }
+
+        refs = CrossReferences{
+            .graph = graph.value(),
+            .limit = refs_limit,
+            .depth = refs_depth,
+            .visits = ArrayList<XrefVisit>::init(app->allocator),
+        };
+    }
+
+    // A running `bible serve` already has the file loaded. It does not serve cross references.
+    if (!has_refs && app->spec.len < sizeof(spec_buffer)) {
+        char spec_text[sizeof(spec_buffer)];
+        memcpy(spec_text, app->spec.ptr, app->spec.len);
+        spec_text[app->spec.len] = 0;
+
+        string request[] = {app->book.value(), spec_text};
+        auto served = serve_forward(ServeReference, app->file_path.value(), request, 2);
+        if (served.has_value()) return served.value();
+    }
+
+    // Without an index, a single chapter is parsed on its own and the rest of the file skipped.
+    // Cross references point anywhere, so they need the whole Bible.
+    u16 chapter = verse_position_chapter(app->ranges.items[0].first);
+    bool one_chapter = !has_refs;
+    for (usize i = 0; i < app->ranges.len; i++) {
+        VerseRange range = app->ranges.items[i];
+        one_chapter = one_chapter && range.within_chapter() &&
+                      verse_position_chapter(range.first) == chapter;
+    }
+
+    auto open = [&](StringSlice book_query) {
+        if (one_chapter) {
+            return bible_open_chapter(app->allocator, app->file_path.value(), book_query, chapter);
+        }
+        return bible_open(app->allocator, app->file_path.value());
+    };
+
+    Writer out = Writer::init(app->allocator, stdout);
+    Writer err = Writer::init(app->allocator, stderr);
+    defer {
+        out.deinit();
+        err.deinit();
+    };
+
+    StringSlice book_query = StringSlice::from_cstr(app->book.value());
+    auto loaded = open(book_query);
+    if (!loaded.has_value() && loaded.error() == BibleBookNotFound) {
+        auto corrected = correct_book_query(out, err, app->book.value());
+        if (!corrected.has_value()) return false;
+
+        book_query = corrected.value();
+        loaded = open(book_query);
+    }
+    if (!loaded.has_value() && loaded.error() == BibleBookNotFound) {
+        out.println("Error: Book '{}' not found", app->book.value());
+        return false;
+    }
+    if (!loaded.has_value() && loaded.error() == BibleChapterNotFound) {
+        out.println("Error: {} has no chapter {}", app->book.value(), chapter);
+        return false;
+    }
+    if (!loaded.has_value()) {
+        out.println(
+            "Error: Could not load '{}': {}",
+            app->file_path.value(),
+            bible_error_message(loaded.error())
+        );
+        return false;
+    }
+
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    CrossReferences* verse_refs = refs.has_value() ? &refs.value() : nullptr;
+    return print_ranges(out, err, bible, app->book.value(), book_query, app->ranges, verse_refs);
+}
+
+bool index_command_handler(CLICommand& command, void* user_data) {
+    auto app = (Application*)user_data;
+
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
+        return false;
+    }
+    app->file_path = file_opt->value.value();
+
+    char default_output[4096];
+    string output_path = default_output;
+
+    auto output_opt = command.get_option("output");
+    if (output_opt.has_value() && output_opt->value.has_value()) {
+        output_path = output_opt->value.value();
+    } else {
+        string xml_path = app->file_path.value();
+        if (!BibleIndex::path_for(xml_path, default_output, sizeof(default_output))) {
+            std::println("Error: File path is too long");
+            return false;
+        }
+    }
+
+    auto source = FileInfo::init(app->file_path.value());
+    if (!source.has_value()) {
+        std::println("Error: Could not open '{}'", app->file_path.value());
+        return false;
+    }
+
+    usize jobs = 0; // One worker per hardware thread
+    auto jobs_opt = command.get_option("jobs");
+    if (jobs_opt.has_value() && jobs_opt->value.has_value()) {
+        auto jobs_parsed = int_from_str<usize>(jobs_opt->value.value());
+        if (!jobs_parsed.has_value()) {
+            std::println("Error: Invalid number of jobs '{}'", jobs_opt->value.value());
+            return false;
+        }
+        jobs = jobs_parsed.value();
+    }
+
+    auto loaded = Bible::load_parallel(app->allocator, app->file_path.value(), jobs);
+    if (!loaded.has_value()) {
+        std::println(
+            "Error: Could not load '{}': {}",
+            app->file_path.value(),
+            bible_error_message(loaded.error())
+        );
+        return false;
+    }
+
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    auto compress_opt = command.get_option("compress");
+    bool compress = compress_opt.has_value() && compress_opt->value.has_value();
+
+    auto error = BibleIndex::write(app->allocator, bible, source.value(), output_path, compress);
+    if (error.has_value()) {
+        std::println(
+            "Error: Could not write index '{}': {}",
+            output_path,
+            bible_error_message(error.value())
+        );
+        return false;
+    }
+
+    std::println(
+        "Indexed {} books, {} chapters, {} verses ({} versification) into {}",
+        bible.book_count,
+        bible.chapter_count,
+        bible.verse_count,
+        versification_name(bible.versification),
+        output_path
+    );
+
+    char search_path[4096];
+    if (SearchIndex::path_for(app->file_path.value(), search_path, sizeof(search_path))) {
+        error = SearchIndex::build(bible, source.value(), search_path);
+        if (error.has_value()) {
+            std::println(
+                "Error: Could not write search index '{}': {}",
+                search_path,
+                bible_error_message(error.value())
+            );
+            return false;
+        }
+
+        std::println("Wrote search index {}", search_path);
+    }
+
+    auto xrefs_opt = command.get_option("xrefs");
+    if (xrefs_opt.has_value() && xrefs_opt->value.has_value()) {
+        char graph_path[4096];
+        if (!XrefGraph::path_for(app->file_path.value(), graph_path, sizeof(graph_path))) {
+            std::println("Error: File path is too long");
+            return false;
+        }
+
+        auto edges = XrefGraph::build(xrefs_opt->value.value(), graph_path);
+        if (!edges.has_value()) {
+            std::println(
+                "Error: Could not compile cross references '{}': {}",
+                xrefs_opt->value.value(),
+                bible_error_message(edges.error())
+            );
+            return false;
+        }
 
-    bool parse_verses(string verse_str) {
-        if (string_contains(verse_str, "-")) { // Range case
-            char start_buffer[32];
-            char end_buffer[32];
+        std::println("Wrote {} cross references into {}", edges.value(), graph_path);
+    }
 
-            i32 dash_pos = string_find(verse_str, "-");
-            if (!string_substring(verse_str, 0, dash_pos, start_buffer, sizeof(start_buffer)) ||
-                !string_substring(
-                    verse_str,
-                    dash_pos + 1,
-                    (i32)strlen(verse_str) - dash_pos - 1,
-                    end_buffer,
-                    sizeof(end_buffer)
-                )) {
-                return false;
-            }
+    return true;
+}
 
-            auto start = int_from_str<usize>(start_buffer);
-            auto end = int_from_str<usize>(end_buffer);
-            if (!start.has_value() || !end.has_value() || start.value() == 0 || end.value() == 0 ||
-                start.value() > end.value()) {
-                return false;
-            }
+bool search_command_handler(CLICommand& command, void* user_data) {
+    auto app = (Application*)user_data;
 
-            verses.append(start.value());
-            verses.append(end.value());
-        } else { // Single verse case
-            auto verse = int_from_str<usize>(verse_str);
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
+        return false;
+    }
+    app->file_path = file_opt->value.value();
 
-            if (!verse.has_value()) {
-                return false;
-            }
+    auto query_opt = command.get_option("query");
+    if (!query_opt.has_value() || !query_opt->value.has_value()) {
+        std::println("Error: Search query is required. Use -q or --query to specify.");
+        return false;
+    }
+    StringSlice query = StringSlice::from_cstr(query_opt->value.value()).trim();
+
+    // A quoted query is a phrase, as is any query with --phrase
+    auto phrase_opt = command.get_option("phrase");
+    bool phrase = phrase_opt.has_value() && phrase_opt->value.has_value();
+    if (query.len >= 2 && query.ptr[0] == '"' && query.ptr[query.len - 1] == '"') {
+        query = query.sub(1, query.len - 2);
+        phrase = true;
+    }
 
-            if (verse.value() == 0) return false;
-            verses.append(verse.value());
+    usize limit = USIZE_MAX;
+    auto limit_opt = command.get_option("limit");
+    if (limit_opt.has_value() && limit_opt->value.has_value()) {
+        auto limit_parsed = int_from_str<usize>(limit_opt->value.value());
+        if (!limit_parsed.has_value()) {
+            std::println("Error: Invalid limit '{}'", limit_opt->value.value());
+            return false;
         }
+        limit = limit_parsed.value();
+    }
 
-        return true;
+    bool color = file_is_terminal(stdout);
+
+    // A running `bible serve` already has the file and its index loaded
+    char query_text[4096];
+    char limit_text[24];
+    if (query.len < sizeof(query_text)) {
+        memcpy(query_text, query.ptr, query.len);
+        query_text[query.len] = 0;
+        snprintf(limit_text, sizeof(limit_text), "%zu", limit);
+
+        string request[] = {query_text, phrase ? "1" : "0", limit_text, color ? "1" : "0"};
+        auto served = serve_forward(ServeSearch, app->file_path.value(), request, 4);
+        if (served.has_value()) return served.value();
     }
-};
 
-bool main_command_handler(CLICommand& command, void* user_data) {
+    auto loaded = bible_open(app->allocator, app->file_path.value());
+    if (!loaded.has_value()) {
+        std::println(
+            "Error: Could not load '{}': {}",
+            app->file_path.value(),
+            bible_error_message(loaded.error())
+        );
+        return false;
+    }
+
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    auto opened = search_index_open(bible, app->file_path.value());
+    if (!opened.has_value()) {
+        std::println("Error: Could not open search index: {}", bible_error_message(opened.error()));
+        return false;
+    }
+
+    SearchIndex index = opened.value();
+    defer { index.deinit(); };
+
+    Writer out = Writer::init(app->allocator, stdout);
+    defer { out.deinit(); };
+
+    return print_search(out, app->allocator, bible, index, query, phrase, limit, color);
+}
+
+bool grep_command_handler(CLICommand& command, void* user_data) {
     auto app = (Application*)user_data;
 
-    // Handle book option
-    auto book_opt = command.get_option("book");
-    if (!book_opt.has_value() || !book_opt->value.has_value()) {
-        std::println("Error: Book name is required. Use -b or --book to specify.");
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
         return false;
     }
-    app->book = book_opt->value.value();
+    app->file_path = file_opt->value.value();
 
-    // Handle chapter option
-    auto chapter_opt = command.get_option("chapter");
-    if (!chapter_opt.has_value() || !chapter_opt->value.has_value()) {
-        std::println("Error: Chapter number is required. Use -c or --chapter to specify.");
+    auto text_opt = command.get_option("text");
+    if (!text_opt.has_value() || !text_opt->value.has_value() || !*text_opt->value.value()) {
+        std::println("Error: Text to find is required. Use -t or --text to specify.");
+        return false;
+    }
+    StringSlice text = StringSlice::from_cstr(text_opt->value.value());
+
+    usize limit = USIZE_MAX;
+    auto limit_opt = command.get_option("limit");
+    if (limit_opt.has_value() && limit_opt->value.has_value()) {
+        auto limit_parsed = int_from_str<usize>(limit_opt->value.value());
+        if (!limit_parsed.has_value()) {
+            std::println("Error: Invalid limit '{}'", limit_opt->value.value());
+            return false;
+        }
+        limit = limit_parsed.value();
+    }
+
+    usize jobs = 0; // One worker per hardware thread
+    auto jobs_opt = command.get_option("jobs");
+    if (jobs_opt.has_value() && jobs_opt->value.has_value()) {
+        auto jobs_parsed = int_from_str<usize>(jobs_opt->value.value());
+        if (!jobs_parsed.has_value()) {
+            std::println("Error: Invalid number of jobs '{}'", jobs_opt->value.value());
+            return false;
+        }
+        jobs = jobs_parsed.value();
+    }
+
+    auto loaded = bible_open(app->allocator, app->file_path.value());
+    if (!loaded.has_value()) {
+        std::println(
+            "Error: Could not load '{}': {}",
+            app->file_path.value(),
+            bible_error_message(loaded.error())
+        );
         return false;
     }
 
-    auto chapter_parsed = int_from_str<usize>(chapter_opt->value.value());
-    if (!chapter_parsed.has_value()) {
-        std::println("Error: Invalid chapter number '{}'", chapter_opt->value.value());
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    auto rows = ArrayList<u32>::init(app->allocator);
+    defer { rows.deinit(); };
+
+    StatsTimer timer = StatsTimer::init(StatsPhaseLookup);
+    defer { timer.stop(); };
+
+    if (!bible_grep(bible, text, rows, jobs)) {
+        std::println("Error: Out of memory");
         return false;
     }
-    app->chapter = chapter_parsed.value();
 
-    // Handle verse option (optional)
-    auto verse_opt = command.get_option("verse");
-    if (verse_opt.has_value() && verse_opt->value.has_value()) {
-        if (!app->parse_verses(verse_opt->value.value()) || app->verses.len == 0) {
-            std::println("Error: Invalid verse number or range '{}'", verse_opt->value.value());
+    timer.stop();
+    timer = StatsTimer::init(StatsPhaseOutput);
+
+    // Declared after `bible`, so the verse text is flushed before it is unmapped
+    Writer out = Writer::init(app->allocator, stdout);
+    defer { out.deinit(); };
+
+    for (usize i = 0; i < rows.len && i < limit; i++) {
+        print_verse_with_reference(out, bible, rows.items[i]);
+    }
+
+    out.println("{} verse(s) found", rows.len);
+    return true;
+}
+
+void print_counts(Writer& out, string title, ArrayList<ConcordanceCount>& counts) {
+    out.println("{}:", title);
+    for (usize i = 0; i < counts.len; i++) {
+        out.print("{:>9} ", counts.items[i].count);
+        out.write(counts.items[i].key);
+        out.write('\n');
+    }
+}
+
+void print_distribution(Writer& out, string title, ConcordanceDistribution& distribution) {
+    out.println(
+        "{}: min {}, median {}, p90 {}, max {}, mean {:.1f}",
+        title,
+        distribution.min,
+        distribution.median,
+        distribution.p90,
+        distribution.max,
+        distribution.mean
+    );
+}
+
+// "Genesis: 1533 verses, 38267 words (2817 distinct)"
+void print_book_summary(Writer& out, Bible& bible, ConcordanceBook& book) {
+    out.write(bible.book_name(book.book_index));
+    out.println(
+        ": {} verses, {} words ({} distinct)",
+        book.verse_count,
+        book.word_count,
+        book.distinct_words
+    );
+}
+
+bool concordance_command_handler(CLICommand& command, void* user_data) {
+    auto app = (Application*)user_data;
+
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
+        return false;
+    }
+    app->file_path = file_opt->value.value();
+
+    usize limit = 20;
+    auto limit_opt = command.get_option("limit");
+    if (limit_opt.has_value() && limit_opt->value.has_value()) {
+        auto limit_parsed = int_from_str<usize>(limit_opt->value.value());
+        if (!limit_parsed.has_value()) {
+            std::println("Error: Invalid limit '{}'", limit_opt->value.value());
+            return false;
+        }
+        limit = limit_parsed.value();
+    }
+
+    usize jobs = 0; // One worker per hardware thread
+    auto jobs_opt = command.get_option("jobs");
+    if (jobs_opt.has_value() && jobs_opt->value.has_value()) {
+        auto jobs_parsed = int_from_str<usize>(jobs_opt->value.value());
+        if (!jobs_parsed.has_value()) {
+            std::println("Error: Invalid number of jobs '{}'", jobs_opt->value.value());
+            return false;
+        }
+        jobs = jobs_parsed.value();
+    }
+
+    auto loaded = bible_open(app->allocator, app->file_path.value());
+    if (!loaded.has_value()) {
+        std::println(
+            "Error: Could not load '{}': {}",
+            app->file_path.value(),
+            bible_error_message(loaded.error())
+        );
+        return false;
+    }
+
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    // With a book, its own word list replaces the per-book overview
+    std::optional<usize> book_index = std::nullopt;
+    auto book_opt = command.get_option("book");
+    if (book_opt.has_value() && book_opt->value.has_value()) {
+        book_index = bible.find_book(StringSlice::from_cstr(book_opt->value.value()));
+        if (!book_index.has_value()) {
+            std::println("Error: Book '{}' not found", book_opt->value.value());
             return false;
         }
     }
 
-    std::println("Reading {} chapter {}", app->book.value(), app->chapter.value());
+    // The per-book overview shows each book's three most frequent words
+    usize book_limit = book_index.has_value() ? limit : 3;
+    auto built = Concordance::build(app->allocator, bible, limit, book_limit, jobs);
+    if (!built.has_value()) {
+        std::println("Error: {}", bible_error_message(built.error()));
+        return false;
+    }
+
+    Concordance concordance = built.value();
+    defer { concordance.deinit(); };
+
+    Writer out = Writer::init(app->allocator, stdout);
+    defer { out.deinit(); };
+
+    if (book_index.has_value()) {
+        ConcordanceBook& book = concordance.books[book_index.value()];
+        print_book_summary(out, bible, book);
+        print_counts(out, "Words", book.words);
+        return true;
+    }
+
+    out.println(
+        "{} verses, {} chapters, {} words ({} distinct, {} bigrams, {} trigrams)",
+        concordance.verse_count,
+        bible.chapter_count,
+        concordance.word_count,
+        concordance.distinct_words,
+        concordance.distinct_bigrams,
+        concordance.distinct_trigrams
+    );
+    print_distribution(out, "Words per verse", concordance.verse_words);
+    print_distribution(out, "Verses per chapter", concordance.chapter_verses);
+
+    out.write('\n');
+    print_counts(out, "Words", concordance.words);
+    out.write('\n');
+    print_counts(out, "Bigrams", concordance.bigrams);
+    out.write('\n');
+    print_counts(out, "Trigrams", concordance.trigrams);
+
+    out.write('\n');
+    out.println("Books:");
+    for (usize i = 0; i < concordance.book_count; i++) {
+        ConcordanceBook& book = concordance.books[i];
+        print_book_summary(out, bible, book);
+
+        out.print("   ");
+        for (usize j = 0; j < book.words.len; j++) {
+            out.write(j == 0 ? " " : ", ");
+            out.write(book.words.items[j].key);
+            out.print(" {}", book.words.items[j].count);
+        }
+        out.write('\n');
+    }
+
+    return true;
+}
+
+// References resolved and rendered per round; bounds the memory a long input needs
+constexpr usize BATCH_CHUNK = 8192;
+
+// One line of batch input
+struct BatchLookup {
+    StringSlice line;
+    usize line_number;
+    // Row spans [span_start, span_start + span_count) of the chunk, valid when `error` is empty
+    u32 span_start;
+    u32 span_count;
+    string error;
+    // Rendered output, a range of the chunk's output buffer
+    usize output_start;
+    usize output_end;
+};
+
+// Resolves the lookup's line to row spans, appended to `spans`. `ranges` is scratch.
+bool batch_resolve(
+    Bible& bible,
+    BatchLookup& lookup,
+    ArrayList<VerseRange>& ranges,
+    ArrayList<RowSpan>& spans
+) {
+    lookup.error = nullptr;
+    lookup.span_start = (u32)spans.len;
+    lookup.span_count = 0;
+
+    auto reference = Reference::parse(lookup.line, ranges);
+    if (!reference.has_value()) {
+        lookup.error = "not a reference";
+        return true;
+    }
+
+    auto book_index = bible.find_book(reference->book);
+    if (!book_index.has_value()) {
+        lookup.error = "book not found";
+        return true;
+    }
+
+    for (usize i = 0; i < ranges.len; i++) {
+        VerseRange range = ranges.items[i];
+        bool whole_book = verse_position_chapter(range.last) == REFERENCE_END;
+        u16 chapter = verse_position_chapter(range.first);
+        if (!whole_book && !bible.find_chapter(book_index.value(), chapter).has_value()) {
+            lookup.error = "chapter not found";
+            break;
+        }
+
+        // A range running past the end of a chapter stops there
+        RowSpan span = bible.find_verse_span(book_index.value(), range.first, range.last);
+        if (span.is_empty()) {
+            lookup.error = "verse not found";
+            break;
+        }
+
+        if (!spans.append(span)) return false;
+    }
+
+    if (lookup.error) {
+        spans.len = lookup.span_start;
+    } else {
+        lookup.span_count = (u32)(spans.len - lookup.span_start);
+    }
+    return true;
+}
+
+void append_bytes(ArrayList<char>& out, string data, usize len) {
+    memcpy(out.items + out.len, data, len);
+    out.len += len;
+}
+
+void append_number(ArrayList<char>& out, u32 number) {
+    char digits[10];
+    usize count = 0;
+    do {
+        digits[count++] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+
+    while (count > 0) out.items[out.len++] = digits[--count];
+}
+
+// Renders a "Book C:V text" line into `out`.
+bool batch_render_verse(Bible& bible, u32 row, ArrayList<char>& out) {
+    auto book_index = bible.find_book_by_id(bible.verse_books[row]);
+    StringSlice book_name =
+        book_index.has_value() ? bible.book_name(book_index.value()) : StringSlice::from_cstr("?");
+    if (!out.reserve(book_name.len + 24 + bible.verse_text_capacity(row))) return false;
+
+    append_bytes(out, book_name.ptr, book_name.len);
+    out.items[out.len++] = ' ';
+    append_number(out, bible.verse_chapters[row]);
+    out.items[out.len++] = ':';
+    append_number(out, bible.verse_numbers[row]);
+    out.items[out.len++] = ' ';
+
+    bible.verse_text_runs(row, [&](StringSlice run) { append_bytes(out, run.ptr, run.len); });
+    out.items[out.len++] = '\n';
+    process_stats.add_verses(1);
+    return true;
+}
 
-    if (app->verses.len > 0) {
-        auto verse_start = app->verses[0];
-        auto verse_end = app->verses[1];
+// Renders the lookup's verses into `out`.
+bool batch_render(Bible& bible, BatchLookup& lookup, RowSpan* spans, ArrayList<char>& out) {
+    lookup.output_start = out.len;
 
-        if (verse_start.has_value() && verse_end.has_value()) {
-            std::println("Verses: {}..{}", verse_start.value(), verse_end.value());
-        } else if (verse_start.has_value()) {
-            std::println("Verse: {}", verse_start.value());
+    for (u32 i = lookup.span_start; i < lookup.span_start + lookup.span_count; i++) {
+        for (u32 row = spans[i].first; row < spans[i].end; row++) {
+            if (!batch_render_verse(bible, row, out)) return false;
         }
     }
 
+    lookup.output_end = out.len;
     return true;
 }
 
+bool batch_command_handler(CLICommand& command, void* user_data) {
+    auto app = (Application*)user_data;
+
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
+        return false;
+    }
+    app->file_path = file_opt->value.value();
+
+    // Growable buffers live on the heap. A list on the arena grows in place only while it is
+    // the arena's last allocation; output, ranges and spans grow in turn, so all but one would
+    // leave their outgrown copies behind, and stdin may be larger than the arena's cap.
+    Allocator heap = PageAllocator::init();
+
+    // Input: a mapped file, or all of stdin
+    StringSlice input = StringSlice::init("", 0);
+    std::optional<MappedFile> input_file;
+    auto stdin_buffer = ArrayList<char>::init(heap);
+    defer { stdin_buffer.deinit(); };
+    defer {
+        if (input_file.has_value()) input_file->deinit();
+    };
+
+    auto input_opt = command.get_option("input");
+    if (input_opt.has_value() && input_opt->value.has_value() &&
+        !string_equals(input_opt->value.value(), "-")) {
+        input_file = MappedFile::init(input_opt->value.value());
+        if (!input_file.has_value()) {
+            std::println("Error: Could not open '{}'", input_opt->value.value());
+            return false;
+        }
+        input_file->advise_sequential();
+        input = StringSlice::init((string)input_file->data, input_file->size);
+    } else {
+        while (true) {
+            if (!stdin_buffer.reserve(KB(64))) {
+                std::println("Error: Out of memory");
+                return false;
+            }
+
+            usize read = fread(stdin_buffer.items + stdin_buffer.len, 1, KB(64), stdin);
+            stdin_buffer.len += read;
+            if (read == 0) break;
+        }
+        input = StringSlice::init(stdin_buffer.items, stdin_buffer.len);
+    }
+
+    auto loaded = bible_open(app->allocator, app->file_path.value());
+    if (!loaded.has_value()) {
+        std::println(
+            "Error: Could not load '{}': {}",
+            app->file_path.value(),
+            bible_error_message(loaded.error())
+        );
+        return false;
+    }
+
+    Bible bible = loaded.value();
+    defer { bible.deinit(); };
+
+    BatchLookup* lookups = heap.alloc_array<BatchLookup>(BATCH_CHUNK);
+    u32* order = heap.alloc_array<u32>(BATCH_CHUNK);
+    auto output = ArrayList<char>::init(heap);
+    // Reused for every line, so parsing does not allocate once they have grown
+    auto ranges = ArrayList<VerseRange>::init(heap);
+    auto spans = ArrayList<RowSpan>::init(heap);
+    defer {
+        heap.free_array(lookups, BATCH_CHUNK);
+        heap.free_array(order, BATCH_CHUNK);
+        output.deinit();
+        ranges.deinit();
+        spans.deinit();
+    };
+    if (!lookups || !order) {
+        std::println("Error: Out of memory");
+        return false;
+    }
+
+    // The rendered verses are written by reference to `output`
+    Writer out = Writer::init(heap, stdout);
+    Writer err = Writer::init(heap, stderr);
+    defer {
+        out.deinit();
+        err.deinit();
+    };
+
+    usize line_number = 0;
+    usize failed = 0;
+    usize position = 0;
+
+    while (position < input.len) {
+        StatsTimer timer = StatsTimer::init(StatsPhaseLookup);
+        defer { timer.stop(); };
+
+        // Resolve a chunk of references
+        usize count = 0;
+        spans.clear();
+        while (count < BATCH_CHUNK && position < input.len) {
+            string line_start = input.ptr + position;
+            string newline = (string)memchr(line_start, '\n', input.len - position);
+            usize line_len = newline ? (usize)(newline - line_start) : input.len - position;
+            position += line_len + 1;
+            line_number++;
+
+            StringSlice line = StringSlice::init(line_start, line_len).trim();
+            if (line.is_empty()) continue;
+
+            BatchLookup& lookup = lookups[count++];
+            lookup = BatchLookup{
+                .line = line,
+                .line_number = line_number,
+                .span_start = 0,
+                .span_count = 0,
+                .error = nullptr,
+                .output_start = 0,
+                .output_end = 0,
+            };
+            if (!batch_resolve(bible, lookup, ranges, spans)) {
+                std::println("Error: Out of memory");
+                return false;
+            }
+        }
+
+        timer.stop();
+        timer = StatsTimer::init(StatsPhaseOutput);
+
+        // Fetch the verses in file order, so the mapped text is read front to back
+        usize resolved = 0;
+        for (usize i = 0; i < count; i++) {
+            if (!lookups[i].error) order[resolved++] = (u32)i;
+        }
+        std::sort(order, order + resolved, [&](u32 a, u32 b) {
+            return bible.text_offsets[spans.items[lookups[a].span_start].first] <
+                   bible.text_offsets[spans.items[lookups[b].span_start].first];
+        });
+
+        output.clear();
+        for (usize i = 0; i < resolved; i++) {
+            if (!batch_render(bible, lookups[order[i]], spans.items, output)) {
+                out.println("Error: Out of memory");
+                return false;
+            }
+        }
+
+        // Emit in input order
+        for (usize i = 0; i < count; i++) {
+            BatchLookup& lookup = lookups[i];
+            if (lookup.error) {
+                err.println(
+                    "Error: line {}: '{}': {}",
+                    lookup.line_number,
+                    std::string_view(lookup.line.ptr, lookup.line.len),
+                    lookup.error
+                );
+                failed++;
+                continue;
+            }
+
+            usize size = lookup.output_end - lookup.output_start;
+            out.write_ref(StringSlice::init(output.items + lookup.output_start, size));
+        }
+
+        // The next chunk reuses `output`
+        out.flush();
+        err.flush();
+    }
+
+    return failed == 0;
+}
+
+// Answers a forwarded command from the daemon's snapshot, as the local handler would.
+ServeStatus serve_request_handler(
+    ServeSnapshot& snapshot,
+    ServeRequest& request,
+    Allocator& allocator,
+    Writer& out,
+    Writer& err
+) {
+    if (request.kind == ServeReference) {
+        auto ranges = ArrayList<VerseRange>::init(allocator);
+        if (!Reference::parse_ranges(StringSlice::from_cstr(request.fields[2]), ranges)) {
+            return ServeNotServed;
+        }
+
+        bool printed = print_ranges(
+            out,
+            err,
+            snapshot.bible,
+            request.fields[1],
+            StringSlice::from_cstr(request.fields[1]),
+            ranges
+        );
+        return printed ? ServeOk : ServeFailed;
+    }
+
+    // Without an index the client reports why, or builds one itself
+    auto limit = int_from_str<usize>(request.fields[3]);
+    if (!snapshot.search.has_value() || !limit.has_value()) return ServeNotServed;
+
+    bool printed = print_search(
+        out,
+        allocator,
+        snapshot.bible,
+        snapshot.search.value(),
+        StringSlice::from_cstr(request.fields[1]),
+        string_equals(request.fields[2], "1"),
+        limit.value(),
+        string_equals(request.fields[4], "1")
+    );
+    return printed ? ServeOk : ServeFailed;
+}
+
+bool serve_command_handler(CLICommand& command, void* user_data) {
+    auto app = (Application*)user_data;
+
+    auto file_opt = command.get_option("file");
+    if (!file_opt.has_value() || !file_opt->value.has_value()) {
+        std::println("Error: Bible file is required. Use -f or --file to specify.");
+        return false;
+    }
+    app->file_path = file_opt->value.value();
+
+#if SERVE_SUPPORTED
+    // Clients send canonical paths
+    char path[PATH_MAX];
+    if (!realpath(app->file_path.value(), path)) {
+        std::println("Error: Could not open '{}'", app->file_path.value());
+        return false;
+    }
+
+    auto loaded = ServeSnapshot::load(path);
+    if (!loaded.has_value()) {
+        std::println("Error: Could not load '{}': {}", path, bible_error_message(loaded.error()));
+        return false;
+    }
+
+    auto daemon = ServeDaemon::init(path, loaded.value(), &serve_request_handler);
+    if (!daemon.has_value()) {
+        std::println("Error: {}", serve_error_message(daemon.error()));
+        return false;
+    }
+    defer { daemon->deinit(); };
+
+    if (!daemon->current->search.has_value()) {
+        std::println(stderr, "No search index for {}; searches will run locally", path);
+    }
+    std::println("Serving {} on {}", path, daemon->socket_path);
+    fflush(stdout);
+
+    return daemon->run();
+#else
+    std::println("Error: serve is only supported on Linux");
+    return false;
+#endif
+}
+
 int main(int argc, char* argv[]) {
     ArenaAllocator arena = ArenaAllocator::init(PageAllocator::init(), 4096, MB(8));
     Allocator allocator = arena.allocator();
     defer { arena.deinit(); };
+    process_stats.arena = &arena;
 
     CLIParser parser = CLIParser::init(allocator, "Bible Reader");
     defer { parser.deinit(); };
@@ -142,14 +1684,161 @@ int main(int argc, char* argv[]) {
     // TODO: the file should be the first parameter not option. e.g ./bible "path_to_bible_xml"
     // --book...
 
-    CLIOption book_option = CLIOption::init("-b", "--book", "Book name (e.g. John)");
+    CLIOption file_option = CLIOption::init("-f", "--file", "Path to the Bible XML file");
+    CLIOption book_option =
+        CLIOption::init("-b", "--book", "Book name or reference (e.g. John, \"John 3:16-18,20\")");
     CLIOption chapter_option = CLIOption::init("-c", "--chapter", "Chapter number");
-    CLIOption verse_option = CLIOption::init("-v", "--verse", "Verse number or range");
+    CLIOption verse_option =
+        CLIOption::init("-v", "--verse", "Verse number, range or list (e.g. 16-18,20)");
+    CLIOption refs_option =
+        CLIOption::init("-r", "--refs", "Print the N best cross references of each verse");
+    CLIOption depth_option = CLIOption::init(
+        "-d",
+        "--depth",
+        "Follow cross references N steps, breadth-first (default: 1)"
+    );
 
+    main_command.add_option(file_option);
     main_command.add_option(book_option);
     main_command.add_option(chapter_option);
     main_command.add_option(verse_option);
+    main_command.add_option(refs_option);
+    main_command.add_option(depth_option);
 
     parser.set_main_command(main_command);
+
+    CLICommand index_command = CLICommand::init(
+        allocator,
+        "index",
+        "Compile a Bible XML file into a binary index for fast lookups",
+        &index_command_handler,
+        &app
+    );
+
+    CLIOption index_file_option = CLIOption::init("-f", "--file", "Path to the Bible XML file");
+    CLIOption index_output_option =
+        CLIOption::init("-o", "--output", "Index file to write (default: <file>.bidx)");
+
+    CLIOption index_jobs_option =
+        CLIOption::init("-j", "--jobs", "Parser threads (default: one per CPU)");
+    CLIOption index_compress_option = CLIOption::init(
+        "-z",
+        "--compress",
+        "Store verse text dictionary-coded (smaller, decoded on read)",
+        true
+    );
+    CLIOption index_xrefs_option = CLIOption::init(
+        "-x",
+        "--xrefs",
+        "Cross-reference TSV (OpenBible format) to compile into <file>.bxref"
+    );
+
+    index_command.add_option(index_file_option);
+    index_command.add_option(index_output_option);
+    index_command.add_option(index_jobs_option);
+    index_command.add_option(index_compress_option);
+    index_command.add_option(index_xrefs_option);
+
+    parser.add_command(index_command);
+
+    CLICommand search_command = CLICommand::init(
+        allocator,
+        "search",
+        "Find verses containing all the given words",
+        &search_command_handler,
+        &app
+    );
+
+    CLIOption search_file_option = CLIOption::init("-f", "--file", "Path to the Bible XML file");
+    CLIOption search_query_option = CLIOption::init("-q", "--query", "Words to search for");
+    CLIOption search_limit_option =
+        CLIOption::init("-l", "--limit", "Maximum number of verses to print");
+    CLIOption search_phrase_option =
+        CLIOption::init("-p", "--phrase", "Match the words as an exact phrase", true);
+
+    search_command.add_option(search_file_option);
+    search_command.add_option(search_query_option);
+    search_command.add_option(search_limit_option);
+    search_command.add_option(search_phrase_option);
+
+    parser.add_command(search_command);
+
+    CLICommand grep_command = CLICommand::init(
+        allocator,
+        "grep",
+        "Find verses containing a literal text, without an index",
+        &grep_command_handler,
+        &app
+    );
+
+    CLIOption grep_file_option = CLIOption::init("-f", "--file", "Path to the Bible XML file");
+    CLIOption grep_text_option =
+        CLIOption::init("-t", "--text", "Text to find (exact bytes, case-sensitive)");
+    CLIOption grep_limit_option =
+        CLIOption::init("-l", "--limit", "Maximum number of verses to print");
+    CLIOption grep_jobs_option =
+        CLIOption::init("-j", "--jobs", "Scanner threads (default: one per CPU)");
+
+    grep_command.add_option(grep_file_option);
+    grep_command.add_option(grep_text_option);
+    grep_command.add_option(grep_limit_option);
+    grep_command.add_option(grep_jobs_option);
+
+    parser.add_command(grep_command);
+
+    CLICommand concordance_command = CLICommand::init(
+        allocator,
+        "concordance",
+        "Word, bigram and trigram frequencies, and verse and chapter lengths",
+        &concordance_command_handler,
+        &app
+    );
+
+    CLIOption concordance_file_option =
+        CLIOption::init("-f", "--file", "Path to the Bible XML file");
+    CLIOption concordance_book_option =
+        CLIOption::init("-b", "--book", "Show the word list of one book");
+    CLIOption concordance_limit_option =
+        CLIOption::init("-l", "--limit", "Entries per list (default: 20)");
+    CLIOption concordance_jobs_option =
+        CLIOption::init("-j", "--jobs", "Counter threads (default: one per CPU)");
+
+    concordance_command.add_option(concordance_file_option);
+    concordance_command.add_option(concordance_book_option);
+    concordance_command.add_option(concordance_limit_option);
+    concordance_command.add_option(concordance_jobs_option);
+
+    parser.add_command(concordance_command);
+
+    CLICommand batch_command = CLICommand::init(
+        allocator,
+        "batch",
+        "Print many references, one per line, e.g. \"John 3:16-18\"",
+        &batch_command_handler,
+        &app
+    );
+
+    CLIOption batch_file_option = CLIOption::init("-f", "--file", "Path to the Bible XML file");
+    CLIOption batch_input_option =
+        CLIOption::init("-i", "--input", "File with one reference per line (default: stdin)");
+
+    batch_command.add_option(batch_file_option);
+    batch_command.add_option(batch_input_option);
+
+    parser.add_command(batch_command);
+
+    CLICommand serve_command = CLICommand::init(
+        allocator,
+        "serve",
+        "Keep a Bible loaded and answer other bible commands over a local socket",
+        &serve_command_handler,
+        &app
+    );
+
+    CLIOption serve_file_option = CLIOption::init("-f", "--file", "Path to the Bible XML file");
+
+    serve_command.add_option(serve_file_option);
+
+    parser.add_command(serve_command);
     return parser.parse_and_execute(argc, argv);
 }
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "def.h"
+#include "simd.h"
+#include "string.h"
+#include <cstring>
+
+// Case and diacritic folding
+//
+// Makes "SENHOR", "Senhor" and "senhor", or "Jesús" and "Jesus", compare equal: ASCII letters
+// are lowercased, and the letters of Latin-1 Supplement and Latin Extended-A (U+00C0..U+017F)
+// become their lowercase base letters, or two letters for ligatures and "ß". Everything else is
+// copied as is. No fold is longer than its input, so the output never needs more bytes than the
+// text; callers hand in that buffer, usually from an arena.
+//
+// Verse text is mostly ASCII, so the SSE2 path lowercases 16 bytes per step and only looks a
+// code point up in the table when a block has a byte above 0x7F.
+
+// Base letters for U+00C0..U+017F, indexed by (UTF-8 lead byte - 0xC3) << 6 | continuation byte
+// & 0x3F. nullptr marks the multiplication and division signs, which are not letters.
+constexpr string NORMALIZE_FOLD[192] = {
+    // Latin-1 Supplement, C3 80..C3 BF
+    "a", "a", "a", "a", "a", "a", "ae", "c", // À Á Â Ã Ä Å Æ Ç
+    "e", "e", "e", "e", "i", "i", "i", "i", // È É Ê Ë Ì Í Î Ï
+    "d", "n", "o", "o", "o", "o", "o", nullptr, // Ð Ñ Ò Ó Ô Õ Ö ×
+    "o", "u", "u", "u", "u", "y", "th", "ss", // Ø Ù Ú Û Ü Ý Þ ß
+    "a", "a", "a", "a", "a", "a", "ae", "c", // à á â ã ä å æ ç
+    "e", "e", "e", "e", "i", "i", "i", "i", // è é ê ë ì í î ï
+    "d", "n", "o", "o", "o", "o", "o", nullptr, // ð ñ ò ó ô õ ö ÷
+    "o", "u", "u", "u", "u", "y", "th", "y", // ø ù ú û ü ý þ ÿ
+    // Latin Extended-A, C4 80..C5 BF
+    "a", "a", "a", "a", "a", "a", "c", "c", // Ā ā Ă ă Ą ą Ć ć
+    "c", "c", "c", "c", "c", "c", "d", "d", // Ĉ ĉ Ċ ċ Č č Ď ď
+    "d", "d", "e", "e", "e", "e", "e", "e", // Đ đ Ē ē Ĕ ĕ Ė ė
+    "e", "e", "e", "e", "g", "g", "g", "g", // Ę ę Ě ě Ĝ ĝ Ğ ğ
+    "g", "g", "g", "g", "h", "h", "h", "h", // Ġ ġ Ģ ģ Ĥ ĥ Ħ ħ
+    "i", "i", "i", "i", "i", "i", "i", "i", // Ĩ ĩ Ī ī Ĭ ĭ Į į
+    "i", "i", "ij", "ij", "j", "j", "k", "k", // İ ı Ĳ ĳ Ĵ ĵ Ķ ķ
+    "k", "l", "l", "l", "l", "l", "l", "l", // ĸ Ĺ ĺ Ļ ļ Ľ ľ Ŀ
+    "l", "l", "l", "n", "n", "n", "n", "n", // ŀ Ł ł Ń ń Ņ ņ Ň
+    "n", "n", "n", "n", "o", "o", "o", "o", // ň ŉ Ŋ ŋ Ō ō Ŏ ŏ
+    "o", "o", "oe", "oe", "r", "r", "r", "r", // Ő ő Œ œ Ŕ ŕ Ŗ ŗ
+    "r", "r", "s", "s", "s", "s", "s", "s", // Ř ř Ś ś Ŝ ŝ Ş ş
+    "s", "s", "t", "t", "t", "t", "t", "t", // Š š Ţ ţ Ť ť Ŧ ŧ
+    "u", "u", "u", "u", "u", "u", "u", "u", // Ũ ũ Ū ū Ŭ ŭ Ů ů
+    "u", "u", "u", "u", "w", "w", "y", "y", // Ű ű Ų ų Ŵ ŵ Ŷ ŷ
+    "y", "z", "z", "z", "z", "z", "z", "s", // Ÿ Ź ź Ż ż Ž ž ſ
+};
+
+// Folds the character at text[i], advancing `i` and `o`. A character is never split: when its
+// fold does not fit in `out_size`, nothing is written and false is returned.
+inline bool
+normalize_fold_char(string text, usize len, usize& i, mut_string out, usize out_size, usize& o) {
+    u8 c = (u8)text[i];
+    if (c < 0x80) {
+        if (o == out_size) return false;
+        out[o++] = (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : (char)c;
+        i++;
+        return true;
+    }
+
+    if (c >= 0xC3 && c <= 0xC5 && i + 1 < len && ((u8)text[i + 1] & 0xC0) == 0x80) {
+        string folded = NORMALIZE_FOLD[(usize)(c - 0xC3) << 6 | ((u8)text[i + 1] & 0x3F)];
+        if (folded) {
+            usize folded_len = folded[1] ? 2 : 1;
+            if (out_size - o < folded_len) return false;
+
+            for (; *folded; folded++) out[o++] = *folded;
+            i += 2;
+            return true;
+        }
+    }
+
+    // Any other sequence is copied whole; stray continuation bytes one at a time
+    usize sequence = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    if (sequence > len - i) sequence = len - i;
+    if (out_size - o < sequence) return false;
+
+    memcpy(out + o, text + i, sequence);
+    i += sequence;
+    o += sequence;
+    return true;
+}
+
+inline usize normalize_fold_scalar(StringSlice text, mut_string out, usize out_size) {
+    usize i = 0;
+    usize o = 0;
+    while (i < text.len) {
+        if (!normalize_fold_char(text.ptr, text.len, i, out, out_size, o)) break;
+    }
+
+    return o;
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE2 inline usize
+normalize_fold_sse2(StringSlice text, mut_string out, usize out_size) {
+    __m128i before_a = _mm_set1_epi8('A' - 1);
+    __m128i after_z = _mm_set1_epi8('Z' + 1);
+    __m128i case_bit = _mm_set1_epi8(0x20);
+
+    usize i = 0;
+    usize o = 0;
+    while (i + 16 <= text.len && o + 16 <= out_size) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text.ptr + i));
+
+        // Bytes above 0x7F are negative, so they never compare as upper case
+        __m128i upper =
+            _mm_and_si128(_mm_cmpgt_epi8(block, before_a), _mm_cmplt_epi8(block, after_z));
+        _mm_storeu_si128((__m128i*)(out + o), _mm_or_si128(block, _mm_and_si128(upper, case_bit)));
+
+        u32 non_ascii = (u32)_mm_movemask_epi8(block);
+        if (non_ascii == 0) {
+            i += 16;
+            o += 16;
+            continue;
+        }
+
+        // Keep the ASCII prefix, then fold the character that ended it on its own
+        u32 prefix = simd_ctz64(non_ascii);
+        i += prefix;
+        o += prefix;
+        if (!normalize_fold_char(text.ptr, text.len, i, out, out_size, o)) return o;
+    }
+
+    while (i < text.len) {
+        if (!normalize_fold_char(text.ptr, text.len, i, out, out_size, o)) break;
+    }
+
+    return o;
+}
+#endif
+
+/// @brief Folds `text` into `out`, which holds `out_size` bytes; `text.len` bytes are always
+/// enough. Stops early, at a character boundary, when `out` is smaller.
+/// @return The folded length.
+inline usize normalize_fold(StringSlice text, mut_string out, usize out_size) {
+#if SIMD_X86
+    if (simd_level() >= SimdSse2) return normalize_fold_sse2(text, out, out_size);
+#endif
+
+    return normalize_fold_scalar(text, out, out_size);
+}
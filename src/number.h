@@ -64,3 +64,24 @@ template <FloatType T> inline std::optional<T> float_from_str(string str) {
 
     return static_cast<T>(num);
 }
+
+/// @brief Converts a run of ASCII digits to an unsigned integer.
+/// @tparam T The unsigned integer type to convert to.
+/// @param str Pointer to the first digit. The string does not have to be NUL-terminated.
+/// @param len Number of bytes to convert.
+/// @return The converted integer, or std::nullopt if the run is empty, has a non-digit, or
+/// overflows `T`.
+template <IntegerType T> inline std::optional<T> uint_from_digits(string str, usize len) {
+    if (!str || len == 0) return std::nullopt;
+
+    u64 num = 0;
+    for (usize i = 0; i < len; i++) {
+        char c = str[i];
+        if (c < '0' || c > '9') return std::nullopt;
+
+        num = num * 10 + (u64)(c - '0');
+        if (num > (u64)std::numeric_limits<T>::max()) return std::nullopt;
+    }
+
+    return (T)num;
+}
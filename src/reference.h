@@ -0,0 +1,223 @@
+#pragma once
+
+#include "array.h"
+#include "def.h"
+#include "string.h"
+#include <algorithm>
+#include <optional>
+
+// Reference grammar
+//
+//   reference := book [spec]
+//   spec      := group (';' group)*
+//   group     := item (',' item)*
+//   item      := position ['-' position]
+//   position  := number [':' number]
+//
+// A bare number is a chapter at the start of a group and after a chapter item, and a verse of
+// the current chapter after a verse item: "John 3:16-18,20; 4,6" is 3:16-18, 3:20, and chapters
+// 4 and 6. A range may cross chapters ("Gen 1:1-2:3"), and a reference without a spec is the
+// whole book.
+
+/// @brief A chapter and verse packed as chapter << 16 | verse, so that positions compare in
+/// reading order.
+using VersePosition = u32;
+
+// Chapter or verse number meaning "up to the end": of the chapter for a verse, of the book for
+// a chapter
+constexpr u16 REFERENCE_END = 0xFFFF;
+
+constexpr VersePosition verse_position(u16 chapter, u16 verse) {
+    return (VersePosition)chapter << 16 | verse;
+}
+
+constexpr u16 verse_position_chapter(VersePosition position) { return (u16)(position >> 16); }
+constexpr u16 verse_position_verse(VersePosition position) { return (u16)(position & 0xFFFF); }
+
+/// @brief Verses `first` to `last`, inclusive.
+struct VerseRange {
+    VersePosition first;
+    VersePosition last;
+
+    bool within_chapter() {
+        u16 chapter = verse_position_chapter(first);
+        return chapter != REFERENCE_END && chapter == verse_position_chapter(last);
+    }
+};
+
+struct Reference {
+    StringSlice book;
+    // The chapters and verses after the book, e.g. "3:16-18,20". Empty for the whole book.
+    StringSlice spec;
+
+    /// @brief Splits `<book> [spec]` and parses the spec into `ranges`. The space before the
+    /// spec is optional ("Jn3:16"), and the book may start with a digit ("1 Cor 13:4-7").
+    static std::optional<Reference> parse(StringSlice text, ArrayList<VerseRange>& ranges) {
+        text = text.trim();
+
+        // The spec is the trailing run of digits and separators
+        usize spec_start = text.len;
+        while (spec_start > 0 && is_spec_char(text.ptr[spec_start - 1])) spec_start--;
+
+        // It starts with a digit, not with a separator
+        while (spec_start < text.len && !is_digit(text.ptr[spec_start])) spec_start++;
+
+        Reference reference = Reference{
+            .book = text.sub(0, spec_start).trim(),
+            .spec = text.sub(spec_start),
+        };
+        if (reference.book.is_empty() || !parse_ranges(reference.spec, ranges)) {
+            return std::nullopt;
+        }
+
+        return reference;
+    }
+
+    /// @brief Parses a chapter and verse spec such as "3:16-18,20; 4:1-3" in one pass, without
+    /// allocating beyond `ranges`. An empty spec is the whole book.
+    ///
+    /// `ranges` is cleared, then receives the ranges sorted and merged: none overlap or touch.
+    /// @return False on a syntax error, a zero chapter or verse, or a range that runs backwards.
+    static bool parse_ranges(StringSlice spec, ArrayList<VerseRange>& ranges) {
+        ranges.clear();
+
+        usize i = 0;
+        skip_spaces(spec, i);
+        if (i == spec.len) {
+            VerseRange book = VerseRange{
+                .first = verse_position(1, 1),
+                .last = verse_position(REFERENCE_END, REFERENCE_END),
+            };
+            return ranges.append(book);
+        }
+
+        u16 chapter = 0;
+        // Whether a bare number is a verse of `chapter`
+        bool verse_context = false;
+
+        while (true) {
+            u16 number;
+            if (!read_number(spec, i, number)) return false;
+
+            VersePosition first;
+            VersePosition last;
+            bool has_verse = true;
+
+            if (i < spec.len && spec.ptr[i] == ':') {
+                i++;
+                u16 verse;
+                if (!read_number(spec, i, verse)) return false;
+
+                chapter = number;
+                first = verse_position(chapter, verse);
+            } else if (verse_context) {
+                first = verse_position(chapter, number);
+            } else {
+                chapter = number;
+                first = verse_position(chapter, 1);
+                has_verse = false;
+            }
+            last = has_verse ? first : verse_position(chapter, REFERENCE_END);
+
+            if (i < spec.len && spec.ptr[i] == '-') {
+                i++;
+                if (!read_number(spec, i, number)) return false;
+
+                if (i < spec.len && spec.ptr[i] == ':') {
+                    i++;
+                    u16 verse;
+                    if (!read_number(spec, i, verse)) return false;
+
+                    chapter = number;
+                    last = verse_position(chapter, verse);
+                    has_verse = true;
+                } else if (has_verse) {
+                    last = verse_position(chapter, number);
+                } else {
+                    chapter = number;
+                    last = verse_position(chapter, REFERENCE_END);
+                }
+            }
+
+            if (last < first) return false;
+            if (!ranges.append(VerseRange{.first = first, .last = last})) return false;
+            verse_context = has_verse;
+
+            if (i == spec.len) break;
+
+            char separator = spec.ptr[i++];
+            if (separator == ';') {
+                verse_context = false;
+            } else if (separator != ',') {
+                return false;
+            }
+        }
+
+        merge(ranges);
+        return true;
+    }
+
+  private:
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+    static bool is_spec_char(char c) {
+        return is_digit(c) || c == ':' || c == '-' || c == ',' || c == ';' || c == ' ' ||
+               c == '\t';
+    }
+
+    static void skip_spaces(StringSlice spec, usize& i) {
+        while (i < spec.len && (spec.ptr[i] == ' ' || spec.ptr[i] == '\t')) i++;
+    }
+
+    // Reads a chapter or verse number and the spaces around it
+    static bool read_number(StringSlice spec, usize& i, u16& number) {
+        skip_spaces(spec, i);
+
+        u32 value = 0;
+        usize start = i;
+        while (i < spec.len && is_digit(spec.ptr[i]) && value < REFERENCE_END) {
+            value = value * 10 + (u32)(spec.ptr[i++] - '0');
+        }
+        if (i == start || value == 0 || value >= REFERENCE_END) return false;
+
+        skip_spaces(spec, i);
+        number = (u16)value;
+        return true;
+    }
+
+    // The position right after `position`: the next verse, or the start of the next chapter
+    // after an end-of-chapter position
+    static VersePosition next_position(VersePosition position) {
+        u16 chapter = verse_position_chapter(position);
+        if (verse_position_verse(position) != REFERENCE_END) return position + 1;
+        if (chapter == REFERENCE_END) return position;
+
+        return verse_position(chapter + 1, 1);
+    }
+
+    static void merge(ArrayList<VerseRange>& ranges) {
+        // References list their parts in order, so this is usually already sorted
+        bool sorted = true;
+        for (usize i = 1; i < ranges.len && sorted; i++) {
+            sorted = ranges.items[i - 1].first <= ranges.items[i].first;
+        }
+        if (!sorted) {
+            std::sort(ranges.items, ranges.items + ranges.len, [](VerseRange a, VerseRange b) {
+                return a.first < b.first;
+            });
+        }
+
+        usize count = 0;
+        for (usize i = 0; i < ranges.len; i++) {
+            VerseRange range = ranges.items[i];
+            if (count > 0 && range.first <= next_position(ranges.items[count - 1].last)) {
+                VerseRange& previous = ranges.items[count - 1];
+                if (range.last > previous.last) previous.last = range.last;
+                continue;
+            }
+
+            ranges.items[count++] = range;
+        }
+        ranges.len = count;
+    }
+};
@@ -0,0 +1,746 @@
+#pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "bible.h"
+#include "def.h"
+#include "file.h"
+#include "hash_map.h"
+#include "normalize.h"
+#include "string.h"
+#include "trace.h"
+#include "xml.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <optional>
+
+// Positional inverted search index (.bsx)
+//
+// Maps every normalized word to the verses it occurs in and, within each verse, to every
+// occurrence: its word ordinal (for phrase matching) and its byte span in the verse's plain text
+// (for highlighting). Everything is delta-encoded as LEB128 varints, and the whole file is
+// mmap'd and queried in place.
+//
+//   SearchIndexHeader
+//   SearchTerm[term_count]   sorted by word bytes, for binary search
+//   strings blob             the words, referenced by SearchTerm
+//   postings blob            per term, one block per verse:
+//                              varint(row - previous row)
+//                              varint(occurrence count)
+//                              varint(byte size of the occurrences), so blocks can be skipped
+//                              per occurrence:
+//                                varint(ordinal - previous ordinal)
+//                                varint(start - end of previous occurrence)
+//                                varint(length)
+
+constexpr char SEARCH_INDEX_MAGIC[4] = {'B', 'S', 'R', 'C'};
+constexpr u32 SEARCH_INDEX_VERSION = 3;
+constexpr string SEARCH_INDEX_EXTENSION = ".bsx";
+
+// Words longer than this are truncated before indexing and querying
+constexpr usize SEARCH_MAX_WORD = 64;
+constexpr usize SEARCH_MAX_QUERY_WORDS = 16;
+// Occurrences of one word in one verse considered by a query; the rest are ignored
+constexpr usize SEARCH_MAX_POSITIONS = 128;
+
+struct SearchIndexHeader {
+    char magic[4];
+    u32 version;
+    // Size and modification time of the Bible file the index was built from
+    u64 source_size;
+    i64 source_modified_time;
+
+    u32 verse_count;
+    u32 term_count;
+
+    u64 terms_offset;
+    u64 strings_offset;
+    u64 strings_size;
+    u64 postings_offset;
+    u64 postings_size;
+};
+
+struct SearchTerm {
+    u32 string_offset;
+    u32 string_length;
+    // Number of verses containing the word
+    u32 verse_count;
+    u32 postings_size;
+    u64 postings_offset;
+};
+
+// One occurrence of a word in a verse
+struct SearchPosition {
+    // Index of the word within the verse
+    u32 ordinal;
+    // Byte span in the verse's plain text
+    u32 start;
+    u32 length;
+};
+
+// A highlighted span of a matching verse. A verse with several matches yields several hits,
+// ordered by `start`.
+struct SearchHit {
+    u32 row;
+    u32 start;
+    u32 end;
+};
+
+/// @brief Appends `value` as a LEB128 varint.
+/// @return Number of bytes written (1 to 5).
+inline usize varint_encode(u32 value, u8* out) {
+    usize len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (u8)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (u8)value;
+
+    return len;
+}
+
+/// @brief Reads one LEB128 varint and advances `cursor` past it.
+/// @return Nothing when the varint runs into `end` or is longer than five bytes, as it is only
+/// in a damaged index.
+inline std::optional<u32> varint_decode(const u8*& cursor, const u8* end) {
+    u32 value = 0;
+
+    for (u32 shift = 0; shift < 32; shift += 7) {
+        if (cursor >= end) return std::nullopt;
+
+        u8 byte = *cursor++;
+        value |= (u32)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+
+    return std::nullopt;
+}
+
+/// @brief Splits text into words. A word is a run of ASCII letters and digits or non-ASCII
+/// UTF-8 letters; ASCII punctuation and common UTF-8 punctuation (curly quotes, dashes,
+/// guillemets, inverted marks) separate words.
+struct WordIterator {
+    StringSlice text;
+    usize pos;
+
+    static WordIterator init(StringSlice text) {
+        return WordIterator{
+            .text = text,
+            .pos = 0,
+        };
+    }
+
+    std::optional<StringSlice> next() {
+        while (pos < text.len && separator_length(pos) > 0) pos += separator_length(pos);
+        if (pos >= text.len) return std::nullopt;
+
+        usize start = pos;
+        while (pos < text.len && separator_length(pos) == 0) pos++;
+
+        return StringSlice::init(text.ptr + start, pos - start);
+    }
+
+  private:
+    // Length of the separator starting at `at`, or 0 if the byte belongs to a word
+    usize separator_length(usize at) {
+        u8 c = (u8)text.ptr[at];
+
+        if (c < 0x80) {
+            bool word = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            return word ? 0 : 1;
+        }
+
+        u8 next = at + 1 < text.len ? (u8)text.ptr[at + 1] : 0;
+
+        // U+00A0..U+00BF: no-break space, ¡, «, », ¿ and other Latin-1 punctuation
+        if (c == 0xC2 && next >= 0xA0 && next <= 0xBF) return 2;
+
+        // U+2000..U+206F: general punctuation (dashes, curly quotes, ellipsis)
+        if (c == 0xE2 && (next == 0x80 || next == 0x81) && at + 2 < text.len) return 3;
+
+        return 0;
+    }
+};
+
+/// @brief Normalizes a word for indexing and querying: case and accents are folded (see
+/// normalize.h), and the result is cut at SEARCH_MAX_WORD bytes.
+/// @param out Buffer of at least SEARCH_MAX_WORD bytes.
+/// @return The normalized length.
+inline usize search_normalize(StringSlice word, mut_string out) {
+    return normalize_fold(word, out, SEARCH_MAX_WORD);
+}
+
+/// @brief Walks one word's posting list a verse at a time. Occurrence data is only decoded on
+/// request, and skipping a verse is a pointer bump. A damaged list ends early: the cursor is
+/// done at the first block that runs past the list or names a row past `row_count`.
+struct PostingCursor {
+    const u8* cursor;
+    const u8* end;
+    u32 row_count;
+    bool done;
+
+    // Current verse
+    u32 row;
+    u32 count;
+    const u8* positions;
+    const u8* positions_end;
+
+    static PostingCursor init(const u8* postings, usize size, u32 row_count) {
+        PostingCursor posting = PostingCursor{
+            .cursor = postings,
+            .end = postings + size,
+            .row_count = row_count,
+            .done = false,
+            .row = 0,
+            .count = 0,
+            .positions = nullptr,
+            .positions_end = nullptr,
+        };
+        posting.advance();
+        return posting;
+    }
+
+    /// @brief Moves to the next verse.
+    /// @return False when the list is exhausted.
+    bool advance() {
+        if (done || cursor >= end) {
+            done = true;
+            return false;
+        }
+
+        auto delta = varint_decode(cursor, end);
+        auto occurrences = varint_decode(cursor, end);
+        auto size = varint_decode(cursor, end);
+        if (!delta.has_value() || !occurrences.has_value() || !size.has_value() ||
+            size.value() > (usize)(end - cursor) || delta.value() >= row_count - row) {
+            done = true;
+            return false;
+        }
+
+        row += delta.value();
+        count = occurrences.value();
+        positions = cursor;
+        positions_end = cursor + size.value();
+        cursor = positions_end;
+        return true;
+    }
+
+    /// @brief Moves to the first verse at or after `target`.
+    /// @return False when the list is exhausted.
+    bool seek(u32 target) {
+        while (!done && row < target) advance();
+        return !done;
+    }
+
+    /// @brief Decodes up to `capacity` occurrences of the current verse.
+    usize decode_positions(SearchPosition* out, usize capacity) {
+        const u8* at = positions;
+        usize decoded = count < capacity ? count : capacity;
+        u32 ordinal = 0;
+        u32 previous_end = 0;
+
+        for (usize i = 0; i < decoded; i++) {
+            auto ordinal_delta = varint_decode(at, positions_end);
+            auto start_delta = varint_decode(at, positions_end);
+            auto length = varint_decode(at, positions_end);
+            if (!ordinal_delta.has_value() || !start_delta.has_value() || !length.has_value()) {
+                return i;
+            }
+
+            ordinal += ordinal_delta.value();
+            u32 start = previous_end + start_delta.value();
+            out[i] = SearchPosition{.ordinal = ordinal, .start = start, .length = length.value()};
+            previous_end = start + length.value();
+        }
+
+        return decoded;
+    }
+};
+
+struct SearchIndex {
+    MappedFile file;
+    SearchIndexHeader* header;
+    SearchTerm* terms;
+    string strings;
+    const u8* postings;
+
+    /// @brief Writes `<source_path>.bsx` into `out`.
+    /// @return False if the buffer is too small.
+    static bool path_for(string source_path, mut_string out, usize out_size) {
+        i32 written = snprintf(out, out_size, "%s%s", source_path, SEARCH_INDEX_EXTENSION);
+        return written > 0 && (usize)written < out_size;
+    }
+
+    /// @brief Builds the inverted index for `bible` and writes it to `path`.
+    ///
+    /// The text is tokenized twice: the first pass counts how many verses each word occurs in,
+    /// which sizes one flat posting array; the second pass fills it. This avoids a growable list
+    /// per word.
+    /// @param source Size and modification time of the Bible file, for staleness checks.
+    static std::optional<BibleError> build(Bible& bible, FileInfo source, string path) {
+        trace_scope("search index build");
+
+        ArenaAllocator arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+        Allocator allocator = arena.allocator();
+        defer { arena.deinit(); };
+
+        usize max_text = 0;
+        for (usize row = 0; row < bible.verse_count; row++) {
+            usize len = bible.verse_text_capacity(row);
+            if (len > max_text) max_text = len;
+        }
+
+        char* scratch = allocator.alloc_array<char>(max_text + 1);
+        if (!scratch) return BibleOutOfMemory;
+
+        // Pass 1: distinct words, their verse and occurrence counts
+        auto words = StringMap<TermBuild>::init(allocator, 16384);
+        if (!words.entries) return BibleOutOfMemory;
+
+        usize max_words_per_verse = 0;
+        for (usize row = 0; row < bible.verse_count; row++) {
+            StringSlice text = bible.verse_plain_text(row, scratch);
+            auto it = WordIterator::init(text);
+            usize word_count = 0;
+
+            while (auto word = it.next()) {
+                char normalized[SEARCH_MAX_WORD];
+                usize len = search_normalize(word.value(), normalized);
+
+                TermBuild initial = TermBuild{
+                    .verse_count = 0,
+                    .occurrence_count = 0,
+                    .last_row = U32_NONE,
+                    .fill = 0,
+                };
+                TermBuild* term = words.get_or_insert(StringSlice::init(normalized, len), initial);
+                if (!term) return BibleOutOfMemory;
+
+                term->occurrence_count++;
+                if (term->last_row != (u32)row) {
+                    term->last_row = (u32)row;
+                    term->verse_count++;
+                }
+                word_count++;
+            }
+
+            if (word_count > max_words_per_verse) max_words_per_verse = word_count;
+        }
+
+        // Lay the occurrence lists out back to back and sort the words
+        SearchTermBuild* sorted = allocator.alloc_array<SearchTermBuild>(words.len);
+        if (!sorted && words.len > 0) return BibleOutOfMemory;
+
+        usize term_count = 0;
+        usize total_verses = 0;
+        usize total_occurrences = 0;
+        for (usize i = 0; i < words.capacity; i++) {
+            if (!words.entries[i].used) continue;
+
+            TermBuild& term = words.entries[i].value;
+            term.fill = (u32)total_occurrences;
+            total_verses += term.verse_count;
+            total_occurrences += term.occurrence_count;
+
+            sorted[term_count++] = SearchTermBuild{.word = words.entries[i].key, .term = &term};
+        }
+
+        std::sort(sorted, sorted + term_count, [](SearchTermBuild& a, SearchTermBuild& b) {
+            return compare_words(a.word, b.word) < 0;
+        });
+
+        // Pass 2: fill the flat occurrence array. Rows are visited in order, so every list
+        // comes out sorted by row and ordinal.
+        usize occurrences_capacity = total_occurrences > 0 ? total_occurrences : 1;
+        Occurrence* occurrences = allocator.alloc_array<Occurrence>(occurrences_capacity);
+        if (!occurrences) return BibleOutOfMemory;
+
+        for (usize row = 0; row < bible.verse_count; row++) {
+            StringSlice text = bible.verse_plain_text(row, scratch);
+            auto it = WordIterator::init(text);
+            u32 ordinal = 0;
+
+            while (auto word = it.next()) {
+                char normalized[SEARCH_MAX_WORD];
+                usize len = search_normalize(word.value(), normalized);
+
+                TermBuild* term = words.get(StringSlice::init(normalized, len));
+                occurrences[term->fill++] = Occurrence{
+                    .row = (u32)row,
+                    .position = SearchPosition{
+                        .ordinal = ordinal++,
+                        .start = (u32)(word->ptr - text.ptr),
+                        .length = (u32)word->len,
+                    },
+                };
+            }
+        }
+
+        // Encode. A varint is at most 5 bytes: 3 per verse header and 3 per occurrence.
+        SearchTerm* terms = allocator.alloc_array<SearchTerm>(term_count > 0 ? term_count : 1);
+        u8* postings = allocator.alloc_array<u8>((total_verses + total_occurrences) * 15 + 1);
+        u8* block = allocator.alloc_array<u8>(max_words_per_verse * 15 + 1);
+        if (!terms || !postings || !block) return BibleOutOfMemory;
+
+        usize strings_size = 0;
+        usize postings_size = 0;
+        for (usize i = 0; i < term_count; i++) {
+            TermBuild& term = *sorted[i].term;
+            Occurrence* list = occurrences + term.fill - term.occurrence_count;
+
+            usize list_start = postings_size;
+            u32 previous_row = 0;
+            usize j = 0;
+            while (j < term.occurrence_count) {
+                u32 row = list[j].row;
+
+                // Occurrences are encoded first so the block size can precede them
+                usize block_size = 0;
+                u32 count = 0;
+                u32 previous_ordinal = 0;
+                u32 previous_end = 0;
+                for (; j < term.occurrence_count && list[j].row == row; j++) {
+                    SearchPosition& position = list[j].position;
+                    u8* out = block + block_size;
+                    out += varint_encode(position.ordinal - previous_ordinal, out);
+                    out += varint_encode(position.start - previous_end, out);
+                    out += varint_encode(position.length, out);
+                    block_size = (usize)(out - block);
+                    previous_ordinal = position.ordinal;
+                    previous_end = position.start + position.length;
+                    count++;
+                }
+
+                postings_size += varint_encode(row - previous_row, postings + postings_size);
+                postings_size += varint_encode(count, postings + postings_size);
+                postings_size += varint_encode((u32)block_size, postings + postings_size);
+                memcpy(postings + postings_size, block, block_size);
+                postings_size += block_size;
+                previous_row = row;
+            }
+
+            terms[i] = SearchTerm{
+                .string_offset = (u32)strings_size,
+                .string_length = (u32)sorted[i].word.len,
+                .verse_count = term.verse_count,
+                .postings_size = (u32)(postings_size - list_start),
+                .postings_offset = list_start,
+            };
+            strings_size += sorted[i].word.len;
+        }
+
+        SearchIndexHeader header = {};
+        memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+        header.version = SEARCH_INDEX_VERSION;
+        header.source_size = source.size;
+        header.source_modified_time = source.modified_time;
+        header.verse_count = (u32)bible.verse_count;
+        header.term_count = (u32)term_count;
+        header.terms_offset = file_align(sizeof(SearchIndexHeader));
+        header.strings_offset = file_align(header.terms_offset + sizeof(SearchTerm) * term_count);
+        header.strings_size = strings_size;
+        header.postings_offset = file_align(header.strings_offset + strings_size);
+        header.postings_size = postings_size;
+
+        auto opened = AtomicFileWriter::init(path);
+        if (!opened.has_value()) return BibleWriteFailed;
+
+        AtomicFileWriter& writer = opened.value();
+        writer.write_section(0, &header, sizeof(header));
+        writer.write_section(header.terms_offset, terms, sizeof(SearchTerm) * term_count);
+        writer.pad_to(header.strings_offset);
+        for (usize i = 0; i < term_count; i++) writer.write(sorted[i].word.ptr, sorted[i].word.len);
+        writer.write_section(header.postings_offset, postings, postings_size);
+
+        if (!writer.commit()) return BibleWriteFailed;
+
+        return std::nullopt;
+    }
+
+    /// @brief Maps a search index.
+    /// @param verse_count Verses of the Bible the index is for. An index of another size is
+    /// rejected as stale, as its rows would not be that Bible's.
+    /// @param source When set, the index is rejected as stale unless it was built from a file
+    /// with this size and modification time.
+    static std::expected<SearchIndex, BibleError>
+    load(string path, usize verse_count, std::optional<FileInfo> source = std::nullopt) {
+        auto file = MappedFile::init(path);
+        if (!file.has_value()) return std::unexpected(BibleFileNotFound);
+
+        auto index = from_mapping(file.value(), verse_count, source);
+        if (!index.has_value()) file->deinit();
+
+        return index;
+    }
+
+    void deinit() { file.deinit(); }
+
+    /// @brief Binary-searches the term table for an already normalized word.
+    std::optional<usize> find_term(StringSlice word) {
+        usize low = 0;
+        usize high = header->term_count;
+
+        while (low < high) {
+            usize mid = low + (high - low) / 2;
+            i32 order = compare_words(term_word(mid), word);
+
+            if (order == 0) return mid;
+            if (order < 0) low = mid + 1;
+            else high = mid;
+        }
+
+        return std::nullopt;
+    }
+
+    StringSlice term_word(usize term) {
+        return StringSlice::init(strings + terms[term].string_offset, terms[term].string_length);
+    }
+
+    PostingCursor postings_of(usize term) {
+        SearchTerm& entry = terms[term];
+        return PostingCursor::init(
+            postings + entry.postings_offset,
+            entry.postings_size,
+            header->verse_count
+        );
+    }
+
+    /// @brief Finds the verses that contain every word of `query` (or, with `phrase`, the words
+    /// in this exact order and next to each other), and the byte spans to highlight in each.
+    ///
+    /// The posting lists are intersected by leapfrogging: every cursor seeks to the largest
+    /// current row until they all agree. Only the occurrences of agreeing verses are decoded,
+    /// into stack buffers, so nothing is allocated besides `hits`.
+    /// @return False if `hits` could not grow.
+    bool search(StringSlice query, bool phrase, ArrayList<SearchHit>& hits) {
+        trace_scope("search");
+        hits.clear();
+
+        PostingCursor cursors[SEARCH_MAX_QUERY_WORDS];
+        usize cursor_count = 0;
+
+        auto it = WordIterator::init(query);
+        while (auto word = it.next()) {
+            if (cursor_count == SEARCH_MAX_QUERY_WORDS) break;
+
+            char normalized[SEARCH_MAX_WORD];
+            usize len = search_normalize(word.value(), normalized);
+
+            auto term = find_term(StringSlice::init(normalized, len));
+            if (!term.has_value()) return true; // A missing word matches nothing
+
+            cursors[cursor_count++] = postings_of(term.value());
+        }
+
+        if (cursor_count == 0) return true;
+
+        while (true) {
+            // Leapfrog until every cursor sits on the same verse
+            u32 target = 0;
+            for (usize i = 0; i < cursor_count; i++) {
+                if (cursors[i].done) return true;
+                if (cursors[i].row > target) target = cursors[i].row;
+            }
+
+            bool aligned = true;
+            for (usize i = 0; i < cursor_count; i++) {
+                if (!cursors[i].seek(target)) return true;
+                if (cursors[i].row != target) aligned = false;
+            }
+            if (!aligned) continue;
+
+            bool ok = phrase ? match_phrase(cursors, cursor_count, hits)
+                             : match_all(cursors, cursor_count, hits);
+            if (!ok) return false;
+
+            cursors[0].advance();
+        }
+    }
+
+  private:
+    static constexpr u32 U32_NONE = 0xFFFFFFFF;
+
+    struct TermBuild {
+        u32 verse_count;
+        u32 occurrence_count;
+        // Last verse counted, so a word repeated within a verse counts the verse once
+        u32 last_row;
+        // Next free slot of this word's list in the flat occurrence array
+        u32 fill;
+    };
+
+    struct Occurrence {
+        u32 row;
+        SearchPosition position;
+    };
+
+    // Occurrences of every query word in the verse the cursors agree on
+    struct VersePositions {
+        SearchPosition positions[SEARCH_MAX_QUERY_WORDS][SEARCH_MAX_POSITIONS];
+        usize counts[SEARCH_MAX_QUERY_WORDS];
+
+        void decode(PostingCursor* cursors, usize cursor_count) {
+            for (usize i = 0; i < cursor_count; i++) {
+                counts[i] = cursors[i].decode_positions(positions[i], SEARCH_MAX_POSITIONS);
+            }
+        }
+    };
+
+    // Every occurrence of every query word becomes a hit.
+    static bool match_all(PostingCursor* cursors, usize cursor_count, ArrayList<SearchHit>& hits) {
+        VersePositions verse;
+        verse.decode(cursors, cursor_count);
+
+        usize first = hits.len;
+        for (usize i = 0; i < cursor_count; i++) {
+            for (usize j = 0; j < verse.counts[i]; j++) {
+                SearchPosition& position = verse.positions[i][j];
+                SearchHit hit = SearchHit{
+                    .row = cursors[0].row,
+                    .start = position.start,
+                    .end = position.start + position.length,
+                };
+                if (!hits.append(hit)) return false;
+            }
+        }
+
+        // Order the verse's spans and drop duplicates from words repeated in the query
+        std::sort(hits.items + first, hits.items + hits.len, [](SearchHit& a, SearchHit& b) {
+            return a.start < b.start;
+        });
+
+        usize kept = first;
+        for (usize i = first; i < hits.len; i++) {
+            if (kept > first && hits.items[kept - 1].start == hits.items[i].start) continue;
+            hits.items[kept++] = hits.items[i];
+        }
+        hits.len = kept;
+
+        return true;
+    }
+
+    // A phrase matches where word i of the query sits at ordinal start + i.
+    static bool
+    match_phrase(PostingCursor* cursors, usize cursor_count, ArrayList<SearchHit>& hits) {
+        VersePositions verse;
+        verse.decode(cursors, cursor_count);
+
+        // Per-word read positions; ordinals only grow, so each list is walked once
+        usize next[SEARCH_MAX_QUERY_WORDS] = {};
+
+        for (usize j = 0; j < verse.counts[0]; j++) {
+            SearchPosition& first = verse.positions[0][j];
+            SearchPosition* last = &first;
+            bool matched = true;
+
+            for (usize i = 1; i < cursor_count && matched; i++) {
+                u32 wanted = first.ordinal + (u32)i;
+                while (next[i] < verse.counts[i] && verse.positions[i][next[i]].ordinal < wanted) {
+                    next[i]++;
+                }
+
+                matched = next[i] < verse.counts[i];
+                matched = matched && verse.positions[i][next[i]].ordinal == wanted;
+                if (matched) last = &verse.positions[i][next[i]];
+            }
+
+            if (!matched) continue;
+
+            SearchHit hit = SearchHit{
+                .row = cursors[0].row,
+                .start = first.start,
+                .end = last->start + last->length,
+            };
+            if (!hits.append(hit)) return false;
+        }
+
+        return true;
+    }
+
+    struct SearchTermBuild {
+        StringSlice word;
+        TermBuild* term;
+    };
+
+    static i32 compare_words(StringSlice a, StringSlice b) {
+        usize common = a.len < b.len ? a.len : b.len;
+        i32 order = common > 0 ? memcmp(a.ptr, b.ptr, common) : 0;
+        if (order != 0) return order;
+        if (a.len == b.len) return 0;
+        return a.len < b.len ? -1 : 1;
+    }
+
+    static std::expected<SearchIndex, BibleError>
+    from_mapping(MappedFile file, usize verse_count, std::optional<FileInfo> source) {
+        if (file.size < sizeof(SearchIndexHeader)) return std::unexpected(BibleInvalidIndex);
+
+        SearchIndexHeader* header = (SearchIndexHeader*)file.data;
+        if (memcmp(header->magic, SEARCH_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != SEARCH_INDEX_VERSION) {
+            return std::unexpected(BibleInvalidIndex);
+        }
+
+        if (source.has_value()) {
+            FileInfo built_from = FileInfo{
+                .size = header->source_size,
+                .modified_time = header->source_modified_time,
+            };
+            if (!built_from.equals(source.value())) return std::unexpected(BibleStaleIndex);
+        }
+        if (header->verse_count != verse_count) return std::unexpected(BibleStaleIndex);
+
+        u64 terms_size = sizeof(SearchTerm) * (u64)header->term_count;
+        bool valid = header->terms_offset % alignof(SearchTerm) == 0 &&
+                     header->terms_offset <= file.size &&
+                     terms_size <= file.size - header->terms_offset &&
+                     header->strings_offset <= file.size &&
+                     header->strings_size <= file.size - header->strings_offset &&
+                     header->postings_offset <= file.size &&
+                     header->postings_size <= file.size - header->postings_offset;
+        if (!valid) return std::unexpected(BibleInvalidIndex);
+
+        // Every term's word and postings must be inside their sections
+        SearchTerm* terms = (SearchTerm*)(file.data + header->terms_offset);
+        for (u32 i = 0; i < header->term_count; i++) {
+            SearchTerm& term = terms[i];
+            if ((u64)term.string_offset + term.string_length > header->strings_size ||
+                term.postings_offset > header->postings_size ||
+                term.postings_size > header->postings_size - term.postings_offset) {
+                return std::unexpected(BibleInvalidIndex);
+            }
+        }
+
+        file.advise_random();
+
+        return SearchIndex{
+            .file = file,
+            .header = header,
+            .terms = terms,
+            .strings = (string)(file.data + header->strings_offset),
+            .postings = file.data + header->postings_offset,
+        };
+    }
+};
+
+/// @brief Opens the search index next to the Bible file at `path`, building and persisting it
+/// first when it is missing or older than the Bible file.
+inline std::expected<SearchIndex, BibleError> search_index_open(Bible& bible, string path) {
+    auto source = FileInfo::init(path);
+    if (!source.has_value()) return std::unexpected(BibleFileNotFound);
+
+    char index_path[4096];
+    if (!SearchIndex::path_for(path, index_path, sizeof(index_path))) {
+        return std::unexpected(BibleWriteFailed);
+    }
+
+    auto index = SearchIndex::load(index_path, bible.verse_count, source);
+    if (index.has_value()) return index;
+
+    auto error = SearchIndex::build(bible, source.value(), index_path);
+    if (error.has_value()) return std::unexpected(error.value());
+
+    return SearchIndex::load(index_path, bible.verse_count, source);
+}
@@ -0,0 +1,741 @@
+#pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "bible.h"
+#include "def.h"
+#include "index.h"
+#include "search.h"
+#include "writer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <print>
+#include <thread>
+
+#ifdef __linux__
+#define SERVE_SUPPORTED 1
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#define SERVE_SUPPORTED 0
+#endif
+
+// Query daemon
+//
+// `bible serve` loads a Bible and its search index once and answers lookups over a local Unix
+// socket, so repeated commands skip opening, parsing and mapping. Every message is a frame: a
+// u32 payload size (host byte order, the socket never leaves the machine), then the payload.
+//
+//   request:  u8 kind, then NUL-terminated fields (see ServeRequestKind)
+//   response: u8 status, u32 stdout size, the stdout bytes, then the stderr bytes
+//
+// The client forwards a command only when a daemon is listening and serves the same file.
+// Otherwise, or on any socket error, the command runs locally as if there were no daemon.
+//
+// The daemon is single-threaded: one epoll loop over the listening socket, the connections, an
+// inotify watch on the Bible file, a signalfd and an eventfd. When the file changes, a new
+// snapshot is loaded on a background thread; the loop swaps it in between two requests, so
+// every request sees one immutable snapshot.
+
+enum ServeRequestKind : u8 {
+    // file, book, chapters and verses (see reference.h)
+    ServeReference = 1,
+    // file, query, phrase (0 or 1), limit, color (0 or 1)
+    ServeSearch = 2,
+};
+
+enum ServeStatus : u8 {
+    ServeOk = 0,
+    ServeFailed = 1,
+    // The daemon cannot answer this request; the client runs it locally
+    ServeNotServed = 2,
+};
+
+enum ServeError {
+    ServeSocketFailed,
+    ServeAlreadyRunning,
+    ServeWatchFailed,
+};
+
+inline string serve_error_message(ServeError error) {
+    switch (error) {
+        case ServeSocketFailed: return "could not listen on the socket";
+        case ServeAlreadyRunning: return "a daemon is already listening on the socket";
+        case ServeWatchFailed: return "could not watch the Bible file";
+    }
+
+    return "unknown error";
+}
+
+constexpr usize SERVE_MAX_FIELDS = 8;
+constexpr usize SERVE_MAX_REQUEST = KB(64);
+// Generous: a search for a common word prints most of the Bible
+constexpr i32 SERVE_CLIENT_TIMEOUT_SECONDS = 30;
+
+inline usize serve_field_count(ServeRequestKind kind) {
+    switch (kind) {
+        case ServeReference: return 3;
+        case ServeSearch: return 5;
+    }
+
+    return 0;
+}
+
+struct ServeRequest {
+    ServeRequestKind kind;
+    string fields[SERVE_MAX_FIELDS];
+    usize field_count;
+
+    /// @brief Splits a request payload into its fields, which point into `payload`.
+    static std::optional<ServeRequest> parse(const u8* payload, usize size) {
+        if (size < 2 || payload[size - 1] != 0) return std::nullopt;
+
+        ServeRequest request = ServeRequest{
+            .kind = (ServeRequestKind)payload[0],
+            .fields = {},
+            .field_count = 0,
+        };
+
+        for (usize at = 1; at < size;) {
+            if (request.field_count == SERVE_MAX_FIELDS) return std::nullopt;
+
+            string field = (string)(payload + at);
+            request.fields[request.field_count++] = field;
+            at += strlen(field) + 1;
+        }
+
+        if (request.field_count != serve_field_count(request.kind)) return std::nullopt;
+        return request;
+    }
+};
+
+/// @brief Everything a request reads. A snapshot is never modified once loaded; a changed
+/// Bible file gets a new snapshot instead.
+struct ServeSnapshot {
+    ArenaAllocator arena;
+    Bible bible;
+    // Absent when the search index could not be opened or built
+    std::optional<SearchIndex> search;
+
+    /// @brief Loads the Bible at `path` and its search index into a new heap snapshot.
+    static std::expected<ServeSnapshot*, BibleError> load(string path) {
+        Allocator heap = PageAllocator::init();
+        ServeSnapshot* snapshot = heap.create<ServeSnapshot>();
+        if (!snapshot) return std::unexpected(BibleOutOfMemory);
+
+        new (snapshot) ServeSnapshot{
+            .arena = ArenaAllocator::init(PageAllocator::init(), KB(64)),
+            .bible = {},
+            .search = std::nullopt,
+        };
+
+        Allocator allocator = snapshot->arena.allocator();
+        auto loaded = bible_open(allocator, path);
+        if (!loaded.has_value()) {
+            snapshot->arena.deinit();
+            snapshot->~ServeSnapshot();
+            heap.destroy(snapshot);
+            return std::unexpected(loaded.error());
+        }
+        snapshot->bible = loaded.value();
+
+        auto opened = search_index_open(snapshot->bible, path);
+        if (opened.has_value()) snapshot->search = opened.value();
+
+        return snapshot;
+    }
+
+    void destroy() {
+        if (search.has_value()) search->deinit();
+        bible.deinit();
+        arena.deinit();
+
+        this->~ServeSnapshot();
+        Allocator heap = PageAllocator::init();
+        heap.destroy(this);
+    }
+};
+
+/// @brief Answers one request by printing what the command would print to `out` and `err`.
+/// `allocator` is reset after every request.
+using ServeHandler = ServeStatus (*)(
+    ServeSnapshot& snapshot,
+    ServeRequest& request,
+    Allocator& allocator,
+    Writer& out,
+    Writer& err
+);
+
+#if SERVE_SUPPORTED
+
+/// @brief Socket path: $BIBLE_SOCKET, else bible.sock in $XDG_RUNTIME_DIR, else a per-user
+/// file in /tmp.
+inline bool serve_socket_path(mut_string out, usize size) {
+    string configured = getenv("BIBLE_SOCKET");
+    if (configured && *configured) return snprintf(out, size, "%s", configured) < (i32)size;
+
+    string runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) return snprintf(out, size, "%s/bible.sock", runtime) < (i32)size;
+
+    return snprintf(out, size, "/tmp/bible-%u.sock", (u32)getuid()) < (i32)size;
+}
+
+/// @brief Connects to the daemon socket at `path`. Returns -1 when nobody listens there.
+inline int serve_connect(string path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+inline bool serve_send_all(int fd, const void* data, usize size) {
+    const u8* bytes = (const u8*)data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+
+        bytes += sent;
+        size -= (usize)sent;
+    }
+
+    return true;
+}
+
+inline bool serve_recv_all(int fd, void* data, usize size) {
+    u8* bytes = (u8*)data;
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+
+        bytes += received;
+        size -= (usize)received;
+    }
+
+    return true;
+}
+
+inline bool serve_append(ArrayList<u8>& buffer, const void* data, usize size) {
+    // Empty output has no buffer at all
+    if (size == 0) return true;
+    if (!buffer.reserve(size)) return false;
+
+    memcpy(buffer.items + buffer.len, data, size);
+    buffer.len += size;
+    return true;
+}
+
+/// @brief Runs a command on the daemon, if one is serving the Bible at `path`, and prints its
+/// output. `args` are the request fields after the file.
+/// @return Whether the command succeeded, or std::nullopt when it has to run locally.
+inline std::optional<bool>
+serve_forward(ServeRequestKind kind, string path, string* args, usize arg_count) {
+    char socket_path[sizeof(sockaddr_un::sun_path)];
+    if (!serve_socket_path(socket_path, sizeof(socket_path))) return std::nullopt;
+
+    // Only trust a socket of our own
+    struct stat socket_stat;
+    if (lstat(socket_path, &socket_stat) != 0 || !S_ISSOCK(socket_stat.st_mode) ||
+        socket_stat.st_uid != getuid()) {
+        return std::nullopt;
+    }
+
+    // The daemon compares canonical paths, whatever directory the client runs from
+    char file_path[PATH_MAX];
+    if (!realpath(path, file_path)) return std::nullopt;
+
+    int fd = serve_connect(socket_path);
+    if (fd < 0) return std::nullopt;
+    defer { close(fd); };
+
+    timeval timeout = {.tv_sec = SERVE_CLIENT_TIMEOUT_SECONDS, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    auto frame = ArrayList<u8>::init(PageAllocator::init());
+    defer { frame.deinit(); };
+
+    u32 size = 0;
+    u8 request_kind = kind;
+    bool built = serve_append(frame, &size, sizeof(size)) &&
+                 serve_append(frame, &request_kind, 1) &&
+                 serve_append(frame, file_path, strlen(file_path) + 1);
+    for (usize i = 0; i < arg_count && built; i++) {
+        built = serve_append(frame, args[i], strlen(args[i]) + 1);
+    }
+    if (!built || frame.len - sizeof(size) > SERVE_MAX_REQUEST) return std::nullopt;
+
+    size = (u32)(frame.len - sizeof(size));
+    memcpy(frame.items, &size, sizeof(size));
+    if (!serve_send_all(fd, frame.items, frame.len)) return std::nullopt;
+
+    // Nothing is printed until the whole response is in, so a failure can still fall back
+    if (!serve_recv_all(fd, &size, sizeof(size)) || size < 1 + sizeof(u32)) return std::nullopt;
+
+    frame.clear();
+    if (!frame.reserve(size) || !serve_recv_all(fd, frame.items, size)) return std::nullopt;
+    frame.len = size;
+
+    ServeStatus status = (ServeStatus)frame.items[0];
+    u32 out_size;
+    memcpy(&out_size, frame.items + 1, sizeof(out_size));
+
+    usize header_size = 1 + sizeof(out_size);
+    if (status == ServeNotServed || out_size > frame.len - header_size) return std::nullopt;
+
+    fwrite(frame.items + header_size, 1, out_size, stdout);
+    fwrite(frame.items + header_size + out_size, 1, frame.len - header_size - out_size, stderr);
+    fflush(stdout);
+    return status == ServeOk;
+}
+
+struct ServeConnection {
+    int fd;
+    // Bytes received and not yet answered
+    ArrayList<u8> input;
+    // Responses not yet sent, from `output_sent` on
+    ArrayList<u8> output;
+    usize output_sent;
+};
+
+// epoll tags of the daemon's own descriptors; anything else is a ServeConnection*
+enum ServeEventTag : u64 {
+    ServeListenEvent = 1,
+    ServeWatchEvent,
+    ServeReloadEvent,
+    ServeSignalEvent,
+};
+
+struct ServeDaemon {
+    // Canonical path of the Bible file, as clients send it
+    char path[PATH_MAX];
+    // Where the file name starts in `path`; inotify reports names relative to the directory
+    usize name_offset;
+    char socket_path[sizeof(sockaddr_un::sun_path)];
+    ServeHandler handler;
+
+    ServeSnapshot* current;
+    // Written by the loader thread, read after joining it
+    ServeSnapshot* reloaded;
+    std::thread loader;
+    bool reload_again;
+
+    int listen_fd;
+    int epoll_fd;
+    int watch_fd;
+    int reload_fd;
+    int signal_fd;
+    sigset_t previous_mask;
+
+    ArrayList<ServeConnection*> connections;
+    // Scratch of the request being answered, reset after each so its blocks are reused
+    ArenaAllocator request_arena;
+
+    /// @brief Listens on the socket and watches `path`, answering with `snapshot` until it
+    /// changes. Takes ownership of `snapshot`, even on failure.
+    static std::expected<ServeDaemon, ServeError>
+    init(string path, ServeSnapshot* snapshot, ServeHandler handler) {
+        ServeDaemon daemon = ServeDaemon{
+            .path = {},
+            .name_offset = 0,
+            .socket_path = {},
+            .handler = handler,
+            .current = snapshot,
+            .reloaded = nullptr,
+            .loader = {},
+            .reload_again = false,
+            .listen_fd = -1,
+            .epoll_fd = -1,
+            .watch_fd = -1,
+            .reload_fd = -1,
+            .signal_fd = -1,
+            .previous_mask = {},
+            .connections = ArrayList<ServeConnection*>::init(PageAllocator::init()),
+            .request_arena = ArenaAllocator::init(PageAllocator::init(), KB(64)),
+        };
+        pthread_sigmask(SIG_SETMASK, nullptr, &daemon.previous_mask);
+
+        auto error = daemon.listen_and_watch(path);
+        if (error.has_value()) {
+            daemon.deinit();
+            return std::unexpected(error.value());
+        }
+
+        return daemon;
+    }
+
+    void deinit() {
+        if (loader.joinable()) loader.join();
+        if (reloaded) reloaded->destroy();
+        reloaded = nullptr;
+
+        while (connections.len > 0) close_connection(connections.items[connections.len - 1]);
+        connections.deinit();
+        request_arena.deinit();
+
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(socket_path);
+        }
+        if (epoll_fd >= 0) close(epoll_fd);
+        if (watch_fd >= 0) close(watch_fd);
+        if (reload_fd >= 0) close(reload_fd);
+        if (signal_fd >= 0) close(signal_fd);
+        listen_fd = epoll_fd = watch_fd = reload_fd = signal_fd = -1;
+        pthread_sigmask(SIG_SETMASK, &previous_mask, nullptr);
+
+        if (current) current->destroy();
+        current = nullptr;
+    }
+
+    /// @brief Answers requests until SIGINT or SIGTERM.
+    /// @return False when the event loop itself failed.
+    bool run() {
+        epoll_event events[64];
+
+        while (true) {
+            i32 count = epoll_wait(epoll_fd, events, 64, -1);
+            if (count < 0 && errno == EINTR) continue;
+            if (count < 0) return false;
+
+            for (i32 i = 0; i < count; i++) {
+                u64 tag = events[i].data.u64;
+                if (tag == ServeSignalEvent) return true;
+
+                if (tag == ServeListenEvent) {
+                    accept_connections();
+                } else if (tag == ServeWatchEvent) {
+                    if (file_changed()) start_reload();
+                } else if (tag == ServeReloadEvent) {
+                    finish_reload();
+                } else {
+                    ServeConnection* connection = (ServeConnection*)events[i].data.ptr;
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                        close_connection(connection);
+                    } else if (events[i].events & EPOLLIN) {
+                        read_requests(connection);
+                    } else if (events[i].events & EPOLLOUT) {
+                        flush(connection);
+                    }
+                }
+            }
+        }
+    }
+
+  private:
+    std::optional<ServeError> listen_and_watch(string file_path) {
+        if (snprintf(path, sizeof(path), "%s", file_path) >= (i32)sizeof(path)) {
+            return ServeWatchFailed;
+        }
+
+        char* slash = strrchr(path, '/');
+        if (!slash) return ServeWatchFailed;
+        name_offset = (usize)(slash - path) + 1;
+
+        if (!serve_socket_path(socket_path, sizeof(socket_path))) return ServeSocketFailed;
+
+        // A socket nobody answers on is left over from a daemon that did not shut down cleanly
+        int live = serve_connect(socket_path);
+        if (live >= 0) {
+            close(live);
+            return ServeAlreadyRunning;
+        }
+        unlink(socket_path);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) return ServeSocketFailed;
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, socket_path, strlen(socket_path) + 1);
+
+        if (bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0) {
+            close(listen_fd);
+            listen_fd = -1;
+            return ServeSocketFailed;
+        }
+        if (chmod(socket_path, 0600) != 0 || listen(listen_fd, 64) != 0) return ServeSocketFailed;
+
+        // The directory is watched rather than the file, since editors and downloads usually
+        // replace the file by renaming a new one over it
+        watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch_fd < 0) return ServeWatchFailed;
+
+        *slash = 0;
+        string directory = slash == path ? "/" : path;
+        i32 watch = inotify_add_watch(watch_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+        *slash = '/';
+        if (watch < 0) return ServeWatchFailed;
+
+        reload_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reload_fd < 0) return ServeSocketFailed;
+
+        // Blocked before the first loader thread starts, so only the signalfd sees them
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signal_fd < 0) return ServeSocketFailed;
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) return ServeSocketFailed;
+
+        if (!watch_events(listen_fd, ServeListenEvent) ||
+            !watch_events(watch_fd, ServeWatchEvent) ||
+            !watch_events(reload_fd, ServeReloadEvent) ||
+            !watch_events(signal_fd, ServeSignalEvent)) {
+            return ServeSocketFailed;
+        }
+
+        return std::nullopt;
+    }
+
+    bool watch_events(int fd, ServeEventTag tag) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = tag;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    void accept_connections() {
+        Allocator heap = PageAllocator::init();
+
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0 && errno == EINTR) continue;
+            if (fd < 0) return;
+
+            ServeConnection* connection = heap.create<ServeConnection>();
+            if (!connection || !connections.append(connection)) {
+                heap.destroy(connection);
+                close(fd);
+                continue;
+            }
+
+            *connection = ServeConnection{
+                .fd = fd,
+                .input = ArrayList<u8>::init(heap),
+                .output = ArrayList<u8>::init(heap),
+                .output_sent = 0,
+            };
+
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = connection;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) close_connection(connection);
+        }
+    }
+
+    void close_connection(ServeConnection* connection) {
+        for (usize i = 0; i < connections.len; i++) {
+            if (connections.items[i] == connection) {
+                connections.items[i] = connections.items[--connections.len];
+                break;
+            }
+        }
+
+        close(connection->fd); // Also removes it from the epoll set
+        connection->input.deinit();
+        connection->output.deinit();
+
+        Allocator heap = PageAllocator::init();
+        heap.destroy(connection);
+    }
+
+    void read_requests(ServeConnection* connection) {
+        while (true) {
+            if (!connection->input.reserve(KB(4))) return close_connection(connection);
+
+            ArrayList<u8>& input = connection->input;
+            ssize_t received = recv(connection->fd, input.items + input.len, KB(4), 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (received <= 0) return close_connection(connection);
+
+            input.len += (usize)received;
+        }
+
+        // Answer every complete frame
+        ArrayList<u8>& input = connection->input;
+        usize consumed = 0;
+        while (input.len - consumed >= sizeof(u32)) {
+            u32 size;
+            memcpy(&size, input.items + consumed, sizeof(size));
+            if (size > SERVE_MAX_REQUEST) return close_connection(connection);
+            if (input.len - consumed - sizeof(size) < size) break;
+
+            if (!respond(connection, input.items + consumed + sizeof(size), size)) {
+                return close_connection(connection);
+            }
+            consumed += sizeof(size) + size;
+        }
+
+        memmove(input.items, input.items + consumed, input.len - consumed);
+        input.len -= consumed;
+
+        flush(connection);
+    }
+
+    bool respond(ServeConnection* connection, const u8* payload, usize size) {
+        Allocator allocator = request_arena.allocator();
+        defer { request_arena.reset(); };
+
+        auto out_text = ArrayList<char>::init(allocator);
+        auto err_text = ArrayList<char>::init(allocator);
+        Writer out = Writer::init_list(allocator, out_text);
+        Writer err = Writer::init_list(allocator, err_text);
+
+        ServeStatus status = ServeFailed;
+        auto request = ServeRequest::parse(payload, size);
+        if (!request.has_value()) {
+            err.println("Error: Malformed request");
+        } else if (strcmp(request->fields[0], path) != 0) {
+            status = ServeNotServed;
+        } else {
+            status = handler(*current, request.value(), allocator, out, err);
+        }
+
+        out.deinit();
+        err.deinit();
+        if (out.failed || err.failed) return false;
+
+        u32 frame_size = (u32)(1 + sizeof(u32) + out_text.len + err_text.len);
+        u8 status_byte = status;
+        u32 out_length = (u32)out_text.len;
+        return serve_append(connection->output, &frame_size, sizeof(frame_size)) &&
+               serve_append(connection->output, &status_byte, 1) &&
+               serve_append(connection->output, &out_length, sizeof(out_length)) &&
+               serve_append(connection->output, out_text.items, out_text.len) &&
+               serve_append(connection->output, err_text.items, err_text.len);
+    }
+
+    void flush(ServeConnection* connection) {
+        ArrayList<u8>& output = connection->output;
+        while (connection->output_sent < output.len) {
+            ssize_t sent = send(
+                connection->fd,
+                output.items + connection->output_sent,
+                output.len - connection->output_sent,
+                MSG_NOSIGNAL
+            );
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (sent <= 0) return close_connection(connection);
+
+            connection->output_sent += (usize)sent;
+        }
+
+        bool pending = connection->output_sent < output.len;
+        if (!pending) {
+            output.clear();
+            connection->output_sent = 0;
+        }
+
+        // Wait for the socket to drain before reading more requests
+        epoll_event event = {};
+        event.events = pending ? EPOLLOUT : EPOLLIN;
+        event.data.ptr = connection;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    }
+
+    bool file_changed() {
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+
+        while (true) {
+            ssize_t size = read(watch_fd, buffer, sizeof(buffer));
+            if (size <= 0) break;
+
+            for (ssize_t at = 0; at < size;) {
+                inotify_event* event = (inotify_event*)(buffer + at);
+                if (event->len > 0 && strcmp(event->name, path + name_offset) == 0) changed = true;
+                at += (ssize_t)(sizeof(inotify_event) + event->len);
+            }
+        }
+
+        return changed;
+    }
+
+    void start_reload() {
+        // A change during a reload needs one more, since the loader may have read old bytes
+        if (loader.joinable()) {
+            reload_again = true;
+            return;
+        }
+
+        loader = std::thread([this]() {
+            auto loaded = ServeSnapshot::load(path);
+            if (loaded.has_value()) {
+                reloaded = loaded.value();
+            } else {
+                std::println(
+                    stderr,
+                    "Could not reload '{}': {}",
+                    path,
+                    bible_error_message(loaded.error())
+                );
+            }
+
+            u64 done = 1;
+            (void)!write(reload_fd, &done, sizeof(done));
+        });
+    }
+
+    void finish_reload() {
+        u64 count;
+        (void)!read(reload_fd, &count, sizeof(count));
+        if (!loader.joinable()) return;
+
+        loader.join();
+        if (reloaded) {
+            // Requests are answered on this thread, so none is using the old snapshot
+            current->destroy();
+            current = reloaded;
+            reloaded = nullptr;
+            std::println(stderr, "Reloaded {}", path);
+        }
+
+        if (reload_again) {
+            reload_again = false;
+            start_reload();
+        }
+    }
+};
+
+#else
+
+inline std::optional<bool>
+serve_forward(ServeRequestKind kind, string path, string* args, usize arg_count) {
+    (void)kind;
+    (void)path;
+    (void)args;
+    (void)arg_count;
+    return std::nullopt;
+}
+
+#endif
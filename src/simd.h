@@ -0,0 +1,93 @@
+#pragma once
+
+#include "def.h"
+#include "string.h"
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+// Lets a single function use instructions beyond the baseline ISA the file is compiled for.
+// Callers must check simd_level() before calling it.
+#if SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+enum SimdLevel {
+    SimdScalar,
+    SimdSse2,
+    SimdAvx2,
+};
+
+inline string simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdScalar: return "scalar";
+        case SimdSse2: return "sse2";
+        case SimdAvx2: return "avx2";
+    }
+
+    return "unknown";
+}
+
+/// @brief Detects the best instruction set supported by the running CPU.
+/// The BIBLE_SIMD environment variable (scalar, sse2, avx2) caps the level, which makes it
+/// possible to compare the vector paths against the scalar one on the same machine.
+inline SimdLevel simd_detect() {
+    SimdLevel level = SimdScalar;
+
+#if SIMD_X86
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) level = SimdSse2;
+    if (__builtin_cpu_supports("avx2")) level = SimdAvx2;
+#elif defined(_MSC_VER)
+    i32 info[4];
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) level = SimdSse2;
+
+    bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    if (os_saves_ymm && (info[1] & (1 << 5))) level = SimdAvx2;
+#endif
+#endif
+
+    string requested = getenv("BIBLE_SIMD");
+    if (requested) {
+        SimdLevel cap = level;
+        if (string_equals(requested, "scalar")) cap = SimdScalar;
+        if (string_equals(requested, "sse2")) cap = SimdSse2;
+        if (string_equals(requested, "avx2")) cap = SimdAvx2;
+        if (cap < level) level = cap;
+    }
+
+    return level;
+}
+
+/// @brief The detected instruction set, computed once per process.
+inline SimdLevel simd_level() {
+    static SimdLevel level = simd_detect();
+    return level;
+}
+
+/// @brief Index of the lowest set bit. `bits` must not be zero.
+inline u32 simd_ctz64(u64 bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctzll(bits);
+#endif
+}
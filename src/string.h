@@ -83,3 +83,91 @@ inline bool string_substring(string str, i32 start, i32 length, mut_string out_b
     errno_t result = strncpy_s(out_buffer, buffer_size, str + start, length);
     return result == 0;
 }
+
+/// @brief A non-owning view into a run of bytes that is not necessarily NUL-terminated.
+/// Slices usually point into a memory-mapped file and stay valid as long as the mapping does.
+struct StringSlice {
+    string ptr;
+    usize len;
+
+    static StringSlice init(string ptr, usize len) {
+        return StringSlice{
+            .ptr = ptr,
+            .len = len,
+        };
+    }
+
+    static StringSlice from_cstr(string str) {
+        return StringSlice{
+            .ptr = str,
+            .len = str ? strlen(str) : 0,
+        };
+    }
+
+    bool is_empty() { return len == 0; }
+
+    bool equals(StringSlice other) {
+        return len == other.len && (len == 0 || memcmp(ptr, other.ptr, len) == 0);
+    }
+
+    bool equals(string str) { return equals(from_cstr(str)); }
+
+    /// @brief Compares two slices ignoring ASCII case.
+    bool equals_ignore_case(StringSlice other) {
+        if (len != other.len) return false;
+
+        for (usize i = 0; i < len; i++) {
+            char a = ptr[i];
+            char b = other.ptr[i];
+            if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+            if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+            if (a != b) return false;
+        }
+
+        return true;
+    }
+
+    bool equals_ignore_case(string str) { return equals_ignore_case(from_cstr(str)); }
+
+    /// @brief Returns the slice without leading and trailing ASCII whitespace.
+    StringSlice trim() {
+        usize start = 0;
+        usize end = len;
+
+        while (start < end && is_space(ptr[start])) start++;
+        while (end > start && is_space(ptr[end - 1])) end--;
+
+        return StringSlice::init(ptr + start, end - start);
+    }
+
+    /// @brief Returns the sub-slice [start, start + length), clamped to the slice bounds.
+    StringSlice sub(usize start, usize length = USIZE_MAX) {
+        if (start > len) start = len;
+        if (length > len - start) length = len - start;
+
+        return StringSlice::init(ptr + start, length);
+    }
+
+  private:
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+};
+
+/// @brief Finds the first occurrence of `needle` in a byte range that is not NUL-terminated.
+/// @return Pointer to the match, or nullptr if there is none.
+inline string
+string_find_bytes(string haystack, usize haystack_len, string needle, usize needle_len) {
+    if (needle_len == 0) return haystack;
+    if (needle_len > haystack_len) return nullptr;
+
+    string end = haystack + haystack_len - needle_len + 1;
+    string cursor = haystack;
+
+    while (cursor < end) {
+        cursor = (string)memchr(cursor, needle[0], (usize)(end - cursor));
+        if (!cursor) return nullptr;
+        if (memcmp(cursor, needle, needle_len) == 0) return cursor;
+        cursor++;
+    }
+
+    return nullptr;
+}
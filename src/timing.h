@@ -0,0 +1,140 @@
+#pragma once
+
+#include "allocator.h"
+#include "def.h"
+#include "trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+// Phase timings for --stats
+//
+// The code marks where a command spends its time with a StatsTimer around each phase, and counts
+// the bytes it scans and the verses it prints. Recording costs a clock read and an atomic add,
+// and nothing at all until --stats turns it on. The summary goes to stderr once the command has
+// run, so it never mixes with the verses on stdout.
+
+enum StatsPhase {
+    // Command line parsing
+    StatsPhaseArguments,
+    // Opening and mapping files
+    StatsPhaseOpen,
+    // Building the verse table from XML
+    StatsPhaseParse,
+    // Resolving references, searching, scanning
+    StatsPhaseLookup,
+    // Formatting and writing the results
+    StatsPhaseOutput,
+    StatsPhaseCount,
+};
+
+constexpr string STATS_PHASE_NAMES[StatsPhaseCount] = {
+    "arguments",
+    "open",
+    "parse",
+    "lookup",
+    "output",
+};
+
+// The clock of the trace, so phases and spans line up
+inline u64 stats_now_ns() { return trace_now_ns(); }
+
+struct Stats {
+    std::atomic<bool> enabled;
+    u64 start_ns;
+    std::atomic<u64> phase_ns[StatsPhaseCount];
+    // Bytes of XML parsed or verse text scanned
+    std::atomic<u64> bytes_scanned;
+    std::atomic<u64> verses_emitted;
+    // The app's arena, whose size is reported when set. Arenas only grow until deinit(), so its
+    // size when the command is done is its peak.
+    ArenaAllocator* arena;
+
+    /// @param start When the process started its work, see stats_now_ns().
+    void enable(u64 start) {
+        start_ns = start;
+        enabled.store(true, std::memory_order_relaxed);
+    }
+
+    bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    void add_time(StatsPhase phase, u64 ns) {
+        if (is_enabled()) phase_ns[phase].fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void add_bytes(u64 bytes) {
+        if (is_enabled()) bytes_scanned.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void add_verses(u64 count) {
+        if (is_enabled()) verses_emitted.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    /// @brief Prints the summary, with the time since enable() not covered by a phase as "other".
+    void print(FILE* out) {
+        u64 total = stats_now_ns() - start_ns;
+        u64 covered = 0;
+
+        fprintf(out, "\nstats:\n");
+        for (usize phase = 0; phase < StatsPhaseCount; phase++) {
+            u64 ns = phase_ns[phase].load(std::memory_order_relaxed);
+            covered += ns;
+            fprintf(out, "  %-12s %10.3f ms\n", STATS_PHASE_NAMES[phase], (f64)ns / 1e6);
+        }
+        u64 other = total > covered ? total - covered : 0;
+        fprintf(out, "  %-12s %10.3f ms\n", "other", (f64)other / 1e6);
+        fprintf(out, "  %-12s %10.3f ms\n", "total", (f64)total / 1e6);
+
+        // Scanning happens while parsing XML or looking through verse text
+        u64 bytes = bytes_scanned.load(std::memory_order_relaxed);
+        u64 scan_ns = phase_ns[StatsPhaseParse].load() + phase_ns[StatsPhaseLookup].load();
+        if (bytes > 0 && scan_ns > 0) {
+            fprintf(
+                out,
+                "  %-12s %10.2f MB at %.1f MB/s\n",
+                "scanned",
+                (f64)bytes / (f64)MB(1),
+                (f64)bytes / (f64)MB(1) / ((f64)scan_ns / 1e9)
+            );
+        }
+        fprintf(out, "  %-12s %10llu\n", "verses", (unsigned long long)verses_emitted.load());
+        if (arena) {
+            fprintf(
+                out,
+                "  %-12s %10.1f KB in %zu block(s)\n",
+                "arena peak",
+                (f64)arena->total_allocated / (f64)KB(1),
+                arena->block_count
+            );
+        }
+    }
+};
+
+/// @brief The statistics of this process, recorded only when --stats was given.
+inline Stats process_stats;
+
+/// @brief Adds the time from init() to the first stop() to `phase`, and records it as a span
+/// named after the phase when tracing. Stopping again does nothing, so a timer can be stopped
+/// early and by a defer.
+struct StatsTimer {
+    StatsPhase phase;
+    u64 start_ns;
+
+    static StatsTimer init(StatsPhase phase) {
+        return StatsTimer{
+            .phase = phase,
+            .start_ns = process_stats.is_enabled() || trace_is_enabled() ? stats_now_ns() : 0,
+        };
+    }
+
+    void stop() {
+        if (!start_ns) return;
+
+        u64 end_ns = stats_now_ns();
+        process_stats.add_time(phase, end_ns - start_ns);
+        if (trace_is_enabled()) {
+            trace_record(STATS_PHASE_NAMES[phase], start_ns, end_ns, TRACE_NO_ARG);
+        }
+        start_ns = 0;
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "allocator.h"
+#include "def.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+// Span tracing for --trace
+//
+// `trace_scope("parse");` records a span from that line to the end of the enclosing scope, like
+// `defer` runs at its end. Each thread writes its spans into its own ring buffer, so recording
+// takes no lock; when a buffer is full the oldest spans are overwritten. With tracing off a span
+// is one relaxed load and a branch.
+//
+// trace_write() saves every thread's spans in the Chrome trace event format, which
+// chrome://tracing and ui.perfetto.dev open as one timeline row per thread. That shows what
+// totals cannot: a worker still busy while the others wait, or a thread stalled mid-run.
+//
+// Span names must be string literals, or otherwise live until the trace is written.
+
+constexpr usize TRACE_BUFFER_EVENTS = 16384;
+// No argument, see TraceEvent::arg
+constexpr i64 TRACE_NO_ARG = -1;
+
+struct TraceEvent {
+    string name;
+    u64 begin_ns;
+    u64 end_ns;
+    // A number shown with the span, e.g. the book a worker parsed, or TRACE_NO_ARG
+    i64 arg;
+};
+
+struct TraceBuffer {
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    // Spans ever recorded; the last TRACE_BUFFER_EVENTS of them are kept
+    u64 written;
+    u32 thread_id;
+    string thread_name;
+    TraceBuffer* next;
+};
+
+struct TraceState {
+    std::atomic<bool> enabled;
+    u64 start_ns;
+    // Every thread's buffer, newest first. Buffers are never freed, so a thread may exit
+    // before the trace is written.
+    std::atomic<TraceBuffer*> buffers;
+    std::atomic<u32> next_thread_id;
+};
+
+inline TraceState trace_state;
+inline thread_local TraceBuffer* trace_thread_buffer = nullptr;
+
+inline u64 trace_now_ns() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+inline bool trace_is_enabled() { return trace_state.enabled.load(std::memory_order_relaxed); }
+
+inline TraceBuffer* trace_buffer();
+
+/// @brief Starts recording spans, from the thread that becomes "main" on the timeline. Call
+/// before the threads to trace are started.
+/// @param start Time zero of the timeline, see trace_now_ns().
+inline void trace_enable(u64 start) {
+    trace_state.start_ns = start;
+    trace_state.enabled.store(true, std::memory_order_relaxed);
+    trace_buffer();
+}
+
+// The calling thread's buffer, created on its first span
+inline TraceBuffer* trace_buffer() {
+    if (trace_thread_buffer) return trace_thread_buffer;
+
+    Allocator allocator = PageAllocator::init();
+    TraceBuffer* buffer = allocator.create<TraceBuffer>();
+    if (!buffer) return nullptr;
+
+    buffer->written = 0;
+    buffer->thread_id = trace_state.next_thread_id.fetch_add(1, std::memory_order_relaxed);
+    buffer->thread_name = buffer->thread_id == 0 ? "main" : "worker";
+    buffer->next = trace_state.buffers.load(std::memory_order_relaxed);
+    while (!trace_state.buffers.compare_exchange_weak(buffer->next, buffer)) {
+    }
+
+    trace_thread_buffer = buffer;
+    return buffer;
+}
+
+/// @brief Names the calling thread's row of the timeline (a string literal).
+inline void trace_thread_name(string name) {
+    if (!trace_is_enabled()) return;
+
+    TraceBuffer* buffer = trace_buffer();
+    if (buffer) buffer->thread_name = name;
+}
+
+inline void trace_record(string name, u64 begin_ns, u64 end_ns, i64 arg) {
+    TraceBuffer* buffer = trace_buffer();
+    if (!buffer) return;
+
+    buffer->events[buffer->written % TRACE_BUFFER_EVENTS] = TraceEvent{
+        .name = name,
+        .begin_ns = begin_ns,
+        .end_ns = end_ns,
+        .arg = arg,
+    };
+    buffer->written++;
+}
+
+/// @brief A span that ends when it goes out of scope, see trace_scope.
+struct TraceSpan {
+    string name;
+    u64 begin_ns;
+    i64 arg;
+
+    static TraceSpan begin(string name, i64 arg = TRACE_NO_ARG) {
+        return TraceSpan{
+            .name = name,
+            .begin_ns = trace_is_enabled() ? trace_now_ns() : 0,
+            .arg = arg,
+        };
+    }
+
+    ~TraceSpan() {
+        if (begin_ns) trace_record(name, begin_ns, trace_now_ns(), arg);
+    }
+};
+
+#define trace_name_concat(line) trace_span_##line
+#define trace_name(line) trace_name_concat(line)
+/// @brief Records a span named by the first argument (with an optional number, e.g. a book
+/// index, as the second) from here to the end of the scope.
+#define trace_scope(...) TraceSpan trace_name(__LINE__) = TraceSpan::begin(__VA_ARGS__)
+
+/// @brief Writes the spans of every thread to `path` as Chrome trace events. The threads that
+/// recorded them must be done.
+/// @return False when the file could not be written.
+inline bool trace_write(string path) {
+    FILE* out = fopen(path, "w");
+    if (!out) return false;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    bool first = true;
+    for (TraceBuffer* buffer = trace_state.buffers.load(); buffer; buffer = buffer->next) {
+        fprintf(
+            out,
+            "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+            "\"args\": {\"name\": \"%s %u\"}}",
+            first ? "" : ",\n",
+            buffer->thread_id,
+            buffer->thread_name,
+            buffer->thread_id
+        );
+        first = false;
+
+        u64 kept = buffer->written < TRACE_BUFFER_EVENTS ? buffer->written : TRACE_BUFFER_EVENTS;
+        for (u64 i = buffer->written - kept; i < buffer->written; i++) {
+            TraceEvent& event = buffer->events[i % TRACE_BUFFER_EVENTS];
+
+            // Microseconds since the start given to trace_enable(), as the format wants
+            f64 ts = (f64)(event.begin_ns - trace_state.start_ns) / 1e3;
+            f64 dur = (f64)(event.end_ns - event.begin_ns) / 1e3;
+            fprintf(
+                out,
+                ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, "
+                "\"dur\": %.3f",
+                event.name,
+                buffer->thread_id,
+                ts,
+                dur
+            );
+            if (event.arg != TRACE_NO_ARG) {
+                fprintf(out, ", \"args\": {\"n\": %lld}", (long long)event.arg);
+            }
+            fputc('}', out);
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "def.h"
+#include <optional>
+
+// Verse ids and versification schemes
+//
+// Translations do not agree on where chapters start. Hebrew Bibles end Malachi at 3:24 where
+// English ones have a chapter 4, the Septuagint and the Vulgate number most psalms one lower,
+// and so on. A canonical verse id is a verse in KJV numbering, so the same id addresses the
+// same text in every loaded translation. Each other scheme is described by a compile-time table
+// of shifts from KJV numbering; anything a table does not mention is numbered alike.
+//
+// Only whole verses are mapped. Verses that one tradition splits in two (1 Sam 20:42,
+// Isa 63:19) and psalm superscriptions, which Hebrew and Vulgate editions count as verses, keep
+// their own numbers.
+
+/// @brief Canonical verse id, the same in every translation: book (8 bits), chapter (8 bits)
+/// and verse (16 bits), in KJV numbering. Ids sort in canonical order, so range checks and
+/// sorting are integer compares.
+using VerseId = u32;
+
+constexpr u16 VERSE_ID_MAX_CHAPTER = 0xFF;
+
+constexpr VerseId verse_id(u8 book, u16 chapter, u16 verse) {
+    return (VerseId)book << 24 | (VerseId)(chapter & 0xFF) << 16 | verse;
+}
+
+constexpr u8 verse_id_book(VerseId id) { return (u8)(id >> 24); }
+constexpr u16 verse_id_chapter(VerseId id) { return (u16)((id >> 16) & 0xFF); }
+constexpr u16 verse_id_verse(VerseId id) { return (u16)(id & 0xFFFF); }
+
+enum Versification : u8 {
+    // English Protestant numbering, that of canonical verse ids
+    VersificationKjv,
+    // Masoretic numbering, followed by Hebrew Bibles and many modern translations
+    VersificationHebrew,
+    // Septuagint and Vulgate psalm numbering, with the Greek additions to Daniel 3
+    VersificationVulgate,
+};
+
+constexpr usize VERSIFICATION_COUNT = 3;
+
+inline string versification_name(Versification versification) {
+    switch (versification) {
+        case VersificationKjv: return "kjv";
+        case VersificationHebrew: return "hebrew";
+        case VersificationVulgate: return "vulgate";
+    }
+
+    return "unknown";
+}
+
+// Verse number meaning "to the end of the chapter"
+constexpr u16 VERSIFICATION_CHAPTER_END = 0xFFFF;
+
+/// @brief Verses `first_verse` to `last_verse` of chapters `first_chapter` to `last_chapter`
+/// of `book`, in KJV numbering, are numbered `chapter + chapter_shift`:`verse + verse_shift`
+/// in another scheme.
+struct VersificationShift {
+    u8 book;
+    u8 first_chapter;
+    u8 last_chapter;
+    u16 first_verse;
+    u16 last_verse;
+    i8 chapter_shift;
+    i16 verse_shift;
+
+    constexpr bool covers(u8 id_book, u16 chapter, u16 verse) const {
+        return id_book == book && chapter >= first_chapter && chapter <= last_chapter &&
+               verse >= first_verse && verse <= last_verse;
+    }
+
+    constexpr bool covers_target(u8 id_book, u16 chapter, u16 verse) const {
+        return covers(id_book, (u16)(chapter - chapter_shift), (u16)(verse - verse_shift));
+    }
+};
+
+// Entries are ordered by book, so a lookup stops at the first later book
+constexpr VersificationShift VERSIFICATION_HEBREW[] = {
+    {1, 31, 31, 55, 55, 1, -54},  // Genesis 31:55 is 32:1
+    {1, 32, 32, 1, 32, 0, 1},
+    {2, 8, 8, 1, 4, -1, 25},      // Exodus 8:1-4 is 7:26-29
+    {2, 8, 8, 5, 32, 0, -4},
+    {2, 22, 22, 1, 1, -1, 36},    // Exodus 22:1 is 21:37
+    {2, 22, 22, 2, 31, 0, -1},
+    {3, 6, 6, 1, 7, -1, 19},      // Leviticus 6:1-7 is 5:20-26
+    {3, 6, 6, 8, 30, 0, -7},
+    {4, 16, 16, 36, 50, 1, -35},  // Numbers 16:36-50 is 17:1-15
+    {4, 17, 17, 1, 13, 0, 15},
+    {4, 29, 29, 40, 40, 1, -39},  // Numbers 29:40 is 30:1
+    {4, 30, 30, 1, 16, 0, 1},
+    {5, 12, 12, 32, 32, 1, -31},  // Deuteronomy 12:32 is 13:1
+    {5, 13, 13, 1, 18, 0, 1},
+    {5, 22, 22, 30, 30, 1, -29},  // Deuteronomy 22:30 is 23:1
+    {5, 23, 23, 1, 25, 0, 1},
+    {5, 29, 29, 1, 1, -1, 68},    // Deuteronomy 29:1 is 28:69
+    {5, 29, 29, 2, 29, 0, -1},
+    {9, 23, 23, 29, 29, 1, -28},  // 1 Samuel 23:29 is 24:1
+    {9, 24, 24, 1, 22, 0, 1},
+    {10, 18, 18, 33, 33, 1, -32}, // 2 Samuel 18:33 is 19:1
+    {10, 19, 19, 1, 43, 0, 1},
+    {11, 4, 4, 21, 34, 1, -20},   // 1 Kings 4:21-34 is 5:1-14
+    {11, 5, 5, 1, 18, 0, 14},
+    {12, 11, 11, 21, 21, 1, -20}, // 2 Kings 11:21 is 12:1
+    {12, 12, 12, 1, 21, 0, 1},
+    {13, 6, 6, 1, 15, -1, 26},    // 1 Chronicles 6:1-15 is 5:27-41
+    {13, 6, 6, 16, 81, 0, -15},
+    {14, 2, 2, 1, 1, -1, 17},     // 2 Chronicles 2:1 is 1:18
+    {14, 2, 2, 2, 18, 0, -1},
+    {14, 14, 14, 1, 1, -1, 22},   // 2 Chronicles 14:1 is 13:23
+    {14, 14, 14, 2, 15, 0, -1},
+    {16, 4, 4, 1, 6, -1, 32},     // Nehemiah 4:1-6 is 3:33-38
+    {16, 4, 4, 7, 23, 0, -6},
+    {16, 9, 9, 38, 38, 1, -37},   // Nehemiah 9:38 is 10:1
+    {16, 10, 10, 1, 39, 0, 1},
+    {18, 41, 41, 1, 8, -1, 24},   // Job 41:1-8 is 40:25-32
+    {18, 41, 41, 9, 34, 0, -8},
+    {21, 5, 5, 1, 1, -1, 16},     // Ecclesiastes 5:1 is 4:17
+    {21, 5, 5, 2, 20, 0, -1},
+    {22, 6, 6, 13, 13, 1, -12},   // Song of Solomon 6:13 is 7:1
+    {22, 7, 7, 1, 13, 0, 1},
+    {23, 9, 9, 1, 1, -1, 22},     // Isaiah 9:1 is 8:23
+    {23, 9, 9, 2, 21, 0, -1},
+    {24, 9, 9, 1, 1, -1, 22},     // Jeremiah 9:1 is 8:23
+    {24, 9, 9, 2, 26, 0, -1},
+    {26, 20, 20, 45, 49, 1, -44}, // Ezekiel 20:45-49 is 21:1-5
+    {26, 21, 21, 1, 32, 0, 5},
+    {27, 4, 4, 1, 3, -1, 30},     // Daniel 4:1-3 is 3:31-33
+    {27, 4, 4, 4, 37, 0, -3},
+    {27, 5, 5, 31, 31, 1, -30},   // Daniel 5:31 is 6:1
+    {27, 6, 6, 1, 28, 0, 1},
+    {28, 1, 1, 10, 11, 1, -9},    // Hosea 1:10-11 is 2:1-2
+    {28, 2, 2, 1, 23, 0, 2},
+    {28, 11, 11, 12, 12, 1, -11}, // Hosea 11:12 is 12:1
+    {28, 12, 12, 1, 14, 0, 1},
+    {28, 13, 13, 16, 16, 1, -15}, // Hosea 13:16 is 14:1
+    {28, 14, 14, 1, 9, 0, 1},
+    {29, 2, 2, 28, 32, 1, -27},   // Joel 2:28-32 is 3:1-5, and Joel 3 is 4
+    {29, 3, 3, 1, 21, 1, 0},
+    {32, 1, 1, 17, 17, 1, -16},   // Jonah 1:17 is 2:1
+    {32, 2, 2, 1, 10, 0, 1},
+    {33, 5, 5, 1, 1, -1, 13},     // Micah 5:1 is 4:14
+    {33, 5, 5, 2, 15, 0, -1},
+    {34, 1, 1, 15, 15, 1, -14},   // Nahum 1:15 is 2:1
+    {34, 2, 2, 1, 13, 0, 1},
+    {38, 1, 1, 18, 21, 1, -17},   // Zechariah 1:18-21 is 2:1-4
+    {38, 2, 2, 1, 13, 0, 4},
+    {39, 4, 4, 1, 6, -1, 18},     // Malachi 4:1-6 is 3:19-24
+};
+
+constexpr VersificationShift VERSIFICATION_VULGATE[] = {
+    // Psalms 9 and 10 are one psalm, whose title is verse 1
+    {19, 9, 9, 1, 20, 0, 1},
+    {19, 10, 10, 1, 18, -1, 21},
+    {19, 11, 113, 1, VERSIFICATION_CHAPTER_END, -1, 0},
+    // So are 114 and 115, while 116 and 147 are split in two
+    {19, 114, 114, 1, 8, -1, 0},
+    {19, 115, 115, 1, 18, -2, 8},
+    {19, 116, 116, 1, 9, -2, 0},
+    {19, 116, 116, 10, 19, -1, -9},
+    {19, 117, 146, 1, VERSIFICATION_CHAPTER_END, -1, 0},
+    {19, 147, 147, 1, 11, -1, 0},
+    {19, 147, 147, 12, 20, 0, -11},
+    // Daniel 3:24-90 is the Song of the Three Young Men
+    {27, 3, 3, 24, 30, 0, 67},
+    {27, 4, 4, 1, 3, -1, 97},
+    {27, 4, 4, 4, 37, 0, -3},
+};
+
+struct VersificationTable {
+    const VersificationShift* shifts;
+    usize len;
+};
+
+constexpr VersificationTable versification_table(Versification versification) {
+    switch (versification) {
+        case VersificationKjv: return VersificationTable{.shifts = nullptr, .len = 0};
+        case VersificationHebrew:
+            return VersificationTable{
+                .shifts = VERSIFICATION_HEBREW,
+                .len = sizeof(VERSIFICATION_HEBREW) / sizeof(VERSIFICATION_HEBREW[0]),
+            };
+        case VersificationVulgate:
+            return VersificationTable{
+                .shifts = VERSIFICATION_VULGATE,
+                .len = sizeof(VERSIFICATION_VULGATE) / sizeof(VERSIFICATION_VULGATE[0]),
+            };
+    }
+
+    return VersificationTable{.shifts = nullptr, .len = 0};
+}
+
+/// @brief Numbers canonical verse `id` the way `versification` does.
+constexpr VerseId versification_from_canonical(Versification versification, VerseId id) {
+    VersificationTable table = versification_table(versification);
+    u8 book = verse_id_book(id);
+    u16 chapter = verse_id_chapter(id);
+    u16 verse = verse_id_verse(id);
+
+    for (usize i = 0; i < table.len && table.shifts[i].book <= book; i++) {
+        const VersificationShift& shift = table.shifts[i];
+        if (shift.covers(book, chapter, verse)) {
+            return verse_id(
+                book,
+                (u16)(chapter + shift.chapter_shift),
+                (u16)(verse + shift.verse_shift)
+            );
+        }
+    }
+
+    return id;
+}
+
+/// @brief The canonical id of verse `id` as numbered by `versification`.
+/// @return Nothing when the verse has no KJV counterpart, e.g. a psalm title counted as verse 1.
+constexpr std::optional<VerseId>
+versification_to_canonical(Versification versification, VerseId id) {
+    VersificationTable table = versification_table(versification);
+    u8 book = verse_id_book(id);
+    u16 chapter = verse_id_chapter(id);
+    u16 verse = verse_id_verse(id);
+
+    // A number that is not shifted here but is shifted away in KJV numbering names a verse
+    // KJV does not have
+    bool taken = false;
+    for (usize i = 0; i < table.len && table.shifts[i].book <= book; i++) {
+        const VersificationShift& shift = table.shifts[i];
+        if (shift.covers_target(book, chapter, verse)) {
+            return verse_id(
+                book,
+                (u16)(chapter - shift.chapter_shift),
+                (u16)(verse - shift.verse_shift)
+            );
+        }
+        taken = taken || shift.covers(book, chapter, verse);
+    }
+
+    if (taken) return std::nullopt;
+    return id;
+}
+
+// A table is usable when it is ordered by book, open-ended entries are not shifted past the end
+// of a chapter, and no two entries map onto the same verse
+constexpr bool versification_table_valid(Versification versification) {
+    VersificationTable table = versification_table(versification);
+    for (usize i = 0; i < table.len; i++) {
+        const VersificationShift& a = table.shifts[i];
+        if (i > 0 && table.shifts[i - 1].book > a.book) return false;
+        if (a.last_verse == VERSIFICATION_CHAPTER_END && a.verse_shift != 0) return false;
+
+        for (usize j = i + 1; j < table.len; j++) {
+            const VersificationShift& b = table.shifts[j];
+            bool chapters_overlap =
+                a.book == b.book &&
+                a.first_chapter + a.chapter_shift <= b.last_chapter + b.chapter_shift &&
+                b.first_chapter + b.chapter_shift <= a.last_chapter + a.chapter_shift;
+            bool verses_overlap = a.first_verse + a.verse_shift <= b.last_verse + b.verse_shift &&
+                                  b.first_verse + b.verse_shift <= a.last_verse + a.verse_shift;
+            if (chapters_overlap && verses_overlap) return false;
+        }
+    }
+
+    return true;
+}
+
+static_assert(versification_table_valid(VersificationHebrew), "overlapping Hebrew shifts");
+static_assert(versification_table_valid(VersificationVulgate), "overlapping Vulgate shifts");
+static_assert(
+    versification_from_canonical(VersificationHebrew, verse_id(39, 4, 5)) == verse_id(39, 3, 23)
+);
+static_assert(
+    versification_to_canonical(VersificationVulgate, verse_id(19, 9, 22)) == verse_id(19, 10, 1)
+);
+static_assert(
+    versification_from_canonical(VersificationVulgate, verse_id(19, 116, 10)) ==
+    verse_id(19, 115, 1)
+);
+static_assert(
+    versification_from_canonical(VersificationVulgate, verse_id(19, 147, 12)) ==
+    verse_id(19, 147, 1)
+);
@@ -0,0 +1,306 @@
+#pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "def.h"
+#include "string.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <utility>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// Buffered output
+//
+// A Writer collects output as a list of slices and hands them to the OS with one writev() per
+// flush. Small pieces (numbers, separators, formatted text) are copied into the writer's buffer;
+// large ones, such as verse text in a mapped file or an arena, are referenced where they are, so
+// printing a whole book copies none of its text and costs a handful of syscalls.
+
+constexpr usize WRITER_BUFFER_SIZE = KB(64);
+// IOV_MAX on Linux and the BSDs
+constexpr usize WRITER_MAX_SLICES = 1024;
+// Referencing a slice shorter than this costs more than copying it
+constexpr usize WRITER_INLINE_MAX = 32;
+
+#ifdef _WIN32
+struct WriterSlice {
+    void* iov_base;
+    usize iov_len;
+};
+#else
+using WriterSlice = iovec;
+#endif
+
+struct Writer {
+    Allocator allocator;
+    // Destination: a stream, or `list` when there is no stream
+    FILE* stream;
+    ArrayList<char>* list;
+    // Copied bytes, referenced by the slices
+    char* buffer;
+    usize buffer_len;
+    usize buffer_capacity;
+    WriterSlice* slices;
+    usize slice_count;
+    // A write failed, e.g. the reader of a pipe went away; later output is dropped
+    bool failed;
+
+    /// @brief A writer to `stream`. Anything already buffered by stdio on the stream is flushed
+    /// first, so std::print and the writer can be mixed as long as the writer is flushed.
+    static Writer init(Allocator allocator, FILE* stream) {
+        Writer writer = init_buffers(allocator);
+        writer.stream = stream;
+        return writer;
+    }
+
+    /// @brief A writer that appends to `list` on every flush.
+    static Writer init_list(Allocator allocator, ArrayList<char>& list) {
+        Writer writer = init_buffers(allocator);
+        writer.list = &list;
+        return writer;
+    }
+
+    void deinit() {
+        flush();
+        allocator.free_array(buffer, buffer_capacity);
+        allocator.free_array(slices, WRITER_MAX_SLICES);
+        buffer = nullptr;
+        slices = nullptr;
+        buffer_capacity = 0;
+    }
+
+    /// @brief Copies `text`, so it can be reused as soon as this returns.
+    void write(StringSlice text) {
+        if (!make_room(text.len)) {
+            write_direct(text.ptr, text.len);
+            return;
+        }
+
+        memcpy(buffer + buffer_len, text.ptr, text.len);
+        commit(text.len);
+    }
+
+    void write(string text) { write(StringSlice::from_cstr(text)); }
+
+    void write(char c) {
+        if (!make_room(1)) {
+            write_direct(&c, 1);
+            return;
+        }
+
+        buffer[buffer_len] = c;
+        commit(1);
+    }
+
+    /// @brief Writes `text` without copying it: it must stay valid until the next flush().
+    /// Slices shorter than WRITER_INLINE_MAX are copied anyway.
+    void write_ref(StringSlice text) {
+        if (text.len < WRITER_INLINE_MAX || !slices) {
+            write(text);
+            return;
+        }
+
+        if (slice_count > 0) {
+            WriterSlice& last = slices[slice_count - 1];
+            if ((string)last.iov_base + last.iov_len == text.ptr) {
+                last.iov_len += text.len;
+                return;
+            }
+        }
+
+        if (slice_count == WRITER_MAX_SLICES) flush();
+        slices[slice_count++] = WriterSlice{.iov_base = (void*)text.ptr, .iov_len = text.len};
+    }
+
+    void write_number(u64 number) {
+        char digits[20];
+        usize count = 0;
+        do {
+            digits[count++] = (char)('0' + number % 10);
+            number /= 10;
+        } while (number > 0);
+
+        char text[20];
+        for (usize i = 0; i < count; i++) text[i] = digits[count - 1 - i];
+        write(StringSlice::init(text, count));
+    }
+
+    /// @brief std::format into the buffer.
+    template <typename... Args> void print(std::format_string<Args...> format, Args&&... args) {
+        usize room = buffer_capacity - buffer_len;
+        auto result =
+            std::format_to_n(buffer + buffer_len, room, format, std::forward<Args>(args)...);
+        if ((usize)result.size <= room && slice_count < WRITER_MAX_SLICES && buffer) {
+            commit((usize)result.size);
+            return;
+        }
+
+        // Did not fit: retry on an empty buffer, or format on the side when it never will
+        usize size = (usize)result.size;
+        if (make_room(size)) {
+            std::format_to_n(buffer + buffer_len, size, format, std::forward<Args>(args)...);
+            commit(size);
+            return;
+        }
+
+        char* text = allocator.alloc_array<char>(size);
+        if (!text) {
+            failed = true;
+            return;
+        }
+
+        std::format_to_n(text, size, format, std::forward<Args>(args)...);
+        write_direct(text, size);
+        allocator.free_array(text, size);
+    }
+
+    template <typename... Args>
+    void println(std::format_string<Args...> format, Args&&... args) {
+        print(format, std::forward<Args>(args)...);
+        write('\n');
+    }
+
+    /// @brief Writes everything collected so far.
+    /// @return False when a write failed, now or before.
+    bool flush() {
+        if (slice_count > 0 && !failed) {
+            if (stream) {
+                fflush(stream);
+                write_slices(slices, slice_count);
+            } else {
+                for (usize i = 0; i < slice_count && !failed; i++) {
+                    append_to_list((string)slices[i].iov_base, slices[i].iov_len);
+                }
+            }
+        }
+
+        buffer_len = 0;
+        slice_count = 0;
+        return !failed;
+    }
+
+  private:
+    static Writer init_buffers(Allocator allocator) {
+        Writer writer = Writer{
+            .allocator = allocator,
+            .stream = nullptr,
+            .list = nullptr,
+            .buffer = allocator.alloc_array<char>(WRITER_BUFFER_SIZE),
+            .buffer_len = 0,
+            .buffer_capacity = WRITER_BUFFER_SIZE,
+            .slices = allocator.alloc_array<WriterSlice>(WRITER_MAX_SLICES),
+            .slice_count = 0,
+            .failed = false,
+        };
+
+        // Without buffers every write goes straight through
+        if (!writer.buffer || !writer.slices) {
+            allocator.free_array(writer.buffer, WRITER_BUFFER_SIZE);
+            allocator.free_array(writer.slices, WRITER_MAX_SLICES);
+            writer.buffer = nullptr;
+            writer.slices = nullptr;
+            writer.buffer_capacity = 0;
+        }
+
+        return writer;
+    }
+
+    // Flushes when `size` more bytes or one more slice would not fit. Returns false when the
+    // bytes cannot be buffered at all.
+    bool make_room(usize size) {
+        if (!buffer || size > buffer_capacity) return false;
+
+        if (size > buffer_capacity - buffer_len || slice_count == WRITER_MAX_SLICES) flush();
+        return true;
+    }
+
+    // Adds the `size` bytes just copied to the end of the buffer
+    void commit(usize size) {
+        char* start = buffer + buffer_len;
+        buffer_len += size;
+
+        if (slice_count > 0) {
+            WriterSlice& last = slices[slice_count - 1];
+            if ((char*)last.iov_base + last.iov_len == start) {
+                last.iov_len += size;
+                return;
+            }
+        }
+
+        slices[slice_count++] = WriterSlice{.iov_base = start, .iov_len = size};
+    }
+
+    void write_direct(string data, usize len) {
+        flush();
+        if (failed) return;
+
+        if (stream) {
+            fflush(stream);
+            WriterSlice slice = WriterSlice{.iov_base = (void*)data, .iov_len = len};
+            write_slices(&slice, 1);
+        } else {
+            append_to_list(data, len);
+        }
+    }
+
+    void append_to_list(string data, usize len) {
+        if (!list->reserve(len)) {
+            failed = true;
+            return;
+        }
+
+        memcpy(list->items + list->len, data, len);
+        list->len += len;
+    }
+
+    // Writes all of `slices`, resuming after short writes. The slices are consumed.
+    void write_slices(WriterSlice* pending, usize count) {
+#ifdef _WIN32
+        int fd = _fileno(stream);
+        for (usize i = 0; i < count && !failed; i++) {
+            string data = (string)pending[i].iov_base;
+            usize left = pending[i].iov_len;
+            while (left > 0) {
+                int written = _write(fd, data, (unsigned int)(left < GB(1) ? left : GB(1)));
+                if (written <= 0) {
+                    failed = true;
+                    break;
+                }
+
+                data += written;
+                left -= (usize)written;
+            }
+        }
+#else
+        int fd = fileno(stream);
+        while (count > 0) {
+            ssize_t written = writev(fd, pending, (int)count);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                failed = true;
+                return;
+            }
+
+            usize left = (usize)written;
+            while (count > 0 && left >= pending->iov_len) {
+                left -= pending->iov_len;
+                pending++;
+                count--;
+            }
+
+            if (count > 0) {
+                pending->iov_base = (char*)pending->iov_base + left;
+                pending->iov_len -= left;
+            }
+        }
+#endif
+    }
+};
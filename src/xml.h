@@ -0,0 +1,498 @@
+#pragma once
+
+#include "def.h"
+#include "number.h"
+#include "simd.h"
+#include "string.h"
+#include <cstring>
+#include <optional>
+
+enum XmlTokenKind {
+    XmlOpen,      // <name attr="value">
+    XmlClose,     // </name>
+    XmlSelfClose, // <name attr="value"/>
+    XmlText,      // Character data between tags. Entities are not decoded.
+    XmlEnd,       // End of input
+    XmlError,     // Unterminated tag, comment or CDATA section
+};
+
+struct XmlToken {
+    XmlTokenKind kind;
+    // Tag name for XmlOpen, XmlClose and XmlSelfClose
+    StringSlice name;
+    // Raw attribute text for XmlOpen and XmlSelfClose. Use XmlAttributeIterator to walk it.
+    StringSlice attributes;
+    // Raw character data for XmlText
+    StringSlice text;
+    // Byte range of the whole token in the input
+    usize start;
+    usize end;
+};
+
+struct XmlAttribute {
+    StringSlice name;
+    StringSlice value;
+};
+
+/// @brief Walks the `name="value"` pairs of a tag's raw attribute text.
+struct XmlAttributeIterator {
+    StringSlice attributes;
+    usize pos;
+
+    static XmlAttributeIterator init(StringSlice attributes) {
+        return XmlAttributeIterator{
+            .attributes = attributes,
+            .pos = 0,
+        };
+    }
+
+    std::optional<XmlAttribute> next() {
+        string s = attributes.ptr;
+        usize len = attributes.len;
+
+        while (pos < len && is_space(s[pos])) pos++;
+        if (pos >= len) return std::nullopt;
+
+        usize name_start = pos;
+        while (pos < len && s[pos] != '=' && !is_space(s[pos])) pos++;
+        StringSlice name = StringSlice::init(s + name_start, pos - name_start);
+
+        while (pos < len && is_space(s[pos])) pos++;
+        if (pos >= len || s[pos] != '=') {
+            // Attribute without a value (not valid XML, but be lenient)
+            return XmlAttribute{.name = name, .value = StringSlice::init(s + pos, 0)};
+        }
+        pos++;
+
+        while (pos < len && is_space(s[pos])) pos++;
+        if (pos >= len) return XmlAttribute{.name = name, .value = StringSlice::init(s + pos, 0)};
+
+        char quote = s[pos];
+        if (quote != '"' && quote != '\'') {
+            usize value_start = pos;
+            while (pos < len && !is_space(s[pos])) pos++;
+            return XmlAttribute{
+                .name = name,
+                .value = StringSlice::init(s + value_start, pos - value_start),
+            };
+        }
+
+        usize value_start = ++pos;
+        while (pos < len && s[pos] != quote) pos++;
+        StringSlice value = StringSlice::init(s + value_start, pos - value_start);
+        if (pos < len) pos++; // Skip closing quote
+
+        return XmlAttribute{.name = name, .value = value};
+    }
+
+  private:
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+};
+
+/// @brief Finds the value of the attribute `name` in a tag's raw attribute text.
+inline std::optional<StringSlice> xml_find_attribute(StringSlice attributes, string name) {
+    auto it = XmlAttributeIterator::init(attributes);
+
+    while (auto attribute = it.next()) {
+        if (attribute->name.equals(name)) return attribute->value;
+    }
+
+    return std::nullopt;
+}
+
+// Structural classification
+//
+// The tokenizer only ever stops at '<', '>' and quotes (quotes matter because '>' is legal
+// inside attribute values). Each classifier turns a 64-byte block into a bitmask with bit i set
+// when byte i is one of those, and the tokenizer walks the set bits instead of the bytes.
+// Entities ('&') are not structural here: tokens are raw slices and entities are decoded when
+// text is printed or indexed.
+//
+// All classifiers return identical masks; only their speed differs.
+
+constexpr usize XML_BLOCK_SIZE = 64;
+
+typedef u64 (*XmlClassifyFn)(const u8* block);
+
+inline u64 xml_classify_scalar(const u8* block) {
+    u64 mask = 0;
+
+    for (usize i = 0; i < XML_BLOCK_SIZE; i++) {
+        u8 c = block[i];
+        if (c == '<' || c == '>' || c == '"' || c == '\'') mask |= (u64)1 << i;
+    }
+
+    return mask;
+}
+
+#if SIMD_X86
+SIMD_TARGET_SSE2 inline u64 xml_classify_sse2(const u8* block) {
+    __m128i lt = _mm_set1_epi8('<');
+    __m128i gt = _mm_set1_epi8('>');
+    __m128i dquote = _mm_set1_epi8('"');
+    __m128i squote = _mm_set1_epi8('\'');
+
+    u64 mask = 0;
+    for (usize i = 0; i < XML_BLOCK_SIZE; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, lt), _mm_cmpeq_epi8(bytes, gt)),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, dquote), _mm_cmpeq_epi8(bytes, squote))
+        );
+        mask |= (u64)(u16)_mm_movemask_epi8(hits) << i;
+    }
+
+    return mask;
+}
+
+SIMD_TARGET_AVX2 inline u64 xml_classify_avx2(const u8* block) {
+    __m256i lt = _mm256_set1_epi8('<');
+    __m256i gt = _mm256_set1_epi8('>');
+    __m256i dquote = _mm256_set1_epi8('"');
+    __m256i squote = _mm256_set1_epi8('\'');
+
+    u64 mask = 0;
+    for (usize i = 0; i < XML_BLOCK_SIZE; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, lt), _mm256_cmpeq_epi8(bytes, gt)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, dquote), _mm256_cmpeq_epi8(bytes, squote))
+        );
+        mask |= (u64)(u32)_mm256_movemask_epi8(hits) << i;
+    }
+
+    return mask;
+}
+#endif
+
+inline XmlClassifyFn xml_classify_for(SimdLevel level) {
+#if SIMD_X86
+    if (level == SimdAvx2) return xml_classify_avx2;
+    if (level == SimdSse2) return xml_classify_sse2;
+#endif
+    (void)level;
+    return xml_classify_scalar;
+}
+
+/// @brief Pull tokenizer over an XML document held in memory.
+/// Every token is a slice of the input; nothing is copied or allocated. Comments, processing
+/// instructions and DOCTYPE declarations are skipped.
+struct XmlTokenizer {
+    string data;
+    usize len;
+    usize pos;
+
+    XmlClassifyFn classify;
+    // Structural bitmask of the 64-byte block starting at `mask_base`
+    u64 mask;
+    usize mask_base;
+
+    /// @brief Creates a tokenizer over `data[start..len)`. Token offsets are always relative to
+    /// `data`, so several tokenizers can work on different ranges of the same buffer.
+    static XmlTokenizer init(string data, usize len, usize start = 0) {
+        return init(data, len, start, simd_level());
+    }
+
+    /// @brief Same as above, but with an explicit instruction set for the classifier.
+    static XmlTokenizer init(string data, usize len, usize start, SimdLevel level) {
+        return XmlTokenizer{
+            .data = data,
+            .len = len,
+            .pos = start,
+            .classify = xml_classify_for(level),
+            .mask = 0,
+            .mask_base = USIZE_MAX,
+        };
+    }
+
+    XmlToken next() {
+        while (pos < len) {
+            usize start = pos;
+
+            if (data[pos] != '<') {
+                pos = find_structural(pos, '<');
+                return text_token(start, pos);
+            }
+
+            if (starts_with(pos, "<!--")) {
+                if (!skip_past(pos + 4, "-->")) return error_token(start);
+                continue;
+            }
+
+            if (starts_with(pos, "<![CDATA[")) {
+                usize content_start = pos + 9;
+                if (!skip_past(content_start, "]]>")) return error_token(start);
+                return text_token(content_start, pos - 3);
+            }
+
+            if (starts_with(pos, "<?") || starts_with(pos, "<!")) {
+                string gt = (string)memchr(data + pos, '>', len - pos);
+                if (!gt) return error_token(start);
+                pos = (usize)(gt - data) + 1;
+                continue;
+            }
+
+            return tag_token(start);
+        }
+
+        return XmlToken{
+            .kind = XmlEnd,
+            .name = {},
+            .attributes = {},
+            .text = {},
+            .start = len,
+            .end = len,
+        };
+    }
+
+  private:
+    XmlToken tag_token(usize start) {
+        bool closing = start + 1 < len && data[start + 1] == '/';
+        usize name_start = start + (closing ? 2 : 1);
+        usize name_end = name_start;
+
+        while (name_end < len && !is_name_end(data[name_end])) name_end++;
+
+        // Find the closing '>' while skipping over quoted attribute values
+        usize i = next_structural(name_end);
+        char quote = 0;
+        while (i < len) {
+            char c = data[i];
+            if (quote) {
+                if (c == quote) quote = 0;
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+            } else if (c == '>') {
+                break;
+            }
+            i = next_structural(i + 1);
+        }
+
+        if (i >= len) {
+            pos = len;
+            return error_token(start);
+        }
+
+        pos = i + 1;
+
+        bool self_closing = !closing && i > name_end && data[i - 1] == '/';
+        usize attributes_end = self_closing ? i - 1 : i;
+
+        return XmlToken{
+            .kind = closing ? XmlClose : (self_closing ? XmlSelfClose : XmlOpen),
+            .name = StringSlice::init(data + name_start, name_end - name_start),
+            .attributes = StringSlice::init(data + name_end, attributes_end - name_end),
+            .text = {},
+            .start = start,
+            .end = pos,
+        };
+    }
+
+    XmlToken text_token(usize start, usize end) {
+        return XmlToken{
+            .kind = XmlText,
+            .name = {},
+            .attributes = {},
+            .text = StringSlice::init(data + start, end - start),
+            .start = start,
+            .end = pos,
+        };
+    }
+
+    XmlToken error_token(usize start) {
+        return XmlToken{
+            .kind = XmlError,
+            .name = {},
+            .attributes = {},
+            .text = {},
+            .start = start,
+            .end = len,
+        };
+    }
+
+    // Position of the next structural byte at or after `from`, or `len` if there is none.
+    usize next_structural(usize from) {
+        while (from < len) {
+            usize block_start = from & ~(XML_BLOCK_SIZE - 1);
+
+            if (block_start != mask_base) {
+                mask = classify_block(block_start);
+                mask_base = block_start;
+            }
+
+            u64 bits = mask & (~(u64)0 << (from - block_start));
+            if (bits) {
+                usize found = block_start + simd_ctz64(bits);
+                return found < len ? found : len;
+            }
+
+            from = block_start + XML_BLOCK_SIZE;
+        }
+
+        return len;
+    }
+
+    // Position of the next `c` (which must be structural) at or after `from`, or `len`.
+    usize find_structural(usize from, char c) {
+        usize i = next_structural(from);
+        while (i < len && data[i] != c) i = next_structural(i + 1);
+        return i;
+    }
+
+    u64 classify_block(usize block_start) {
+        if (block_start + XML_BLOCK_SIZE <= len) return classify((const u8*)data + block_start);
+
+        // The last partial block is classified from a zero-padded copy so no classifier ever
+        // reads past the end of the input
+        u8 tail[XML_BLOCK_SIZE] = {};
+        memcpy(tail, data + block_start, len - block_start);
+        return classify(tail);
+    }
+
+    bool starts_with(usize at, string prefix) {
+        usize prefix_len = strlen(prefix);
+        return at + prefix_len <= len && memcmp(data + at, prefix, prefix_len) == 0;
+    }
+
+    // Moves `pos` just past the next occurrence of `terminator` at or after `from`.
+    bool skip_past(usize from, string terminator) {
+        usize terminator_len = strlen(terminator);
+
+        for (usize i = from; i + terminator_len <= len; i++) {
+            if (data[i] == terminator[0] && memcmp(data + i, terminator, terminator_len) == 0) {
+                pos = i + terminator_len;
+                return true;
+            }
+        }
+
+        pos = len;
+        return false;
+    }
+
+    static bool is_name_end(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '>' || c == '/';
+    }
+};
+
+/// @brief Decodes the body of an entity reference (the part between '&' and ';') as UTF-8.
+/// @return The number of bytes written to `out` (at most 4), or 0 for unknown entities.
+inline usize decode_entity(StringSlice entity, mut_string out) {
+    u32 code_point = 0;
+
+    if (entity.equals("amp")) code_point = '&';
+    else if (entity.equals("lt")) code_point = '<';
+    else if (entity.equals("gt")) code_point = '>';
+    else if (entity.equals("quot")) code_point = '"';
+    else if (entity.equals("apos")) code_point = '\'';
+    else if (entity.len < 2 || entity.ptr[0] != '#') return 0;
+    else if (entity.ptr[1] == 'x' || entity.ptr[1] == 'X') {
+        if (entity.len < 3 || entity.len > 8) return 0;
+
+        for (usize i = 2; i < entity.len; i++) {
+            char c = entity.ptr[i];
+            u32 digit;
+            if (c >= '0' && c <= '9') digit = (u32)(c - '0');
+            else if (c >= 'a' && c <= 'f') digit = (u32)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') digit = (u32)(c - 'A' + 10);
+            else return 0;
+            code_point = code_point * 16 + digit;
+        }
+    } else {
+        auto decimal = uint_from_digits<u32>(entity.ptr + 1, entity.len - 1);
+        if (!decimal.has_value()) return 0;
+        code_point = decimal.value();
+    }
+
+    if (code_point < 0x80) {
+        out[0] = (char)code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char)(0xC0 | (code_point >> 6));
+        out[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char)(0xE0 | (code_point >> 12));
+        out[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    if (code_point < 0x110000) {
+        out[0] = (char)(0xF0 | (code_point >> 18));
+        out[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (code_point & 0x3F));
+        return 4;
+    }
+
+    return 0;
+}
+
+/// @brief Calls `emit(StringSlice)` for every run of plain text in raw XML character data.
+/// Nested tags are dropped and entities are decoded. Runs of untouched text are slices of
+/// `raw`; decoded entities are handed out from a small stack buffer.
+template <typename F> inline void xml_text_runs(StringSlice raw, F emit) {
+    string s = raw.ptr;
+    usize len = raw.len;
+    usize run_start = 0;
+    usize i = 0;
+
+    while (i < len) {
+        char c = s[i];
+
+        if (c == '<') {
+            if (i > run_start) emit(StringSlice::init(s + run_start, i - run_start));
+
+            string gt = (string)memchr(s + i, '>', len - i);
+            i = gt ? (usize)(gt - s) + 1 : len;
+            run_start = i;
+            continue;
+        }
+
+        if (c == '&') {
+            string semicolon = (string)memchr(s + i, ';', len - i < 12 ? len - i : 12);
+            if (!semicolon) {
+                i++;
+                continue;
+            }
+
+            char decoded[4];
+            usize decoded_len = decode_entity(
+                StringSlice::init(s + i + 1, (usize)(semicolon - s) - i - 1),
+                decoded
+            );
+            if (decoded_len == 0) { // Unknown entity, keep it verbatim
+                i++;
+                continue;
+            }
+
+            if (i > run_start) emit(StringSlice::init(s + run_start, i - run_start));
+            emit(StringSlice::init(decoded, decoded_len));
+
+            i = (usize)(semicolon - s) + 1;
+            run_start = i;
+            continue;
+        }
+
+        i++;
+    }
+
+    if (len > run_start) emit(StringSlice::init(s + run_start, len - run_start));
+}
+
+/// @brief Decodes raw XML character data into `out`, dropping nested tags.
+/// @param raw The raw character data.
+/// @param out Output buffer. The decoded text is never longer than `raw`, so `raw.len` bytes
+/// are always enough.
+/// @return The number of bytes written to `out`.
+inline usize xml_decode_text(StringSlice raw, mut_string out) {
+    usize written = 0;
+
+    xml_text_runs(raw, [&](StringSlice run) {
+        memcpy(out + written, run.ptr, run.len);
+        written += run.len;
+    });
+
+    return written;
+}
@@ -0,0 +1,349 @@
+#pragma once
+
+#include "allocator.h"
+#include "array.h"
+#include "bible.h"
+#include "books.h"
+#include "def.h"
+#include "file.h"
+#include "index.h"
+#include "number.h"
+#include "string.h"
+#include "trace.h"
+#include "versification.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <optional>
+
+// Cross-reference graph (.bxref)
+//
+// Verse-to-verse references with vote weights, as in the OpenBible.info dataset, stored as a
+// compressed sparse row (CSR) graph: the verses that have references, ascending, and for each
+// one a range of a single edge array, best voted first. A verse's references are a binary
+// search and one contiguous slice, and the three arrays are persisted as they are and mapped
+// like the Bible index. Verses are canonical ids, so one graph serves every translation.
+//
+//   XrefHeader
+//   VerseId  sources[source_count]      ascending
+//   u32      offsets[source_count + 1]  edge range of sources[i] is [offsets[i], offsets[i + 1])
+//   XrefEdge edges[edge_count]
+
+constexpr char XREF_MAGIC[4] = {'B', 'X', 'R', 'F'};
+constexpr u32 XREF_VERSION = 1;
+constexpr string XREF_EXTENSION = ".bxref";
+// Verses a walk visits at most, which also keeps its duplicate check cheap
+constexpr usize XREF_MAX_VISITS = 4096;
+
+struct XrefHeader {
+    char magic[4];
+    u32 version;
+    u32 source_count;
+    u32 edge_count;
+
+    u64 sources_offset;
+    u64 offsets_offset;
+    u64 edges_offset;
+};
+
+/// @brief A reference to verses `target` to `target_last`, which is the same verse for most.
+struct XrefEdge {
+    VerseId target;
+    VerseId target_last;
+    i32 votes;
+};
+
+static_assert(sizeof(XrefEdge) == 12, "XrefEdge layout is part of the graph format");
+
+/// @brief A verse reached by XrefGraph::walk(), `depth` references away from the start.
+struct XrefVisit {
+    XrefEdge edge;
+    u32 depth;
+};
+
+struct XrefGraph {
+    MappedFile file;
+    const VerseId* sources;
+    const u32* offsets;
+    const XrefEdge* edges;
+    usize source_count;
+
+    /// @brief Writes the graph path for a Bible file into `out`: `<file>.bxref`, where a
+    /// `<file>.bidx` index path gives the same path as its XML file.
+    /// @return False if the buffer is too small.
+    static bool path_for(string bible_path, mut_string out, usize out_size) {
+        usize len = strlen(bible_path);
+        if (BibleIndex::is_index_path(bible_path)) len -= strlen(BIBLE_INDEX_EXTENSION);
+
+        i32 written = snprintf(out, out_size, "%.*s%s", (i32)len, bible_path, XREF_EXTENSION);
+        return written > 0 && (usize)written < out_size;
+    }
+
+    /// @brief Compiles a tab-separated cross-reference list into a graph file at `path`.
+    /// Lines are `From<TAB>To<TAB>Votes` with OSIS-style references (`Gen.1.1`, or a range
+    /// `Isa.40.26-Isa.40.28` as the target), as in the OpenBible.info export. The header line,
+    /// `#` comments and lines that do not parse are skipped.
+    /// @return The error, or the number of edges written.
+    static std::expected<usize, BibleError> build(string tsv_path, string path) {
+        trace_scope("xref build");
+
+        auto tsv = MappedFile::init(tsv_path);
+        if (!tsv.has_value()) return std::unexpected(BibleFileNotFound);
+        defer { tsv->deinit(); };
+
+        tsv->advise_sequential();
+
+        ArenaAllocator arena = ArenaAllocator::init(PageAllocator::init(), MB(1));
+        Allocator allocator = arena.allocator();
+        defer { arena.deinit(); };
+
+        auto parsed = ArrayList<SourcedEdge>::init(allocator);
+        string cursor = (string)tsv->data;
+        string end = cursor + tsv->size;
+        while (cursor < end) {
+            string line_end = (string)memchr(cursor, '\n', (usize)(end - cursor));
+            if (!line_end) line_end = end;
+
+            auto edge = parse_line(StringSlice::init(cursor, (usize)(line_end - cursor)));
+            if (edge.has_value() && !parsed.append(edge.value())) {
+                return std::unexpected(BibleOutOfMemory);
+            }
+            cursor = line_end + 1;
+        }
+
+        // Grouped by source, best voted first; ties in canonical order, so output is stable
+        std::sort(parsed.items, parsed.items + parsed.len, [](SourcedEdge& a, SourcedEdge& b) {
+            if (a.source != b.source) return a.source < b.source;
+            if (a.edge.votes != b.edge.votes) return a.edge.votes > b.edge.votes;
+            return a.edge.target < b.edge.target;
+        });
+
+        usize source_count = 0;
+        for (usize i = 0; i < parsed.len; i++) {
+            if (i == 0 || parsed.items[i].source != parsed.items[i - 1].source) source_count++;
+        }
+
+        VerseId* sources = allocator.alloc_array<VerseId>(source_count + 1);
+        u32* offsets = allocator.alloc_array<u32>(source_count + 1);
+        XrefEdge* edges = allocator.alloc_array<XrefEdge>(parsed.len + 1);
+        if (!sources || !offsets || !edges) return std::unexpected(BibleOutOfMemory);
+
+        usize source = 0;
+        for (usize i = 0; i < parsed.len; i++) {
+            if (i == 0 || parsed.items[i].source != parsed.items[i - 1].source) {
+                sources[source] = parsed.items[i].source;
+                offsets[source++] = (u32)i;
+            }
+            edges[i] = parsed.items[i].edge;
+        }
+        offsets[source_count] = (u32)parsed.len;
+
+        XrefHeader header = {};
+        memcpy(header.magic, XREF_MAGIC, sizeof(header.magic));
+        header.version = XREF_VERSION;
+        header.source_count = (u32)source_count;
+        header.edge_count = (u32)parsed.len;
+        header.sources_offset = file_align(sizeof(XrefHeader));
+        header.offsets_offset = file_align(header.sources_offset + sizeof(VerseId) * source_count);
+        header.edges_offset = file_align(header.offsets_offset + sizeof(u32) * (source_count + 1));
+
+        auto opened = AtomicFileWriter::init(path);
+        if (!opened.has_value()) return std::unexpected(BibleWriteFailed);
+
+        AtomicFileWriter& writer = opened.value();
+        writer.write_section(0, &header, sizeof(header));
+        writer.write_section(header.sources_offset, sources, sizeof(VerseId) * source_count);
+        writer.write_section(header.offsets_offset, offsets, sizeof(u32) * (source_count + 1));
+        writer.write_section(header.edges_offset, edges, sizeof(XrefEdge) * parsed.len);
+
+        if (!writer.commit()) return std::unexpected(BibleWriteFailed);
+
+        return parsed.len;
+    }
+
+    /// @brief Maps a graph file.
+    static std::expected<XrefGraph, BibleError> load(string path) {
+        auto file = MappedFile::init(path);
+        if (!file.has_value()) return std::unexpected(BibleFileNotFound);
+
+        auto graph = from_mapping(file.value());
+        if (!graph.has_value()) file->deinit();
+
+        return graph;
+    }
+
+    void deinit() { file.deinit(); }
+
+    /// @brief References of the verse `id`, best voted first.
+    /// @return The edges, or an empty slice when the verse has none.
+    const XrefEdge* edges_of(VerseId id, usize& count) {
+        const VerseId* found = std::lower_bound(sources, sources + source_count, id);
+        if (found == sources + source_count || *found != id) {
+            count = 0;
+            return edges;
+        }
+
+        usize source = (usize)(found - sources);
+        count = offsets[source + 1] - offsets[source];
+        return edges + offsets[source];
+    }
+
+    /// @brief Breadth-first walk from the verse `start`: its `limit` best references, then
+    /// theirs, up to `depth` references away. Verses are visited once, at their shortest
+    /// depth, and the walk stops after XREF_MAX_VISITS verses.
+    /// @param visits Cleared, then filled in visiting order (so by depth).
+    /// @return False when out of memory.
+    bool walk(VerseId start, usize limit, usize depth, ArrayList<XrefVisit>& visits) {
+        visits.clear();
+
+        // `visits` doubles as the queue: the ones before `next` have been expanded
+        usize next = 0;
+        VerseId from = start;
+        u32 from_depth = 0;
+        while (from_depth < depth) {
+            usize count = 0;
+            const XrefEdge* out = edges_of(from, count);
+
+            for (usize i = 0; i < count && i < limit; i++) {
+                if (visits.len == XREF_MAX_VISITS) return true;
+                if (out[i].target == start || visited(visits, out[i].target)) continue;
+
+                XrefVisit visit = XrefVisit{.edge = out[i], .depth = from_depth + 1};
+                if (!visits.append(visit)) return false;
+            }
+
+            if (next == visits.len) break;
+            from = visits.items[next].edge.target;
+            from_depth = visits.items[next].depth;
+            next++;
+        }
+
+        return true;
+    }
+
+  private:
+    struct SourcedEdge {
+        VerseId source;
+        XrefEdge edge;
+    };
+
+    static bool visited(ArrayList<XrefVisit>& visits, VerseId id) {
+        for (usize i = 0; i < visits.len; i++) {
+            if (visits.items[i].edge.target == id) return true;
+        }
+
+        return false;
+    }
+
+    // "Gen.1.1" as a canonical id
+    static std::optional<VerseId> parse_reference(StringSlice text) {
+        string first_dot = (string)memchr(text.ptr, '.', text.len);
+        if (!first_dot) return std::nullopt;
+
+        StringSlice book = StringSlice::init(text.ptr, (usize)(first_dot - text.ptr));
+        StringSlice rest = text.sub(book.len + 1);
+        string second_dot = (string)memchr(rest.ptr, '.', rest.len);
+        if (!second_dot) return std::nullopt;
+
+        usize chapter_len = (usize)(second_dot - rest.ptr);
+        auto id = book_id_from_name(book);
+        auto chapter = uint_from_digits<u16>(rest.ptr, chapter_len);
+        auto verse = uint_from_digits<u16>(second_dot + 1, rest.len - chapter_len - 1);
+        if (!id.has_value() || !chapter.has_value() || !verse.has_value() ||
+            chapter.value() > VERSE_ID_MAX_CHAPTER) {
+            return std::nullopt;
+        }
+
+        return verse_id(id.value(), chapter.value(), verse.value());
+    }
+
+    // "Gen.1.1<TAB>Isa.40.26-Isa.40.28<TAB>12"
+    static std::optional<SourcedEdge> parse_line(StringSlice line) {
+        line = line.trim();
+        if (line.is_empty() || line.ptr[0] == '#') return std::nullopt;
+
+        StringSlice fields[3];
+        usize field_count = 0;
+        usize start = 0;
+        for (usize i = 0; i <= line.len && field_count < 3; i++) {
+            if (i < line.len && line.ptr[i] != '\t') continue;
+
+            fields[field_count++] = line.sub(start, i - start).trim();
+            start = i + 1;
+        }
+        if (field_count < 3) return std::nullopt;
+
+        StringSlice target = fields[1];
+        StringSlice target_last = target;
+        string dash = (string)memchr(target.ptr, '-', target.len);
+        if (dash) {
+            target = StringSlice::init(fields[1].ptr, (usize)(dash - fields[1].ptr));
+            target_last = fields[1].sub(target.len + 1);
+        }
+
+        StringSlice votes_text = fields[2];
+        bool negative = !votes_text.is_empty() && votes_text.ptr[0] == '-';
+        if (negative) votes_text = votes_text.sub(1);
+
+        auto source = parse_reference(fields[0]);
+        auto first = parse_reference(target);
+        auto last = parse_reference(target_last);
+        auto votes = uint_from_digits<i32>(votes_text.ptr, votes_text.len);
+        if (!source.has_value() || !first.has_value() || !last.has_value() ||
+            !votes.has_value() || last.value() < first.value()) {
+            return std::nullopt;
+        }
+
+        return SourcedEdge{
+            .source = source.value(),
+            .edge =
+                XrefEdge{
+                    .target = first.value(),
+                    .target_last = last.value(),
+                    .votes = negative ? -votes.value() : votes.value(),
+                },
+        };
+    }
+
+    static std::expected<XrefGraph, BibleError> from_mapping(MappedFile file) {
+        if (file.size < sizeof(XrefHeader)) return std::unexpected(BibleInvalidIndex);
+
+        XrefHeader* header = (XrefHeader*)file.data;
+        if (memcmp(header->magic, XREF_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != XREF_VERSION) {
+            return std::unexpected(BibleInvalidIndex);
+        }
+
+        u64 sources_size = sizeof(VerseId) * (u64)header->source_count;
+        u64 offsets_size = sizeof(u32) * ((u64)header->source_count + 1);
+        u64 edges_size = sizeof(XrefEdge) * (u64)header->edge_count;
+        bool valid = header->sources_offset % 8 == 0 && header->offsets_offset % 8 == 0 &&
+                     header->edges_offset % 8 == 0 && header->sources_offset <= file.size &&
+                     sources_size <= file.size - header->sources_offset &&
+                     header->offsets_offset <= file.size &&
+                     offsets_size <= file.size - header->offsets_offset &&
+                     header->edges_offset <= file.size &&
+                     edges_size <= file.size - header->edges_offset;
+        if (!valid) return std::unexpected(BibleInvalidIndex);
+
+        // Edge ranges must be in order and inside the edge array
+        const u32* offsets = (const u32*)(file.data + header->offsets_offset);
+        for (u32 i = 0; i < header->source_count; i++) {
+            if (offsets[i] > offsets[i + 1]) return std::unexpected(BibleInvalidIndex);
+        }
+        if (offsets[header->source_count] > header->edge_count) {
+            return std::unexpected(BibleInvalidIndex);
+        }
+
+        file.advise_random();
+
+        return XrefGraph{
+            .file = file,
+            .sources = (const VerseId*)(file.data + header->sources_offset),
+            .offsets = offsets,
+            .edges = (const XrefEdge*)(file.data + header->edges_offset),
+            .source_count = header->source_count,
+        };
+    }
+};